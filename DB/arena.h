@@ -0,0 +1,132 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <memory_resource>
+#include <vector>
+#include <string>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+using namespace std;
+
+// per-statement bump allocator. Operators, their row buffers and temporary
+// keys are carved out of 64 KiB chunks and released all at once when the
+// statement's plan goes away. Chunks come from a small per-thread cache, so
+// once a thread has warmed up a statement does not touch the global heap and
+// threads never contend on it.
+// Not thread safe: worker threads must not allocate from a shared arena.
+class Arena : public pmr::memory_resource {
+public:
+    static constexpr size_t kChunk = 64 * 1024;
+
+private:
+    struct Chunk {
+        Chunk* next;
+        size_t size;    // bytes after the header
+    };
+
+    // standard-size chunks kept by each thread between statements
+    struct Cache {
+        static constexpr int kKeep = 16;
+        Chunk* free = nullptr;
+        int count = 0;
+
+        ~Cache() {
+            while (free) {
+                Chunk* c = free;
+                free = c->next;
+                ::operator delete(c);
+            }
+        }
+    };
+
+    static Cache& cache() {
+        thread_local Cache c;
+        return c;
+    }
+
+    Chunk* head_ = nullptr;
+    char* cur_ = nullptr;
+    char* end_ = nullptr;
+    size_t used_ = 0, chunks_ = 0;
+
+    static char* dataOf(Chunk* c) { return reinterpret_cast<char*>(c + 1); }
+
+    void grow(size_t need) {
+        Chunk* c;
+        Cache& k = cache();
+        if (need <= kChunk && k.free) {
+            c = k.free;
+            k.free = c->next;
+            --k.count;
+        }
+        else {
+            size_t size = max(need, kChunk);
+            c = static_cast<Chunk*>(::operator new(sizeof(Chunk) + size));
+            c->size = size;
+        }
+        c->next = head_;
+        head_ = c;
+        cur_ = dataOf(c);
+        end_ = cur_ + c->size;
+        ++chunks_;
+    }
+
+protected:
+    void* do_allocate(size_t bytes, size_t align) override {
+        uintptr_t p = (reinterpret_cast<uintptr_t>(cur_) + align - 1) & ~(uintptr_t)(align - 1);
+        if (!cur_ || p + bytes > reinterpret_cast<uintptr_t>(end_)) {
+            grow(bytes + align);
+            p = (reinterpret_cast<uintptr_t>(cur_) + align - 1) & ~(uintptr_t)(align - 1);
+        }
+        cur_ = reinterpret_cast<char*>(p + bytes);
+        used_ += bytes;
+        return reinterpret_cast<void*>(p);
+    }
+
+    void do_deallocate(void*, size_t, size_t) override {}  // freed with the arena
+
+    bool do_is_equal(const pmr::memory_resource& o) const noexcept override { return this == &o; }
+
+public:
+    Arena() {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena() {
+        Cache& k = cache();
+        while (head_) {
+            Chunk* c = head_;
+            head_ = c->next;
+            if (c->size == kChunk && k.count < Cache::kKeep) {
+                c->next = k.free;
+                k.free = c;
+                ++k.count;
+            }
+            else
+                ::operator delete(c);
+        }
+    }
+
+    // constructs a T in the arena; destroy it with ArenaDelete (memory is not returned)
+    template <class T, class... Args>
+    T* make(Args&&... args) {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    size_t bytesUsed() const { return used_; }
+    size_t chunkCount() const { return chunks_; }
+};
+
+// unique_ptr deleter for objects made by Arena::make: runs the destructor only
+struct ArenaDelete {
+    template <class T>
+    void operator()(T* p) const { p->~T(); }
+};
+
+// a row of cells whose storage lives in an arena
+using ArenaRow = pmr::vector<pmr::string>;
+
+#endif // ARENA_H
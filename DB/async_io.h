@@ -0,0 +1,595 @@
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include "thread_pool.h"
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// asynchronous file I/O for table loads and saves. Reads run ahead of the
+// parser in large aligned chunks, writes of several files are all in flight
+// at once. Linux uses io_uring (raw syscalls, no liburing); elsewhere, or when
+// the kernel refuses a ring, a small thread pool does the reads and writes.
+
+const size_t kIoChunk = 1 << 20;    // bytes per read / write request
+const size_t kIoAlign = 4096;
+const unsigned kIoDepth = 32;       // requests in flight per queue
+
+// an open file; the mutex serializes seek + read/write on the thread-pool path
+struct IoFile {
+    FILE* fp = nullptr;
+    mutex mu;
+
+    IoFile() = default;
+    IoFile(const IoFile&) = delete;
+    IoFile& operator=(const IoFile&) = delete;
+    ~IoFile() { close(); }
+
+    bool open(const string& path, bool write)
+    {
+        fp = fopen(path.c_str(), write ? "wb" : "rb");
+        return fp != nullptr;
+    }
+
+    void close()
+    {
+        if (fp)
+            fclose(fp);
+        fp = nullptr;
+    }
+
+    bool seek(uint64_t off)
+    {
+#ifdef _WIN32
+        return _fseeki64(fp, (long long)off, SEEK_SET) == 0;
+#else
+        return fseeko(fp, (off_t)off, SEEK_SET) == 0;
+#endif
+    }
+
+    uint64_t size()
+    {
+#ifdef __linux__
+        struct stat st;
+        return fstat(fileno(fp), &st) == 0 ? (uint64_t)st.st_size : 0;
+#else
+        lock_guard<mutex> lk(mu);
+        fseek(fp, 0, SEEK_END);
+        long long n = ftell(fp);
+        return n > 0 ? (uint64_t)n : 0;
+#endif
+    }
+};
+
+namespace aio {
+
+// false forces the thread pool even where io_uring works (db --io threads)
+inline atomic<bool>& uringEnabled()
+{
+    static atomic<bool> on{ true };
+    return on;
+}
+
+inline ThreadPool& pool()
+{
+    static ThreadPool p(4);
+    return p;
+}
+
+#ifdef __linux__
+// the submission / completion rings of one io_uring instance
+class Ring {
+    int fd_ = -1;
+    void* sq_ = MAP_FAILED;
+    void* cq_ = MAP_FAILED;
+    size_t sqBytes_ = 0, cqBytes_ = 0;
+    io_uring_sqe* sqes_ = (io_uring_sqe*)MAP_FAILED;
+    unsigned entries_ = 0;
+    unsigned *sqHead_ = nullptr, *sqTail_ = nullptr, *sqMask_ = nullptr, *sqArray_ = nullptr;
+    unsigned *cqHead_ = nullptr, *cqTail_ = nullptr, *cqMask_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+
+    static unsigned load(unsigned* p) { return atomic_ref<unsigned>(*p).load(memory_order_acquire); }
+    static void store(unsigned* p, unsigned v) { atomic_ref<unsigned>(*p).store(v, memory_order_release); }
+
+public:
+    Ring() = default;
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+
+    ~Ring()
+    {
+        if (sqes_ != MAP_FAILED)
+            munmap(sqes_, entries_ * sizeof(io_uring_sqe));
+        if (cq_ != MAP_FAILED && cq_ != sq_)
+            munmap(cq_, cqBytes_);
+        if (sq_ != MAP_FAILED)
+            munmap(sq_, sqBytes_);
+        if (fd_ >= 0)
+            ::close(fd_);
+    }
+
+    // false when the kernel has no io_uring (or a seccomp filter hides it)
+    bool init(unsigned entries)
+    {
+        io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        fd_ = (int)syscall(__NR_io_uring_setup, entries, &p);
+        if (fd_ < 0)
+            return false;
+        if (!(p.features & IORING_FEAT_NODROP) || !(p.features & IORING_FEAT_FAST_POLL))
+            return false;   // before 5.7: no IORING_OP_READ / WRITE to rely on
+
+        sqBytes_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cqBytes_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+        bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+        if (single)
+            sqBytes_ = cqBytes_ = max(sqBytes_, cqBytes_);
+
+        sq_ = mmap(nullptr, sqBytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+        if (sq_ == MAP_FAILED)
+            return false;
+        cq_ = single ? sq_ : mmap(nullptr, cqBytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        if (cq_ == MAP_FAILED)
+            return false;
+        entries_ = p.sq_entries;
+        sqes_ = (io_uring_sqe*)mmap(nullptr, entries_ * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+        if (sqes_ == MAP_FAILED)
+            return false;
+
+        char* sq = (char*)sq_;
+        char* cq = (char*)cq_;
+        sqHead_ = (unsigned*)(sq + p.sq_off.head);
+        sqTail_ = (unsigned*)(sq + p.sq_off.tail);
+        sqMask_ = (unsigned*)(sq + p.sq_off.ring_mask);
+        sqArray_ = (unsigned*)(sq + p.sq_off.array);
+        cqHead_ = (unsigned*)(cq + p.cq_off.head);
+        cqTail_ = (unsigned*)(cq + p.cq_off.tail);
+        cqMask_ = (unsigned*)(cq + p.cq_off.ring_mask);
+        cqes_ = (io_uring_cqe*)(cq + p.cq_off.cqes);
+        return true;
+    }
+
+    // queues one read / write and hands it to the kernel right away,
+    // the caller keeps at most entries() requests in flight
+    bool submit(uint8_t op, int fd, void* buf, size_t len, uint64_t off, uint64_t tag)
+    {
+        unsigned tail = *sqTail_;
+        unsigned idx = tail & *sqMask_;
+        io_uring_sqe& e = sqes_[idx];
+        memset(&e, 0, sizeof(e));
+        e.opcode = op;
+        e.fd = fd;
+        e.addr = (uint64_t)(uintptr_t)buf;
+        e.len = (uint32_t)len;
+        e.off = off;
+        e.user_data = tag;
+        sqArray_[idx] = idx;
+        store(sqTail_, tail + 1);
+        return syscall(__NR_io_uring_enter, fd_, 1, 0, 0, nullptr, 0) == 1;
+    }
+
+    // blocks for the next completion
+    bool reap(uint64_t& tag, long long& res)
+    {
+        while (true) {
+            unsigned head = *cqHead_;
+            if (head != load(cqTail_)) {
+                const io_uring_cqe& c = cqes_[head & *cqMask_];
+                tag = c.user_data;
+                res = c.res;
+                store(cqHead_, head + 1);
+                return true;
+            }
+            if (syscall(__NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR)
+                return false;
+        }
+    }
+};
+#endif
+
+// one caller's requests and their completions. Requests carry a tag, a
+// completion gives it back with the byte count or -errno; order is not kept.
+class Queue {
+public:
+    struct Done {
+        uint64_t tag;
+        long long res;
+    };
+
+private:
+#ifdef __linux__
+    unique_ptr<Ring> ring_;
+#endif
+    size_t inflight_ = 0;
+    deque<Done> ready_;     // thread pool completions, or reaped early to make room
+    mutex mu_;
+    condition_variable cv_;
+
+    void finish(Done d)
+    {
+        {
+            lock_guard<mutex> lk(mu_);
+            ready_.push_back(d);
+        }
+        cv_.notify_one();
+    }
+
+    // frees a ring slot by pulling one completion aside
+    void makeRoom()
+    {
+#ifdef __linux__
+        if (ring_ && inflight_ - ready_.size() >= kIoDepth) {
+            Done d{};
+            ring_->reap(d.tag, d.res);
+            ready_.push_back(d);
+        }
+#endif
+    }
+
+    void start(bool write, IoFile& f, char* buf, size_t len, uint64_t off, uint64_t tag)
+    {
+        ++inflight_;
+#ifdef __linux__
+        if (ring_) {
+            makeRoom();
+            if (ring_->submit(write ? IORING_OP_WRITE : IORING_OP_READ, fileno(f.fp), buf, len, off, tag))
+                return;
+            ready_.push_back({ tag, -(long long)EIO });
+            return;
+        }
+#endif
+        pool().submit([this, write, &f, buf, len, off, tag] {
+            long long res;
+            {
+                lock_guard<mutex> lk(f.mu);
+                if (!f.seek(off))
+                    res = -(long long)EIO;
+                else {
+                    size_t n = write ? fwrite(buf, 1, len, f.fp) : fread(buf, 1, len, f.fp);
+                    res = n == len || !ferror(f.fp) ? (long long)n : -(long long)EIO;
+                    if (write && fflush(f.fp) != 0)
+                        res = -(long long)EIO;
+                }
+            }
+            finish({ tag, res });
+        });
+    }
+
+public:
+    Queue()
+    {
+#ifdef __linux__
+        if (uringEnabled()) {
+            ring_ = make_unique<Ring>();
+            if (!ring_->init(kIoDepth * 2))
+                ring_.reset();
+        }
+#endif
+    }
+
+    Queue(const Queue&) = delete;
+    Queue& operator=(const Queue&) = delete;
+
+    ~Queue()
+    {
+        while (inflight_ > 0)
+            wait();
+    }
+
+    bool usesRing() const
+    {
+#ifdef __linux__
+        return ring_ != nullptr;
+#else
+        return false;
+#endif
+    }
+
+    size_t inflight() const { return inflight_; }
+
+    void read(IoFile& f, char* buf, size_t len, uint64_t off, uint64_t tag) { start(false, f, buf, len, off, tag); }
+    void write(IoFile& f, const char* buf, size_t len, uint64_t off, uint64_t tag) { start(true, f, (char*)buf, len, off, tag); }
+
+    // next completion; a request must be in flight
+    Done wait()
+    {
+        Done d{};
+        --inflight_;
+#ifdef __linux__
+        if (ring_) {
+            if (!ready_.empty()) {
+                d = ready_.front();
+                ready_.pop_front();
+            }
+            else if (!ring_->reap(d.tag, d.res))
+                d.res = -(long long)EIO;
+            return d;
+        }
+#endif
+        unique_lock<mutex> lk(mu_);
+        cv_.wait(lk, [this] { return !ready_.empty(); });
+        d = ready_.front();
+        ready_.pop_front();
+        return d;
+    }
+};
+
+// queues are kept per thread and reused, a ring costs a few syscalls to set up
+class Lease {
+    unique_ptr<Queue> q_;
+
+    static vector<unique_ptr<Queue>>& idle()
+    {
+        thread_local vector<unique_ptr<Queue>> v;
+        return v;
+    }
+
+public:
+    Lease()
+    {
+        auto& v = idle();
+        if (v.empty())
+            q_ = make_unique<Queue>();
+        else {
+            q_ = std::move(v.back());
+            v.pop_back();
+        }
+    }
+
+    ~Lease()
+    {
+        while (q_->inflight() > 0)
+            q_->wait();
+        idle().push_back(std::move(q_));
+    }
+
+    Lease(const Lease&) = delete;
+    Lease& operator=(const Lease&) = delete;
+
+    Queue* operator->() { return q_.get(); }
+};
+
+inline char* alignedBuffer(size_t bytes)
+{
+    bytes = (bytes + kIoAlign - 1) / kIoAlign * kIoAlign;
+#ifdef _WIN32
+    return (char*)_aligned_malloc(bytes, kIoAlign);
+#else
+    return (char*)aligned_alloc(kIoAlign, bytes);
+#endif
+}
+
+inline void freeAligned(char* p)
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+} // namespace aio
+
+// line reader over a file with up to `depth` chunk reads in flight ahead of
+// the line being parsed. getline(in, line) works as it does for an ifstream.
+class ReadAhead {
+    struct Slot {
+        char* buf = nullptr;
+        size_t len = 0;         // bytes the chunk should hold
+        size_t filled = 0;
+        bool ready = false;
+    };
+
+    aio::Lease q_;
+    IoFile f_;
+    uint64_t size_ = 0;
+    size_t chunks_ = 0, cur_ = 0, pos_ = 0;
+    vector<Slot> slots_;        // chunk k lives in slots_[k % slots_.size()]
+    bool failed_ = false;
+
+    void issue(size_t k)
+    {
+        if (k >= chunks_)
+            return;
+        Slot& s = slots_[k % slots_.size()];
+        uint64_t off = (uint64_t)k * kIoChunk;
+        s.len = (size_t)min<uint64_t>(kIoChunk, size_ - off);
+        s.filled = 0;
+        s.ready = false;
+        q_->read(f_, s.buf, s.len, off, k);
+    }
+
+    // makes chunk cur_ readable, false past the end or on a read error
+    bool ensure()
+    {
+        if (cur_ >= chunks_ || failed_)
+            return false;
+        Slot& want = slots_[cur_ % slots_.size()];
+        while (!want.ready) {
+            aio::Queue::Done d = q_->wait();
+            Slot& s = slots_[d.tag % slots_.size()];
+            if (d.res < 0) {
+                failed_ = true;
+                return false;
+            }
+            s.filled += (size_t)d.res;
+            if (d.res == 0)
+                s.len = s.filled;   // the file got shorter
+            if (s.filled < s.len)   // short read: ask for the rest
+                q_->read(f_, s.buf + s.filled, s.len - s.filled, d.tag * kIoChunk + s.filled, d.tag);
+            else
+                s.ready = true;
+        }
+        return true;
+    }
+
+public:
+    explicit ReadAhead(const string& path, size_t depth = 4)
+    {
+        if (!f_.open(path, false))
+            return;
+        size_ = f_.size();
+        chunks_ = (size_t)((size_ + kIoChunk - 1) / kIoChunk);
+        slots_.resize(max<size_t>(1, min(depth, chunks_)));
+        for (auto& s : slots_)
+            s.buf = aio::alignedBuffer((size_t)min<uint64_t>(kIoChunk, max<uint64_t>(size_, 1)));
+        for (size_t k = 0; k < slots_.size(); ++k)
+            issue(k);
+    }
+
+    ~ReadAhead()
+    {
+        while (q_->inflight() > 0)
+            q_->wait();
+        for (auto& s : slots_)
+            aio::freeAligned(s.buf);
+    }
+
+    ReadAhead(const ReadAhead&) = delete;
+    ReadAhead& operator=(const ReadAhead&) = delete;
+
+    bool is_open() const { return f_.fp != nullptr; }
+    uint64_t size() const { return size_; }
+
+    bool getline(string& line)
+    {
+        line.clear();
+        bool any = false;
+        while (ensure()) {
+            Slot& s = slots_[cur_ % slots_.size()];
+            const char* p = s.buf + pos_;
+            size_t avail = s.len - pos_;
+            const char* nl = (const char*)memchr(p, '\n', avail);
+            size_t n = nl ? (size_t)(nl - p) : avail;
+            line.append(p, n);
+            pos_ += n + (nl ? 1 : 0);
+            any = true;
+            if (pos_ == s.len) {    // chunk used up: its slot reads the next one out
+                pos_ = 0;
+                issue(cur_ + slots_.size());
+                ++cur_;
+            }
+            if (nl)
+                break;
+        }
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        return any;
+    }
+};
+
+inline bool getline(ReadAhead& in, string& line)
+{
+    return in.getline(line);
+}
+
+// whole-file writes. add() truncates the file and starts writing it, several
+// files are in flight together; wait() (or the destructor) returns once all are written
+class WriteBatch {
+    struct File {
+        IoFile f;
+        string data;
+        bool ok = true;
+    };
+    struct Op {
+        size_t file;
+        uint64_t off;
+        size_t len;
+    };
+
+    aio::Lease q_;
+    deque<File> files_;
+    vector<Op> ops_;            // tag -> what the request wrote
+    vector<string> obsolete_;   // removed once the batch is written
+    bool ok_ = true;
+
+    void issue(size_t file, uint64_t off, size_t len)
+    {
+        ops_.push_back({ file, off, len });
+        q_->write(files_[file].f, files_[file].data.data() + off, len, off, ops_.size() - 1);
+    }
+
+    void complete()
+    {
+        aio::Queue::Done d = q_->wait();
+        Op op = ops_[d.tag];
+        if (d.res <= 0)
+            files_[op.file].ok = false;
+        else if ((size_t)d.res < op.len)    // short write: the rest goes again
+            issue(op.file, op.off + d.res, op.len - (size_t)d.res);
+    }
+
+public:
+    WriteBatch() = default;
+    WriteBatch(const WriteBatch&) = delete;
+    WriteBatch& operator=(const WriteBatch&) = delete;
+
+    ~WriteBatch() { wait(); }
+
+    // false when the file can't be opened
+    bool add(const string& path, string&& data)
+    {
+        File& fl = files_.emplace_back();
+        if (!fl.f.open(path, true)) {
+            files_.pop_back();
+            ok_ = false;
+            return false;
+        }
+        fl.data = std::move(data);
+        size_t file = files_.size() - 1;
+        for (uint64_t off = 0; off < fl.data.size(); off += kIoChunk) {
+            if (q_->inflight() >= kIoDepth)
+                complete();
+            issue(file, off, (size_t)min<uint64_t>(kIoChunk, fl.data.size() - off));
+        }
+        return true;
+    }
+
+    // a file the batch makes redundant (a journal): wait() deletes it only
+    // when every file was written in full, a failed batch leaves it in place
+    void removeWhenWritten(const string& path) { obsolete_.push_back(path); }
+
+    // true when every file was written in full
+    bool wait()
+    {
+        while (q_->inflight() > 0)
+            complete();
+        for (auto& fl : files_) {
+            ok_ = ok_ && fl.ok;
+            fl.f.close();
+        }
+        files_.clear();
+        ops_.clear();
+        if (ok_) {
+            error_code ec;
+            for (auto& path : obsolete_)
+                filesystem::remove(path, ec);
+        }
+        obsolete_.clear();
+        return ok_;
+    }
+};
+
+#endif // ASYNC_IO_H
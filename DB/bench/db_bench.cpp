@@ -0,0 +1,341 @@
+// db_bench: measures every statement path of the engine over synthetic tables
+// shaped like db/emp.txt (name STRING, age INT, salary INT).
+//
+//   db_bench [--rows 10k,1m,10m] [--ops N] [--write-ops N] [--dir PATH]
+//            [--only name,...] [--seed S] [--io uring|threads]
+//
+// For each table size it reports ops/s, p50/p99 latency and the bytes read and
+// written by the table files.
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include "database.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+
+struct Options {
+    vector<long long> rows = { 10000 };
+    long long ops = 1000;       // per read benchmark
+    long long writeOps = 50;    // per write benchmark (each one rewrites the file)
+    string dir = (fs::temp_directory_path() / "minidb_bench").string();
+    vector<string> only;
+    unsigned long long seed = 42;
+};
+
+struct Result {
+    string name;
+    long long ops = 0;
+    double seconds = 0;
+    vector<double> latUs;
+    unsigned long long bytesRead = 0;
+    unsigned long long bytesWritten = 0;
+};
+
+const char* kTable = "emp";
+
+bool parseCount(string_view s, long long& out) {
+    long long mul = 1;
+    if (!s.empty()) {
+        char suffix = (char)tolower((unsigned char)s.back());
+        if (suffix == 'k') mul = 1000;
+        else if (suffix == 'm') mul = 1000000;
+        if (mul != 1)
+            s.remove_suffix(1);
+    }
+    if (!parseInt64(s, out) || out <= 0)
+        return false;
+    out *= mul;
+    return true;
+}
+
+vector<string> splitList(string_view s) {
+    vector<string> r;
+    size_t start = 0;
+    while (start <= s.size()) {
+        size_t comma = s.find(',', start);
+        if (comma == string_view::npos)
+            comma = s.size();
+        if (comma > start)
+            r.emplace_back(s.substr(start, comma - start));
+        start = comma + 1;
+    }
+    return r;
+}
+
+double percentile(vector<double>& v, double p) {
+    if (v.empty())
+        return 0;
+    size_t idx = (size_t)(p * (double)(v.size() - 1) + 0.5);
+    nth_element(v.begin(), v.begin() + idx, v.end());
+    return v[idx];
+}
+
+// emp-shaped rows: name n<i>, age 18..80, salary 1000..200000
+void generate(long long rows, mt19937_64& rng) {
+    fs::remove(string("./db/") + kTable + ".txt");
+    fs::remove(string("./db/") + kTable + ".del");   // a previous run's delete journal
+
+    TableSchema s;
+    s.names = { "name", "age", "salary" };
+    s.types = { "STRING", "INT", "INT" };
+
+    TableDynamic t(kTable);
+    t.setSchema(s);
+
+    uniform_int_distribution<int> age(18, 80), salary(1000, 200000);
+    vector<vector<string>> data;
+    data.reserve((size_t)rows);
+    for (long long i = 0; i < rows; ++i)
+        data.push_back({ "n" + to_string(i), to_string(age(rng)), to_string(salary(rng)) });
+
+    t.appendRows(std::move(data));
+}
+
+// runs op n times, timing each call. Bytes come from the engine's file I/O counters.
+Result timed(const string& name, long long n, const function<void(long long)>& op) {
+    metrics::Snapshot before = metrics::snapshot();
+    Result r;
+    r.name = name;
+    r.ops = n;
+    r.latUs.reserve((size_t)n);
+
+    auto start = chrono::steady_clock::now();
+    for (long long i = 0; i < n; ++i) {
+        auto t0 = chrono::steady_clock::now();
+        op(i);
+        auto t1 = chrono::steady_clock::now();
+        r.latUs.push_back(chrono::duration<double, micro>(t1 - t0).count());
+    }
+    r.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    metrics::Snapshot after = metrics::snapshot();
+    r.bytesRead = after.counters[metrics::BytesRead] - before.counters[metrics::BytesRead];
+    r.bytesWritten = after.counters[metrics::BytesWritten] - before.counters[metrics::BytesWritten];
+    return r;
+}
+
+void expectOk(const ResultSet& rs, const string& sql) {
+    if (!rs.ok()) {
+        cerr << "bench statement failed: " << sql << ": " << rs.message() << "\n";
+        exit(1);
+    }
+}
+
+// touches every returned cell so lazy results are really materialized
+size_t consume(const ResultSet& rs) {
+    size_t bytes = 0;
+    for (auto row : rs)
+        for (size_t c = 0; c < row.size(); ++c)
+            bytes += row[c].size();
+    return bytes;
+}
+
+void printHeader(long long rows) {
+    cout << "\nrows=" << rows << "\n"
+        << left << setw(14) << "bench" << right
+        << setw(10) << "ops" << setw(14) << "ops/s"
+        << setw(12) << "p50(us)" << setw(12) << "p99(us)"
+        << setw(16) << "read(B)" << setw(16) << "written(B)" << "\n";
+}
+
+void printResult(Result& r) {
+    double opsPerSec = r.seconds > 0 ? (double)r.ops / r.seconds : 0;
+    double p50 = percentile(r.latUs, 0.50);
+    double p99 = percentile(r.latUs, 0.99);
+
+    cout << left << setw(14) << r.name << right
+        << setw(10) << r.ops
+        << setw(14) << fixed << setprecision(1) << opsPerSec
+        << setw(12) << setprecision(1) << p50
+        << setw(12) << setprecision(1) << p99
+        << setw(16) << r.bytesRead
+        << setw(16) << r.bytesWritten << "\n";
+    cout.unsetf(ios::floatfield);
+}
+
+bool wanted(const Options& o, const string& name) {
+    return o.only.empty() || find(o.only.begin(), o.only.end(), name) != o.only.end();
+}
+
+void runSize(const Options& o, long long rows) {
+    mt19937_64 rng(o.seed);
+    generate(rows, rng);
+    printHeader(rows);
+
+    uniform_int_distribution<long long> anyRow(0, rows - 1);
+    Database db;
+
+    if (wanted(o, "load")) {
+        // cold load: a fresh table object parses the whole file
+        long long n = min<long long>(o.writeOps, 10);
+        Result r = timed("load", n, [&](long long) {
+            TableDynamic t(kTable);
+            t.load();
+        });
+        printResult(r);
+    }
+
+    TableDynamic* t = db.catalog().get(kTable);
+
+    if (wanted(o, "save")) {
+        long long n = min<long long>(o.writeOps, 10);
+        Result r = timed("save", n, [&](long long) { t->save(); });
+        printResult(r);
+    }
+
+    if (wanted(o, "select_point")) {
+        Result r = timed("select_point", o.ops, [&](long long) {
+            string sql = "SELECT * FROM emp WHERE name = n" + to_string(anyRow(rng));
+            ResultSet rs = db.execute(sql);
+            expectOk(rs, sql);
+            consume(rs);
+        });
+        printResult(r);
+    }
+
+    if (wanted(o, "select_range")) {
+        // open range over the top 0.5% - 2% of salaries
+        uniform_int_distribution<int> lo(196000, 199000);
+        long long n = max<long long>(1, o.ops / 10);
+        Result r = timed("select_range", n, [&](long long) {
+            string sql = "SELECT name, salary FROM emp WHERE salary > " + to_string(lo(rng));
+            ResultSet rs = db.execute(sql);
+            expectOk(rs, sql);
+            consume(rs);
+        });
+        printResult(r);
+    }
+
+    if (wanted(o, "insert")) {
+        Result r = timed("insert", o.writeOps, [&](long long i) {
+            string sql = "INSERT INTO emp VALUES (x" + to_string(i) + ", 30, 5000)";
+            expectOk(db.execute(sql), sql);
+        });
+        printResult(r);
+    }
+
+    if (wanted(o, "insert_batch")) {
+        // 100 INSERTs per batch, appended and saved together (server pipelining path)
+        const int per = 100;
+        vector<string> text(per);
+        vector<Statement> sts(per);
+        Result r = timed("insert_batch", o.writeOps, [&](long long i) {
+            for (int k = 0; k < per; ++k) {
+                text[k] = "INSERT INTO emp VALUES (b" + to_string(i * per + k) + ", 40, 7000)";
+                Parse::parseStatement(text[k], sts[k]);
+            }
+            db.executeBatch(sts.data(), sts.size(), [&](size_t k, const ResultSet& rs) { expectOk(rs, text[k]); });
+        });
+        printResult(r);
+        cout << "  (" << per << " rows per op)\n";
+    }
+
+    if (wanted(o, "update")) {
+        Result r = timed("update", o.writeOps, [&](long long) {
+            string sql = "UPDATE emp SET salary = 1234 WHERE name = n" + to_string(anyRow(rng));
+            expectOk(db.execute(sql), sql);
+        });
+        printResult(r);
+    }
+
+    if (wanted(o, "delete")) {
+        Result r = timed("delete", o.writeOps, [&](long long) {
+            string sql = "DELETE FROM emp WHERE name = n" + to_string(anyRow(rng));
+            expectOk(db.execute(sql), sql);
+        });
+        printResult(r);
+    }
+
+    if (wanted(o, "delete_compact")) {
+        // on a fresh table, two DELETEs of 9 ages each (about 14% of the rows):
+        // the first only marks its rows, the second takes the deleted ones past
+        // a quarter of the table and compacts it before returning
+        generate(rows, rng);
+        Database fresh;
+        expectOk(fresh.execute("SELECT * FROM emp WHERE name = n0"), "load");   // not timed
+        uint64_t compactions = metrics::snapshot().counters[metrics::Compactions];
+        const pair<const char*, string> steps[] = {
+            { "delete_mark", "DELETE FROM emp WHERE age < 27" },
+            { "delete_compact", "DELETE FROM emp WHERE age > 71" },
+        };
+        for (auto& [name, sql] : steps) {
+            Result r = timed(name, 1, [&](long long) { expectOk(fresh.execute(sql), sql); });
+            printResult(r);
+        }
+        if (metrics::snapshot().counters[metrics::Compactions] == compactions)
+            cout << "  (no compaction ran)\n";
+    }
+}
+
+void usage() {
+    cerr << "usage: db_bench [--rows 10k,1m,10m] [--ops N] [--write-ops N] [--dir PATH]\n"
+        << "                [--only load,save,select_point,select_range,insert,insert_batch,update,delete,delete_compact]\n"
+        << "                [--seed S] [--io uring|threads]\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options o;
+
+    for (int i = 1; i < argc; ++i) {
+        string_view a = argv[i];
+        bool hasVal = i + 1 < argc;
+
+        if (a == "--rows" && hasVal) {
+            o.rows.clear();
+            for (auto& s : splitList(argv[++i])) {
+                long long n = 0;
+                if (!parseCount(s, n)) {
+                    usage();
+                    return 2;
+                }
+                o.rows.push_back(n);
+            }
+        }
+        else if (a == "--ops" && hasVal) {
+            if (!parseCount(argv[++i], o.ops)) { usage(); return 2; }
+        }
+        else if (a == "--write-ops" && hasVal) {
+            if (!parseCount(argv[++i], o.writeOps)) { usage(); return 2; }
+        }
+        else if (a == "--dir" && hasVal)
+            o.dir = argv[++i];
+        else if (a == "--only" && hasVal)
+            o.only = splitList(argv[++i]);
+        else if (a == "--io" && hasVal) {
+            string_view v = argv[++i];
+            if (v != "uring" && v != "threads") { usage(); return 2; }
+            aio::uringEnabled() = v == "uring";
+        }
+        else if (a == "--seed" && hasVal) {
+            long long s = 0;
+            if (!parseInt64(argv[++i], s)) { usage(); return 2; }
+            o.seed = (unsigned long long)s;
+        }
+        else {
+            usage();
+            return 2;
+        }
+    }
+
+    // the engine works on ./db/, so run inside the scratch directory
+    fs::create_directories(o.dir);
+    fs::current_path(o.dir);
+    cout << "db_bench in " << fs::current_path().string() << "\n";
+
+    for (long long rows : o.rows)
+        runSize(o, rows);
+
+    return 0;
+}
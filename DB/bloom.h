@@ -0,0 +1,83 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <ostream>
+#include "utils.h"
+#include "table_stats.h"
+using namespace std;
+
+// split-block Bloom filters for one column, one filter per kBlock rows.
+// A value picks one 256-bit bucket by its hash and sets one bit in each of the
+// bucket's 8 words, so a probe reads a single cache line. At 10 bits per row
+// about 1% of the blocks that don't hold a value still answer "maybe".
+class BlockBloom {
+public:
+    static constexpr int kBlock = 1024; // rows per filter, same as IntColumn blocks
+    static constexpr int kBuckets = 40; // 256-bit buckets per filter
+    static constexpr int kWords = kBuckets * 8;
+
+private:
+    vector<uint32_t> words_;    // kWords per block
+
+    static uint32_t bitOf(uint32_t key, int i)
+    {
+        static const uint32_t salt[8] = {
+            0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+            0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u };
+        return 1u << ((key * salt[i]) >> 27);
+    }
+
+    static size_t bucketOf(uint64_t h) { return (size_t)(((h >> 32) * (uint64_t)kBuckets) >> 32); }
+
+public:
+    static uint64_t hashOf(string_view v) { return hash64(v); }
+
+    size_t blocks() const { return words_.size() / kWords; }
+    size_t memoryBytes() const { return words_.capacity() * sizeof(uint32_t); }
+    void clear() { words_.clear(); }
+
+    void add(size_t row, uint64_t h)
+    {
+        size_t b = row / kBlock;
+        if (b >= blocks())
+            words_.resize((b + 1) * kWords, 0);
+        uint32_t* w = &words_[b * kWords + bucketOf(h) * 8];
+        for (int i = 0; i < 8; ++i)
+            w[i] |= bitOf((uint32_t)h, i);
+    }
+
+    // false: no row of block b holds the value
+    bool mayContain(size_t b, uint64_t h) const
+    {
+        if (b >= blocks())
+            return false;
+        const uint32_t* w = &words_[b * kWords + bucketOf(h) * 8];
+        for (int i = 0; i < 8; ++i)
+            if (!(w[i] & bitOf((uint32_t)h, i)))
+                return false;
+        return true;
+    }
+
+    // one base64 line per block
+    void write(ostream& out) const
+    {
+        for (size_t b = 0; b < blocks(); ++b)
+            out << base64Encode(&words_[b * kWords], kWords * sizeof(uint32_t)) << "\n";
+    }
+
+    bool readLine(string_view line)
+    {
+        size_t at = words_.size();
+        words_.resize(at + kWords);
+        if (base64Decode(line, &words_[at], kWords * sizeof(uint32_t)))
+            return true;
+        words_.resize(at);
+        return false;
+    }
+};
+
+#endif // BLOOM_H
@@ -0,0 +1,262 @@
+#ifndef COLUMN_H
+#define COLUMN_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <cstdint>
+#include <algorithm>
+#include <span>
+#include "int_column.h"
+#include "value_type.h"
+using namespace std;
+
+// the values of one table column.
+// STRING columns start dictionary encoded: every distinct value is stored once
+// and rows hold its 32-bit code. A column that turns out to be mostly unique
+// (more distinct values than half its rows, past kMinDictValues) falls back to
+// plain strings, so unique names don't pay for the dictionary.
+// INT columns are kept as compressed 64-bit blocks (see int_column.h); a value
+// that does not fit in 64 bits turns the column into plain strings. The other
+// fixed-width types are stored the same way, as keys (see value_type.h).
+class Column {
+    bool dict_ = false;
+    bool int_ = false;
+    ValueType type_ = ValueType::String;
+    IntColumn ints_;
+    vector<string> plain_;
+    vector<uint32_t> codes_;
+    deque<string> values_;                          // code -> value, addresses never move
+    unordered_map<string_view, uint32_t> lookup_;   // value -> code, views into values_
+
+    void rebuildLookup() {
+        lookup_.clear();
+        lookup_.reserve(values_.size());
+        for (size_t i = 0; i < values_.size(); ++i)
+            lookup_.emplace(values_[i], (uint32_t)i);
+    }
+
+    uint32_t intern(string_view v) {
+        auto it = lookup_.find(v);
+        if (it != lookup_.end())
+            return it->second;
+        values_.emplace_back(v);
+        uint32_t c = (uint32_t)values_.size() - 1;
+        lookup_.emplace(values_.back(), c);
+        return c;
+    }
+
+public:
+    static constexpr size_t kMinDictValues = 256;
+
+    explicit Column(bool dictionary = false) : dict_(dictionary) {}
+
+    // storage for a schema type: STRING -> dictionary, fixed width -> compressed ints
+    static Column forType(const string& type) {
+        ValueType t = valueTypeOf(type);
+        Column c(t == ValueType::String);
+        c.int_ = isFixedWidth(t);
+        c.type_ = t;
+        return c;
+    }
+
+    Column(const Column& o) : dict_(o.dict_), int_(o.int_), type_(o.type_), ints_(o.ints_), plain_(o.plain_), codes_(o.codes_), values_(o.values_) { rebuildLookup(); }
+    Column& operator=(const Column& o) {
+        if (this != &o) {
+            dict_ = o.dict_;
+            int_ = o.int_;
+            type_ = o.type_;
+            ints_ = o.ints_;
+            plain_ = o.plain_;
+            codes_ = o.codes_;
+            values_ = o.values_;
+            rebuildLookup();
+        }
+        return *this;
+    }
+    Column(Column&&) = default;             // deque and map move without relocating values
+    Column& operator=(Column&&) = default;
+
+    bool isDict() const { return dict_; }
+    bool isInt() const { return int_; }
+    ValueType type() const { return type_; }
+    size_t size() const { return int_ ? ints_.size() : dict_ ? codes_.size() : plain_.size(); }
+
+    // text columns only (!isInt())
+    string_view get(size_t r) const { return dict_ ? string_view(values_[codes_[r]]) : string_view(plain_[r]); }
+
+    // isInt() columns only: the stored key, the number itself for INT / BIGINT
+    long long getInt(size_t r) const { return ints_.get(r); }
+    const IntColumn& ints() const { return ints_; }
+    IntColumn& ints() { return ints_; }
+
+    // any column, as text
+    string text(size_t r) const { return int_ ? formatValue(type_, ints_.get(r)) : string(get(r)); }
+
+    // dictionary access, only when isDict()
+    uint32_t code(size_t r) const { return codes_[r]; }
+    size_t dictSize() const { return values_.size(); }
+    string_view dictValue(uint32_t c) const { return values_[c]; }
+    long long findCode(string_view v) const {
+        auto it = lookup_.find(v);
+        return it == lookup_.end() ? -1 : (long long)it->second;
+    }
+
+    // bits a scan touches for row r
+    size_t bitsAt(size_t r) const { return int_ ? ints_.bitsAt(r) : dict_ ? 32 : plain_[r].size() * 8; }
+
+    // approximate heap footprint
+    size_t memoryBytes() const {
+        if (int_)
+            return ints_.memoryBytes();
+        size_t n = codes_.capacity() * sizeof(uint32_t) + plain_.capacity() * sizeof(string);
+        for (auto& v : plain_)
+            n += v.capacity() > 15 ? v.capacity() : 0;
+        for (auto& v : values_)
+            n += sizeof(string) + (v.capacity() > 15 ? v.capacity() : 0) + 32;   // + hash node
+        return n;
+    }
+
+    // room for n rows, growing geometrically so repeated small appends stay amortized O(1)
+    void reserve(size_t n) {
+        if (int_)
+            ints_.reserve(n);
+        else if (dict_) {
+            if (n > codes_.capacity())
+                codes_.reserve(max(n, codes_.capacity() * 2));
+        }
+        else if (n > plain_.capacity())
+            plain_.reserve(max(n, plain_.capacity() * 2));
+    }
+
+    void push(string_view v) {
+        if (int_) {
+            long long x = 0;
+            if (encodeValue(type_, v, x)) {
+                ints_.push(x);
+                return;
+            }
+            toPlain();
+        }
+        if (!dict_) {
+            plain_.emplace_back(v);
+            return;
+        }
+        codes_.push_back(intern(v));
+        if (values_.size() > kMinDictValues && values_.size() * 2 > codes_.size())
+            toPlain();
+    }
+
+    // n rows of v (ALTER TABLE ADD COLUMN): constant INT blocks, or one dictionary code
+    void pushRepeat(string_view v, size_t n) {
+        if (int_) {
+            long long x = 0;
+            if (encodeValue(type_, v, x)) {
+                ints_.pushRepeat(x, n);
+                return;
+            }
+            toPlain();
+        }
+        if (dict_)
+            codes_.resize(codes_.size() + n, intern(v));
+        else
+            plain_.resize(plain_.size() + n, string(v));
+    }
+
+    // loading a persisted dictionary column: setDictionary() then pushCode() per row
+    void setDictionary(vector<string>&& values) {
+        dict_ = true;
+        plain_.clear();
+        codes_.clear();
+        values_.assign(make_move_iterator(values.begin()), make_move_iterator(values.end()));
+        rebuildLookup();
+    }
+    bool pushCode(uint32_t c) {
+        if (c >= values_.size())
+            return false;
+        codes_.push_back(c);
+        return true;
+    }
+
+    void set(size_t r, string_view v) {
+        if (int_) {
+            long long x = 0;
+            if (encodeValue(type_, v, x)) {
+                ints_.set(r, x);
+                return;
+            }
+            toPlain();
+        }
+        if (dict_)
+            codes_[r] = intern(v);
+        else
+            plain_[r] = string(v);
+    }
+
+    // removes the rows at the given ascending positions
+    void erase(span<const int> ids) {
+        if (int_) {
+            ints_.erase(ids);
+            return;
+        }
+        size_t w = 0, k = 0, n = size();
+        for (size_t r = 0; r < n; ++r) {
+            if (k < ids.size() && ids[k] == (int)r) {
+                ++k;
+                continue;
+            }
+            if (w != r) {
+                if (dict_) codes_[w] = codes_[r];
+                else plain_[w] = std::move(plain_[r]);
+            }
+            ++w;
+        }
+        if (dict_) codes_.resize(w);
+        else plain_.resize(w);
+    }
+
+    void toPlain() {
+        if (int_) {
+            for (long long x : ints_.all())
+                plain_.push_back(formatValue(type_, x));
+            ints_.clear();
+            int_ = false;
+            return;
+        }
+        if (!dict_)
+            return;
+        plain_.reserve(codes_.size());
+        for (uint32_t c : codes_)
+            plain_.push_back(values_[c]);
+        codes_ = vector<uint32_t>();
+        lookup_.clear();
+        values_.clear();
+        dict_ = false;
+    }
+
+    // "dict 12 values", "plain", "int (for 10, delta 0, rle 2, tail 3)"
+    string describe() const {
+        if (int_)
+            return "int (" + ints_.describe() + ")";
+        if (dict_)
+            return "dict " + to_string(values_.size()) + " values";
+        return "plain";
+    }
+
+    // codes still referenced by some row, renumbered densely (for save).
+    // remap[old] = new code or UINT32_MAX, returns the number of live values
+    uint32_t liveCodes(vector<uint32_t>& remap) const {
+        remap.assign(values_.size(), UINT32_MAX);
+        for (uint32_t c : codes_)
+            remap[c] = 0;
+        uint32_t n = 0;
+        for (auto& m : remap)
+            if (m != UINT32_MAX)
+                m = n++;
+        return n;
+    }
+};
+
+#endif // COLUMN_H
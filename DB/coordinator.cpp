@@ -0,0 +1,465 @@
+#include "coordinator.h"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include "server.h"
+#include "stats.h"
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace {
+
+const size_t kPipeline = 512;   // statements in flight per batch before the replies are read
+
+uint64_t nanosSince(chrono::steady_clock::time_point t0) {
+    return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - t0).count();
+}
+
+// one TSV record (see ResultWriter) back into its fields
+vector<string> splitTsv(string_view line) {
+    vector<string> out(1);
+    for (size_t i = 0; i < line.size(); ++i) {
+        char ch = line[i];
+        if (ch == '\t')
+            out.emplace_back();
+        else if (ch == '\\' && i + 1 < line.size()) {
+            char e = line[++i];
+            out.back().push_back(e == 't' ? '\t' : e == 'n' ? '\n' : e);
+        }
+        else
+            out.back().push_back(ch);
+    }
+    return out;
+}
+
+// "[OK] UPDATE changed: 3" -> "[OK] UPDATE changed", 3
+bool splitCount(string_view msg, string_view& prefix, long long& n) {
+    size_t c = msg.rfind(": ");
+    if (c == string_view::npos || !parseInt64(msg.substr(c + 2), n))
+        return false;
+    prefix = msg.substr(0, c);
+    return true;
+}
+
+} // namespace
+
+
+Coordinator::Coordinator(Database& local, vector<string> shards)
+    : local_(local), addrs_(std::move(shards)), idle_(addrs_.size()) {
+    loadKeys();
+}
+
+Coordinator::~Coordinator() {
+#ifdef __linux__
+    for (auto& fds : idle_)
+        for (int fd : fds)
+            close(fd);
+#endif
+}
+
+string Coordinator::metaPath(const string& table) const {
+    return local_.catalog().folder() + table + ".shard";
+}
+
+// ./db/<table>.shard holds "col pos TYPE" and the column names ("- -1 STRING" for a view)
+void Coordinator::loadKeys() {
+    error_code ec;
+    fs::create_directories(local_.catalog().folder(), ec);
+    for (auto& p : fs::directory_iterator(local_.catalog().folder(), ec)) {
+        if (p.path().extension() != ".shard")
+            continue;
+        ifstream in(p.path());
+        ShardKey k;
+        string type;
+        if (!(in >> k.col >> k.pos >> type))
+            continue;
+        k.type = valueTypeOf(type);
+        for (string c; in >> c; )
+            k.cols.push_back(c);
+        keys_[toLower(p.path().stem().string())] = k;
+    }
+}
+
+// fills r with where st goes; false when it is answered without the shards (early)
+bool Coordinator::route(const Statement& st, Route& r, ResultSet& early) {
+    if (!st.valid()) {
+        early = ResultSet::error("Invalid query or unsupported format");
+        return false;
+    }
+    if (st.kind == StmtKind::Show) {
+        early = local_.execute(st);
+        return false;
+    }
+    if (st.kind == StmtKind::Begin || st.kind == StmtKind::Commit || st.kind == StmtKind::Rollback) {
+        early = ResultSet::error("transactions are not supported through the coordinator");
+        return false;
+    }
+
+    r.text = string(st.text);
+    string tname = lowerCopy(st.table);
+    auto everyShard = [&] {
+        r.shards.resize(addrs_.size());
+        for (size_t s = 0; s < addrs_.size(); ++s)
+            r.shards[s] = (int)s;
+    };
+
+    bool ddl = st.kind == StmtKind::Create || st.kind == StmtKind::Drop || st.kind == StmtKind::Alter || st.kind == StmtKind::Analyze;
+    if (ddl && !st.explain) {
+        r.ddl = true;
+        everyShard();
+        r.gather = st.kind == StmtKind::Analyze ? Gather::Tagged : Gather::First;
+        if (st.kind == StmtKind::Alter && st.ddl().alterColumn) {
+            shared_lock<shared_mutex> lk(metaMu_);
+            auto it = keys_.find(tname);
+            if (it == keys_.end() || it->second.pos < 0)
+                return true;    // the shards say why
+            r.key = it->second;
+            string col = lowerCopy(st.cols[0]);
+            auto at = find(r.key.cols.begin(), r.key.cols.end(), col);
+            if (iequals(st.ddl().alterOp, "ADD")) {
+                if (at == r.key.cols.end())
+                    r.key.cols.push_back(col);
+                return true;
+            }
+            if (col == r.key.col) {
+                early = ResultSet::error("ALTER: " + col + " is the shard key of " + tname + " and can't be dropped");
+                return false;
+            }
+            if (r.key.cols.empty()) {
+                early = ResultSet::error("ALTER: the columns of " + tname + " are not known here, it was created by an older coordinator");
+                return false;
+            }
+            if (at != r.key.cols.end()) {
+                if (at - r.key.cols.begin() < r.key.pos)
+                    --r.key.pos;
+                r.key.cols.erase(at);
+            }
+            return true;
+        }
+        if (st.kind != StmtKind::Create || st.bloom)
+            return true;
+        if (st.view) {
+            r.key = ShardKey{ "-", -1, ValueType::String, {} };
+            return true;
+        }
+        if (st.cols.empty())
+            return true;    // the shards say why
+
+        string col = lowerCopy(st.ddl().shardCol.empty() ? st.cols[0] : st.ddl().shardCol);
+        vector<string> cols;
+        for (size_t i = 0; i + 1 < st.cols.size(); i += 2) {
+            cols.push_back(lowerCopy(st.cols[i]));
+            if (cols.back() == col)
+                r.key = ShardKey{ col, (int)(i / 2), valueTypeOf(st.cols[i + 1]), {} };
+        }
+        r.key.cols = std::move(cols);
+        if (r.key.pos < 0) {
+            early = ResultSet::error("CREATE: shard key " + col + " is not a column of " + tname);
+            return false;
+        }
+        if (!st.ddl().shardBy.empty()) {
+            // the shards get the statement without the clause
+            size_t at = st.ddl().shardBy.data() - st.text.data();
+            r.text = string(st.text.substr(0, at)) + string(st.text.substr(at + st.ddl().shardBy.size()));
+        }
+        return true;
+    }
+
+    ShardKey key;
+    {
+        shared_lock<shared_mutex> lk(metaMu_);
+        auto it = keys_.find(tname);
+        if (it == keys_.end()) {
+            early = ResultSet::error(string(Parse::kindName(st.kind)) + ": table not found");
+            return false;
+        }
+        key = it->second;
+    }
+
+    if (st.kind == StmtKind::Insert && !st.explain) {
+        if (key.pos < 0) {
+            early = ResultSet::error("INSERT: " + tname + " is a materialized view");
+            return false;
+        }
+        if ((size_t)key.pos >= st.vals.size()) {
+            early = ResultSet::error("INSERT validation: column count mismatch");
+            return false;
+        }
+        r.shards.push_back(shardOf(st.vals[key.pos], key.type));
+        return true;
+    }
+
+    if (st.kind == StmtKind::Update && key.pos >= 0)
+        for (auto c : st.setCols)
+            if (lowerCopy(c) == key.col) {
+                early = ResultSet::error("UPDATE: can't change the shard key " + key.col);
+                return false;
+            }
+
+    if (key.pos >= 0 && st.hasWhere() && st.whereOp == "=" && lowerCopy(st.whereCol) == key.col)
+        r.shards.push_back(shardOf(st.whereVal, key.type));
+    else
+        everyShard();
+
+    if (st.explain)
+        r.gather = Gather::Tagged;
+    else if (st.kind == StmtKind::Select)
+        r.gather = Gather::Rows;
+    else
+        r.gather = r.shards.size() > 1 ? Gather::Sum : Gather::First;
+    return true;
+}
+
+// one result from the replies (status byte + body, empty when the shard was lost)
+ResultSet Coordinator::gather(const Statement& st, const Route& r, const vector<string>& replies, const Links& l) {
+    for (size_t j = 0; j < replies.size(); ++j) {
+        int s = r.shards[j];
+        if (replies[j].empty())
+            return ResultSet::error("shard " + to_string(s) + " (" + addrs_[s] + "): " + l.why[s]);
+        if (replies[j][0] == '-') {
+            string msg = replies[j].substr(1);
+            return ResultSet::error(r.shards.size() > 1 ? "shard " + to_string(s) + ": " + msg : msg);
+        }
+    }
+
+    if (r.gather == Gather::Rows || r.gather == Gather::Tagged) {
+        bool tagged = r.gather == Gather::Tagged;
+        ResultSet out;
+        for (size_t j = 0; j < replies.size(); ++j) {
+            string_view body = string_view(replies[j]).substr(1);
+            size_t nl = body.find('\n');
+            if (nl == string_view::npos)
+                return ResultSet::done(string(body));   // a message, not rows
+            if (out.names_.empty()) {
+                out.names_ = splitTsv(body.substr(0, nl));
+                if (tagged)
+                    out.names_.insert(out.names_.begin(), "shard");
+                out.types_.assign(out.names_.size(), "STRING");
+            }
+            for (body.remove_prefix(nl + 1); !body.empty(); ) {
+                nl = body.find('\n');
+                vector<string> row = splitTsv(body.substr(0, nl));
+                if (tagged)
+                    row.insert(row.begin(), to_string(r.shards[j]));
+                row.resize(out.names_.size());
+                out.owned_.push_back(std::move(row));
+                body.remove_prefix(nl == string_view::npos ? body.size() : nl + 1);
+            }
+        }
+        return out;
+    }
+
+    string_view first = string_view(replies[0]).substr(1);
+    if (r.gather == Gather::Sum) {
+        string_view prefix, p;
+        long long total = 0, n = 0;
+        bool same = splitCount(first, prefix, n);
+        for (size_t j = 0; same && j < replies.size(); ++j) {
+            same = splitCount(string_view(replies[j]).substr(1), p, n) && p == prefix;
+            total += n;
+        }
+        if (same)
+            return ResultSet::done(string(prefix) + ": " + to_string(total), (int)total);
+    }
+    return ResultSet::done(string(first), st.kind == StmtKind::Insert ? 1 : 0);
+}
+
+// DDL goes to every shard on its own; the key is kept (or forgotten) once a shard took it
+ResultSet Coordinator::runDdl(const Statement& st, Route& r, Links& l) {
+    for (int s : r.shards)
+        l.send(s, r.text);
+    vector<vector<string>> replies;
+    exchange(l, { r.shards }, replies);
+    ResultSet rs = gather(st, r, replies[0], l);
+
+    bool any = false;
+    for (auto& rep : replies[0])
+        any = any || (!rep.empty() && rep[0] == '+');
+    bool alter = st.kind == StmtKind::Alter && st.ddl().alterColumn && r.key.pos >= 0;
+    if (!any || st.bloom || (st.kind != StmtKind::Create && st.kind != StmtKind::Drop && !alter))
+        return rs;
+
+    string tname = lowerCopy(st.table);
+    unique_lock<shared_mutex> lk(metaMu_);
+    error_code ec;
+    if (st.kind == StmtKind::Drop) {
+        keys_.erase(tname);
+        fs::remove(metaPath(tname), ec);
+    }
+    else {
+        keys_[tname] = r.key;
+        ofstream out(metaPath(tname));
+        out << r.key.col << " " << r.key.pos << " " << typeName(r.key.type);
+        for (auto& c : r.key.cols)
+            out << " " << c;
+        out << "\n";
+    }
+    return rs;
+}
+
+void Coordinator::executeBatch(const Statement* sts, size_t n, const function<void(size_t, const ResultSet&)>& consume) {
+    struct Pending {
+        size_t idx;
+        Route r;
+        chrono::steady_clock::time_point t0;
+    };
+
+    Links l(*this);
+    vector<Pending> pending;
+
+    // reads the replies of everything queued and hands out the results in order
+    auto flush = [&] {
+        if (pending.empty())
+            return;
+        vector<vector<int>> shardsOf;
+        shardsOf.reserve(pending.size());
+        for (auto& p : pending)
+            shardsOf.push_back(p.r.shards);
+        vector<vector<string>> replies;
+        exchange(l, shardsOf, replies);
+        for (size_t k = 0; k < pending.size(); ++k) {
+            const Statement& st = sts[pending[k].idx];
+            ResultSet rs = gather(st, pending[k].r, replies[k], l);
+            metrics::statement((int)st.kind, nanosSince(pending[k].t0));
+            consume(pending[k].idx, rs);
+        }
+        pending.clear();
+    };
+
+    for (size_t i = 0; i < n; ++i) {
+        auto t0 = chrono::steady_clock::now();
+        Route r;
+        ResultSet early;
+        bool routed = route(sts[i], r, early);
+        if (!routed || r.ddl) {
+            flush();    // earlier statements answer first
+            ResultSet rs = routed ? runDdl(sts[i], r, l) : early;
+            metrics::statement((int)sts[i].kind, nanosSince(t0));
+            consume(i, rs);
+            continue;
+        }
+        for (int s : r.shards)
+            l.send(s, r.text);
+        pending.push_back({ i, std::move(r), t0 });
+        if (pending.size() >= kPipeline)
+            flush();
+    }
+    flush();
+}
+
+#ifdef __linux__
+
+Coordinator::Links::Links(Coordinator& co)
+    : c(co), fds(co.addrs_.size(), -1), in(co.addrs_.size()), out(co.addrs_.size()), why(co.addrs_.size()) {}
+
+// connections with nothing left to read go back to the pool
+Coordinator::Links::~Links() {
+    lock_guard<mutex> lk(c.poolMu_);
+    for (size_t s = 0; s < fds.size(); ++s) {
+        if (fds[s] < 0)
+            continue;
+        if (in[s].empty() && out[s].empty())
+            c.idle_[s].push_back(fds[s]);
+        else
+            close(fds[s]);
+    }
+}
+
+// a shard that failed once in this batch stays failed until the next one
+bool Coordinator::Links::open(int s) {
+    if (fds[s] >= 0)
+        return true;
+    if (!why[s].empty())
+        return false;
+    while (true) {
+        int fd;
+        {
+            lock_guard<mutex> lk(c.poolMu_);
+            if (c.idle_[s].empty())
+                break;
+            fd = c.idle_[s].back();
+            c.idle_[s].pop_back();
+        }
+        // an idle connection the shard closed meanwhile (restarted) reads EOF
+        char b;
+        if (recv(fd, &b, 1, MSG_PEEK | MSG_DONTWAIT) < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            fds[s] = fd;
+            return true;
+        }
+        close(fd);
+    }
+    fds[s] = net::openSocket(c.addrs_[s], false, why[s]);
+    return fds[s] >= 0;
+}
+
+void Coordinator::Links::send(int s, string_view sql) {
+    if (open(s))
+        proto::putFrame(out[s], 0, sql);
+}
+
+void Coordinator::Links::fail(int s) {
+    close(fds[s]);
+    fds[s] = -1;
+    in[s].clear();
+    out[s].clear();
+    why[s] = "connection lost";
+}
+
+// sends what is queued to every shard, then reads one reply per (statement, shard)
+// in the order they were queued; a shard works on its part while the others are read
+void Coordinator::exchange(Links& l, const vector<vector<int>>& shardsOf, vector<vector<string>>& replies) {
+    for (size_t s = 0; s < addrs_.size(); ++s) {
+        if (l.fds[s] < 0 || l.out[s].empty())
+            continue;
+        if (!net::writeAll(l.fds[s], l.out[s].data(), l.out[s].size()))
+            l.fail((int)s);
+        l.out[s].clear();
+    }
+
+    replies.assign(shardsOf.size(), {});
+    for (size_t k = 0; k < shardsOf.size(); ++k) {
+        replies[k].resize(shardsOf[k].size());
+        for (size_t j = 0; j < shardsOf[k].size(); ++j) {
+            int s = shardsOf[k][j];
+            if (l.fds[s] >= 0 && !net::readFrame(l.fds[s], l.in[s], replies[k][j])) {
+                l.fail(s);
+                replies[k][j].clear();
+            }
+        }
+    }
+}
+
+#else // !__linux__
+
+Coordinator::Links::Links(Coordinator& co)
+    : c(co), fds(co.addrs_.size(), -1), in(co.addrs_.size()), out(co.addrs_.size()), why(co.addrs_.size(), "coordinator mode is only available on Linux") {}
+
+Coordinator::Links::~Links() {
+}
+
+bool Coordinator::Links::open(int) {
+    return false;
+}
+
+void Coordinator::Links::send(int, string_view) {
+}
+
+void Coordinator::Links::fail(int) {
+}
+
+void Coordinator::exchange(Links&, const vector<vector<int>>& shardsOf, vector<vector<string>>& replies) {
+    replies.assign(shardsOf.size(), {});
+    for (size_t k = 0; k < shardsOf.size(); ++k)
+        replies[k].resize(shardsOf[k].size());
+}
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef COORDINATOR_H
+#define COORDINATOR_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <shared_mutex>
+#include <mutex>
+#include "database.h"
+using namespace std;
+
+// coordinator mode (db --serve ADDR --shards A,B,...): every table is
+// hash-partitioned by a shard key over N engine instances, each an ordinary
+// `db --serve` in its own directory answering in the default TSV format. The
+// coordinator keeps no rows, only each table's key (./db/<table>.shard).
+//   INSERT                         the shard owning the key value
+//   SELECT / UPDATE / DELETE       one shard for WHERE key = v, otherwise all of them
+//   CREATE / DROP / ALTER / ...    every shard (the shard key can't be dropped)
+// Results from several shards are gathered: rows concatenated in shard order,
+// changed counts summed. The statements of one client batch are pipelined per
+// shard, so a burst of INSERTs reaches each shard as one batch of its own.
+class Coordinator {
+    struct ShardKey {
+        string col;
+        int pos = -1;                   // -1: no key (materialized views), always every shard
+        ValueType type = ValueType::String;
+        vector<string> cols;            // every column, so pos follows ALTER TABLE DROP COLUMN
+    };
+
+    // how the replies of the shards a statement went to become one result
+    enum class Gather { Rows, Tagged, Sum, First };
+
+    struct Route {
+        vector<int> shards;
+        Gather gather = Gather::First;
+        string text;                    // what is sent, the statement unless rewritten
+        bool ddl = false;               // runs on its own, after everything before it
+        ShardKey key;                   // CREATE: the key to keep
+    };
+
+    // one connection per shard for the length of a batch, taken from the pool
+    struct Links {
+        Coordinator& c;
+        vector<int> fds;
+        vector<string> in;              // bytes received, not yet framed
+        vector<string> out;             // frames not yet sent
+        vector<string> why;             // why a shard can't be reached
+
+        explicit Links(Coordinator& co);
+        ~Links();
+        bool open(int s);
+        void send(int s, string_view sql);
+        void fail(int s);
+    };
+
+    Database& local_;                   // SHOW runs here
+    vector<string> addrs_;
+    shared_mutex metaMu_;
+    unordered_map<string, ShardKey> keys_;  // by table key
+    mutex poolMu_;
+    vector<vector<int>> idle_;          // per shard: open connections not in use
+
+    string metaPath(const string& table) const;
+    void loadKeys();
+    bool route(const Statement& st, Route& r, ResultSet& early);
+    ResultSet gather(const Statement& st, const Route& r, const vector<string>& replies, const Links& l);
+    ResultSet runDdl(const Statement& st, Route& r, Links& l);
+    void exchange(Links& l, const vector<vector<int>>& shardsOf, vector<vector<string>>& replies);
+
+public:
+    Coordinator(Database& local, vector<string> shards);
+    ~Coordinator();
+
+    Coordinator(const Coordinator&) = delete;
+    Coordinator& operator=(const Coordinator&) = delete;
+
+    size_t shardCount() const { return addrs_.size(); }
+
+    // the shard a key value of the given type belongs to
+    int shardOf(string_view v, ValueType type) const { return (int)(valueHash(v, type) % addrs_.size()); }
+
+    // runs n statements in order and calls consume(i, result) for each, like Database::executeBatch
+    void executeBatch(const Statement* sts, size_t n, const function<void(size_t, const ResultSet&)>& consume);
+};
+
+#endif // COORDINATOR_H
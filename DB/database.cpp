@@ -0,0 +1,1804 @@
+#include "database.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <thread>
+#include <numeric>
+#include <unordered_map>
+#include <algorithm>
+#include <iterator>
+#include "output.h"
+#include "stats.h"
+
+using namespace std;
+
+
+TableSchema schemaFromCreateCols(const Fields& cols) {
+    // cols holds name,type pairs
+    TableSchema s;
+    for (size_t i = 0; i + 1 < cols.size(); i += 2) {
+        ValueType t = ValueType::String;
+        parseValueType(cols[i + 1], t);     // unknown types are kept as STRING
+        string tp = typeName(t);
+
+        s.names.push_back(lowerCopy(cols[i]));
+        s.types.push_back(tp);
+    }
+    return s;
+}
+
+
+// INT accepts any number: one too long for 64 bits turns the column into text
+static bool valueFits(ValueType t, string_view v) {
+    long long key = 0;
+    return t == ValueType::Int ? isNumberString(v) : !isFixedWidth(t) || encodeValue(t, v, key);
+}
+
+bool validateInsert(const TableSchema& schema, const Fields& vals, string& err) {
+    if (schema.names.size() != vals.size()) {
+        err = "column count mismatch";
+        return false;
+    }
+    for (size_t i = 0; i < vals.size(); i++) {
+        ValueType t = valueTypeOf(schema.types[i]);
+        if (!valueFits(t, vals[i])) {
+            err = "value '" + string(vals[i]) + "' not " + typeName(t) + " for column " + schema.names[i];
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// partitions are the tables "<table>.<partition>", no other name has a dot
+static bool isPartition(const string& key) {
+    return key.find('.') != string::npos;
+}
+
+// what a replica has to replay: anything that can change a table or the catalog
+static bool changesData(const Statement& st) {
+    switch (st.kind) {
+    case StmtKind::None:
+    case StmtKind::Select:
+    case StmtKind::Show:
+    case StmtKind::Begin:
+    case StmtKind::Commit:
+    case StmtKind::Rollback:
+        return false;
+    default:
+        return !st.explain || st.analyze;   // EXPLAIN ANALYZE runs the write
+    }
+}
+
+// partition an INSERT's values go to, -1 with err set when none takes them
+static int routeRow(const TableDynamic& t, const Fields& vals, string& err) {
+    const PartitionSpec& spec = *t.partitions();
+    int c = t.columnIndex(spec.col);
+    int i = spec.route(vals[c], valueTypeOf(t.schema().types[c]));
+    if (i < 0)
+        err = "no partition of " + t.name() + " takes " + spec.col + " = " + string(vals[c]);
+    return i;
+}
+
+ResultSet Database::execute(string_view sql) {
+    Statement st;
+    if (!Parse::parseStatement(sql, st))
+        return ResultSet::error("Invalid query or unsupported format");
+
+    return execute(st);
+}
+
+static uint64_t nanosSince(chrono::steady_clock::time_point t0) {
+    return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - t0).count();
+}
+
+// latency is recorded per statement kind, lock wait included, result rendering excluded
+ResultSet Database::execute(const Statement& st) {
+    return execute(st, session_);
+}
+
+ResultSet Database::execute(const Statement& st, Session& s) {
+    auto t0 = chrono::steady_clock::now();
+    ResultSet rs;
+    if (st.kind == StmtKind::Select) {
+        shared_lock<shared_mutex> lk(rw_);
+        rs = run(st, s);
+    }
+    else {
+        unique_lock<shared_mutex> lk(rw_);
+        rs = run(st, s);
+        logChange(st, rs, s);
+    }
+    metrics::statement((int)st.kind, nanosSince(t0));
+    return rs;
+}
+
+void Database::execute(const Statement& st, const function<void(const ResultSet&)>& consume) {
+    execute(st, session_, consume);
+}
+
+void Database::execute(const Statement& st, Session& s, const function<void(const ResultSet&)>& consume) {
+    auto t0 = chrono::steady_clock::now();
+    if (st.kind == StmtKind::Select) {
+        shared_lock<shared_mutex> lk(rw_);
+        ResultSet rs = run(st, s);
+        metrics::statement((int)st.kind, nanosSince(t0));
+        consume(rs);
+        return;
+    }
+    unique_lock<shared_mutex> lk(rw_);
+    ResultSet rs = run(st, s);
+    logChange(st, rs, s);
+    metrics::statement((int)st.kind, nanosSince(t0));
+    consume(rs);
+}
+
+void Database::executeBatch(const Statement* sts, size_t n, const function<void(size_t, const ResultSet&)>& consume) {
+    executeBatch(sts, n, session_, consume);
+}
+
+void Database::executeBatch(const Statement* sts, size_t n, Session& s, const function<void(size_t, const ResultSet&)>& consume) {
+    size_t i = 0;
+    while (i < n) {
+        size_t j = i + 1;
+        // EXPLAIN INSERT keeps its kind but has no plan: it runs alone and is refused
+        if (sts[i].kind == StmtKind::Insert && !sts[i].explain) {
+            while (j < n && sts[j].kind == StmtKind::Insert && !sts[j].explain && iequals(sts[j].table, sts[i].table))
+                ++j;
+        }
+
+        if (j - i > 1) {
+            unique_lock<shared_mutex> lk(rw_);
+            insertGroup(sts + i, j - i, s, [&](size_t k, const ResultSet& rs) { consume(i + k, rs); });
+        }
+        else {
+            execute(sts[i], s, [&](const ResultSet& rs) { consume(i, rs); });
+        }
+        i = j;
+    }
+}
+
+void Database::insertGroup(const Statement* sts, size_t n, Session& s, const function<void(size_t, const ResultSet&)>& consume) {
+    auto t0 = chrono::steady_clock::now();
+    string tname = lowerCopy(sts[0].table);
+    if (readOnly_ && &s != &applier_) {
+        for (size_t k = 0; k < n; ++k)
+            consume(k, ResultSet::error("INSERT: read-only replica, send writes to the primary"));
+        return;
+    }
+
+    TableDynamic* t = table(tname, s, true);
+    if (!t || t->view() || isPartition(tname)) {
+        string err = !t ? "INSERT: table not found" : t->view() ? "INSERT: " + tname + " is a materialized view"
+                                                                : "INSERT: " + tname + " is a partition, insert through its table";
+        for (size_t k = 0; k < n; ++k)
+            consume(k, ResultSet::error(err));
+        return;
+    }
+
+    vector<ResultSet> results;
+    vector<vector<string>> rows;
+    vector<int> parts;          // partitioned table: where each row goes
+    results.reserve(n);
+    rows.reserve(n);
+
+    for (size_t k = 0; k < n; ++k) {
+        string err;
+        if (!validateInsert(t->schema(), sts[k].vals, err)) {
+            results.push_back(ResultSet::error("INSERT validation: " + err));
+            continue;
+        }
+        if (t->partitions()) {
+            int part = routeRow(*t, sts[k].vals, err);
+            if (part < 0) {
+                results.push_back(ResultSet::error("INSERT: " + err));
+                continue;
+            }
+            parts.push_back(part);
+        }
+        rows.emplace_back(sts[k].vals.begin(), sts[k].vals.end());
+        results.push_back(ResultSet::done("[OK] Inserted into " + tname, 1));
+    }
+
+    if (t->partitions()) {
+        // one append, and one save, per partition the group touches
+        vector<vector<vector<string>>> byPart(t->partitions()->names.size());
+        for (size_t k = 0; k < rows.size(); ++k)
+            byPart[parts[k]].push_back(std::move(rows[k]));
+        WriteBatch batch;
+        for (size_t i = 0; i < byPart.size(); ++i) {
+            if (byPart[i].empty())
+                continue;
+            TableDynamic* pt = partition(*t, i, s, true);
+            bool deferred = pt->savesDeferred();
+            pt->deferSaves(true);
+            pt->appendRows(std::move(byPart[i]));
+            pt->deferSaves(deferred);
+            if (!deferred)
+                pt->save(batch);
+        }
+        if (!batch.wait()) {    // the rows are in memory only, the journals stay
+            for (auto& rs : results)
+                if (rs.ok())
+                    rs = ResultSet::error("INSERT: cannot write the files of " + tname);
+        }
+    }
+    else {
+        int from = t->rowCount();
+        t->appendRows(std::move(rows));
+        maintainViews(*t, { RowDelta::Insert, from, t->rowCount(), {}, {} }, s);
+        compactIfDue(*t, s);
+    }
+
+    // the group shares one save, every INSERT in it is charged an equal part
+    uint64_t each = nanosSince(t0) / n;
+    for (size_t k = 0; k < n; ++k)
+        metrics::statement((int)StmtKind::Insert, each);
+
+    for (size_t k = 0; k < n; ++k) {
+        logChange(sts[k], results[k], s);
+        consume(k, results[k]);
+    }
+}
+
+// cost model for the WHERE access path, in units of "read and test one row".
+// There are no indexes, so the candidates are a serial scan and a parallel
+// scan; the parallel one pays thread start-up per worker and a copy of every
+// matching row id when the parts are joined.
+const double kRowCost = 1.0;
+const double kWorkerStartup = 4000;
+const double kMergeCost = 0.05;
+const int kMaxScanWorkers = 8;
+
+struct AccessChoice {
+    bool parallel = false;
+    int workers = 1;
+    double selectivity = 1;
+    double estRows = 0;
+    bool zones = false;     // whole blocks can be skipped (zone maps, Bloom filter)
+    string describe;
+};
+
+static double estimateSelectivity(const TableDynamic& t, const Predicate& w, bool& fromStats) {
+    double s = t.stats().selectivity(w.col, w.op, w.val);
+    fromStats = s >= 0;
+    if (fromStats)
+        return s;
+
+    // not analyzed: the usual textbook guesses
+    if (w.op == "=") return 0.05;
+    if (w.op == "!=") return 0.95;
+    return 1.0 / 3;
+}
+
+static AccessChoice chooseAccess(const TableDynamic& t, const Predicate& where, Arena& arena) {
+    AccessChoice a;
+    double rows = (double)t.rowCount();     // a scan passes deleted rows too
+    bool fromStats = false;
+    a.selectivity = estimateSelectivity(t, where, fromStats);
+    a.estRows = a.selectivity * t.liveRows();
+
+    int hw = (int)thread::hardware_concurrency();
+    int workers = clamp(hw, 1, kMaxScanWorkers);
+
+    // zone maps / Bloom filters: only blocks that may hold a match are read
+    Predicate z(where, &arena);
+    z.prepare(t);
+    long long cand = z.candidateRows();
+    a.zones = cand >= 0;
+    if (a.zones) {
+        a.estRows = min(a.estRows, (double)cand);
+        rows = (double)cand;
+    }
+
+    double scanCost = rows * kRowCost;
+    double parallelCost = rows * kRowCost / workers + workers * kWorkerStartup + a.estRows * kMergeCost;
+
+    if (workers > 1 && parallelCost < scanCost) {
+        a.parallel = true;
+        a.workers = workers;
+    }
+
+    char buf[200];
+    if (workers > 1)
+        snprintf(buf, sizeof(buf), "Access: %s (cost scan=%.0f, parallel scan x%d=%.0f), selectivity %.4f from %s",
+            a.parallel ? "parallel scan" : "scan", scanCost, workers, parallelCost,
+            a.selectivity, fromStats ? "ANALYZE stats" : "defaults");
+    else
+        snprintf(buf, sizeof(buf), "Access: scan (cost=%.0f, single core), selectivity %.4f from %s",
+            scanCost, a.selectivity, fromStats ? "ANALYZE stats" : "defaults");
+    a.describe = buf;
+    if (a.zones)
+        a.describe += ", " + z.skipKind() + " keeps " + to_string(cand) + " of " + to_string(t.rowCount()) + " rows";
+    return a;
+}
+
+// operators live in the plan's arena, each gets it for its own buffers
+template <class T, class... Args>
+static OpPtr makeOp(Arena& a, Args&&... args) {
+    return OpPtr(a.make<T>(&a, std::forward<Args>(args)...));
+}
+
+static OpPtr instrument(Arena& a, OpPtr op, bool analyze) {
+    if (!analyze)
+        return op;
+    return OpPtr(a.make<Analyze>(std::move(op)));
+}
+
+// SELECT list -> table columns ("*" is all of them)
+static bool selectColumns(const TableDynamic& t, const Statement& p, vector<int>& colMap, string& err) {
+    const auto& sel = p.cols;
+
+    //*
+    if (sel.size() == 1 && sel[0] == "*") {
+        for (int i = 0; i < (int)t.schema().names.size(); i++)
+            colMap.push_back(i);
+        return true;
+    }
+    for (size_t i = 0; i < sel.size(); i++) {// col name
+        int idx = t.columnIndex(sel[i]);
+        if (idx < 0) {
+            err = "SELECT: unknown column " + string(sel[i]);
+            return false;
+        }
+        colMap.push_back(idx);
+    }
+    return true;
+}
+
+// WHERE col op val, where stays unset (col -1) without one
+static bool wherePredicate(const TableDynamic& t, const Statement& p, Predicate& where, string& err) {
+    if (!p.hasWhere())
+        return true;
+    int idx = t.columnIndex(p.whereCol);
+    if (idx < 0) {
+        err = p.kind == StmtKind::Select ? "SELECT: unknown WHERE column" : string(Parse::kindName(p.kind)) + ": unknown WHERE col";
+        return false;
+    }
+    where = Predicate(idx, t.schema().names[idx], p.whereOp, p.whereVal, valueTypeOf(t.schema().types[idx]));
+    return true;
+}
+
+// SELECT, UPDATE and DELETE all read through TableScan -> [Filter]; SELECT adds a Projection
+bool Database::plan(const Statement& p, bool analyze, Plan& pl, string& err, Session& s) {
+    string what = Parse::kindName(p.kind);
+    bool writes = p.kind != StmtKind::Select && (!p.explain || p.analyze);
+    TableDynamic* t = table(lowerCopy(p.table), s, writes);
+    if (!t) {
+        err = what + ": table not found";
+        return false;
+    }
+    if (p.kind != StmtKind::Select && isPartition(t->name())) {
+        err = what + ": " + t->name() + " is a partition, write through its table";
+        return false;
+    }
+    return planTable(t, p, analyze, pl, err);
+}
+
+// the plan of p against t, which may be one partition of p's table
+bool Database::planTable(TableDynamic* t, const Statement& p, bool analyze, Plan& pl, string& err) {
+    string what = Parse::kindName(p.kind);
+    pl.table = t;
+    if (p.kind != StmtKind::Select && t->view()) {
+        err = what + ": " + t->name() + " is a materialized view";
+        return false;
+    }
+
+    if (p.kind == StmtKind::Select && !selectColumns(*t, p, pl.colMap, err))
+        return false;
+
+    if (p.kind == StmtKind::Update) {
+        for (size_t i = 0; i < p.setCols.size(); ++i) {
+            Assignment a;
+            a.col = t->columnIndex(p.setCols[i]);
+            if (a.col < 0) {
+                err = "UPDATE: unknown column";
+                return false;
+            }
+            for (auto& o : pl.sets)
+                if (o.col == a.col) {
+                    err = "UPDATE: column " + t->schema().names[a.col] + " assigned twice";
+                    return false;
+                }
+            string why;
+            if (!a.expr.compile(p.setExprs[i], t->schema().names, t->schema().types, t->schema().types[a.col], why)) {
+                err = "UPDATE: " + why;
+                return false;
+            }
+            pl.sets.push_back(std::move(a));
+        }
+    }
+
+    //where
+    Predicate where;
+    if (!wherePredicate(*t, p, where, err))
+        return false;
+
+    Arena& ar = pl.arena;
+    OpPtr op;
+    if (p.hasWhere()) {
+        AccessChoice a = chooseAccess(*t, where, ar);
+        pl.access = a.describe;
+        if (a.parallel)
+            op = instrument(ar, makeOp<ParallelScan>(ar, *t, where, a.workers, a.estRows, analyze), analyze);
+        else {
+            op = instrument(ar, makeOp<TableScan>(ar, *t, analyze, a.zones ? &where : nullptr), analyze);
+            op = instrument(ar, makeOp<Filter>(ar, std::move(op), *t, where, a.estRows), analyze);
+        }
+    }
+    else
+        op = instrument(ar, makeOp<TableScan>(ar, *t, analyze), analyze);
+
+    if (p.kind == StmtKind::Select) {
+        vector<string> names;
+        for (int idx : pl.colMap)
+            names.push_back(t->schema().names[idx]);
+        op = instrument(ar, makeOp<Projection>(ar, std::move(op), pl.colMap, names), analyze);
+    }
+
+    pl.root = std::move(op);
+    return true;
+}
+
+ResultSet Database::runPlan(const Statement& p, Plan& pl, Session& s) {
+    TableDynamic* t = pl.table;
+    Operator* root = pl.root.get();
+    root->open();
+
+    if (p.kind == StmtKind::Select) {
+        // keep row ids only, the ResultSet reads the cells straight from the table
+        ResultSet rs;
+        rs.colMap_ = pl.colMap;
+        for (int idx : pl.colMap) {
+            rs.names_.push_back(t->schema().names[idx]);
+            rs.types_.push_back(t->schema().types[idx]);
+        }
+        rs.table_ = t;
+        while (root->next())
+            rs.rowIds_.push_back(root->rowId());
+        root->close();
+        rs.decodeInts();
+        metrics::add(metrics::RowsReturned, rs.rowIds_.size());
+        return rs;
+    }
+
+    pmr::vector<int> ids(&pl.arena);
+    while (root->next())
+        ids.push_back(root->rowId());
+    root->close();
+
+    if (p.kind == StmtKind::Update) {
+        string err;
+        int changed = t->updateRowIds(ids, pl.sets, err, &pl.arena);
+        if (changed < 0)
+            return ResultSet::error("UPDATE: " + err);
+        RowDelta d{ RowDelta::Update, 0, 0, ids, {} };
+        for (auto& a : pl.sets)
+            d.cols.push_back(a.col);
+        maintainViews(*t, d, s);
+        compactIfDue(*t, s);
+        return ResultSet::done("[OK] UPDATE changed: " + to_string(changed), changed);
+    }
+
+    int removed = t->deleteRowIds(ids);
+    maintainViews(*t, { RowDelta::Delete, 0, 0, ids, {} }, s);
+    compactIfDue(*t, s);
+    return ResultSet::done("[OK] DELETE removed: " + to_string(removed), removed);
+}
+
+static string fmtMs(double seconds) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.3f ms", seconds * 1000.0);
+    return buf;
+}
+
+static void planLines(const Operator* op, int depth, bool analyze, vector<vector<string>>& out) {
+    string s(depth * 2, ' ');
+    if (depth > 0)
+        s += "-> ";
+    s += op->describe();
+
+    const OpStats* st = op->stats();
+    if (analyze && st) {
+        const Operator* in = op->input();
+        long long rowsIn = in && in->stats() ? in->stats()->rowsOut : st->rowsOut;
+
+        s += "  (rows in=" + to_string(rowsIn) + " out=" + to_string(st->rowsOut)
+            + ", next() calls=" + to_string(st->nextCalls) + ", time=" + fmtMs(st->seconds);
+        if (op->bytesRead() > 0)
+            s += ", bytes read=" + to_string(op->bytesRead());
+        s += ")";
+    }
+    out.push_back({ s });
+
+    if (op->input())
+        planLines(op->input(), depth + 1, analyze, out);
+}
+
+// EXPLAIN prints the operator tree, EXPLAIN ANALYZE also runs the statement
+// and reports per operator counters plus where the time went overall
+ResultSet Database::explain(const Statement& p, Session& s) {
+    if (p.kind != StmtKind::Select && p.kind != StmtKind::Update && p.kind != StmtKind::Delete)
+        return ResultSet::error("EXPLAIN: only SELECT, UPDATE and DELETE have a plan");
+
+    using clock = chrono::steady_clock;
+    auto secs = [](clock::time_point a, clock::time_point b) { return chrono::duration<double>(b - a).count(); };
+
+    bool wasLoaded = catalog_.isLoaded(lowerCopy(p.table));
+    if (TableDynamic* t = table(lowerCopy(p.table), s, false); t && t->partitions())
+        return explainPartitioned(p, *t, s);
+
+    auto t0 = clock::now();
+    Plan pl;
+    string err;
+    if (!plan(p, p.analyze, pl, err, s))
+        return ResultSet::error(err);
+    auto t1 = clock::now();
+
+    ResultSet out;
+    out.names_ = { "QUERY PLAN" };
+    out.types_ = { "STRING" };
+
+    string head;
+    if (p.kind == StmtKind::Update) {
+        head = "Update on " + pl.table->name() + " SET ";
+        for (size_t i = 0; i < pl.sets.size(); ++i)
+            head += (i ? ", " : "") + pl.table->schema().names[pl.sets[i].col] + " = " + pl.sets[i].expr.text();
+    }
+    else if (p.kind == StmtKind::Delete)
+        head = "Delete on " + pl.table->name();
+
+    if (!p.analyze) {
+        if (!head.empty())
+            out.owned_.push_back({ head });
+        planLines(pl.root.get(), head.empty() ? 0 : 1, false, out.owned_);
+        if (!pl.access.empty())
+            out.owned_.push_back({ pl.access });
+        return out;
+    }
+
+    ResultSet res = runPlan(p, pl, s);
+    auto t2 = clock::now();
+
+    // render the rows the way a client would, to see the output cost
+    size_t outBytes = 0;
+    if (res.hasRows()) {
+        ResultWriter w(nullptr, OutputFormat::Tsv);
+        w.write(res);
+        outBytes = w.take().size();
+    }
+    auto t3 = clock::now();
+
+    if (!head.empty())
+        out.owned_.push_back({ head + "  (rows affected=" + to_string(res.affected()) + ")" });
+    planLines(pl.root.get(), head.empty() ? 0 : 1, true, out.owned_);
+    if (!pl.access.empty())
+        out.owned_.push_back({ pl.access });
+    char mem[96];
+    snprintf(mem, sizeof(mem), "Memory: %.1f KiB from the statement arena (%zu chunks)",
+        pl.arena.bytesUsed() / 1024.0, pl.arena.chunkCount());
+    out.owned_.push_back({ mem });
+
+    out.owned_.push_back({ "Planning + table load: " + fmtMs(secs(t0, t1)) + (wasLoaded ? " (table cached)" : " (cold, read from disk)") });
+    out.owned_.push_back({ "Execution: " + fmtMs(secs(t1, t2)) });
+    if (res.hasRows())
+        out.owned_.push_back({ "Output: " + fmtMs(secs(t2, t3)) + ", " + to_string(res.rowCount()) + " rows, " + to_string(outBytes) + " bytes (tsv)" });
+    out.owned_.push_back({ "Total: " + fmtMs(secs(t0, t3)) });
+    return out;
+}
+
+// the table a statement of s sees: its transaction's copy if it made one,
+// the committed table otherwise. A write inside a transaction makes the copy
+TableDynamic* Database::table(const string& key, Session& s, bool write) {
+    if (s.open_) {
+        auto it = s.tables_.find(key);
+        if (it != s.tables_.end())
+            return &it->second.table;
+    }
+    TableDynamic* t = catalog_.get(key);
+    if (!t || !s.open_ || !write)
+        return t;
+    auto [it, fresh] = s.tables_.try_emplace(key, *t);
+    if (fresh)
+        it->second.hold = hold(key);
+    return &it->second.table;
+}
+
+// partition i of t, for reading or (in a transaction, a copy) writing.
+// A partition whose file went missing comes back empty
+TableDynamic* Database::partition(TableDynamic& t, size_t i, Session& s, bool write) {
+    string key = t.partitionKey(i);
+    if (!catalog_.has(key))
+        catalog_.create(key, t.schema());
+    return table(key, s, write);
+}
+
+// partitions where can reach: RANGE ones whose keys overlap it, for HASH
+// only the one an equality hashes to. Without a WHERE on the column, all
+static vector<int> prunePartitions(const TableDynamic& t, const Predicate& where) {
+    const PartitionSpec& spec = *t.partitions();
+    int n = (int)spec.names.size();
+    int c = t.columnIndex(spec.col);
+    vector<int> out;
+    if (where.col < 0 || where.col != c || (spec.hash && where.cmp != Predicate::Eq)) {
+        for (int i = 0; i < n; ++i)
+            out.push_back(i);
+        return out;
+    }
+    if (spec.hash) {
+        out.push_back(spec.route(where.val, where.type));
+        return out;
+    }
+    for (int i = 0; i < n && where.valNum; ++i) {
+        long long lo = i == 0 ? LLONG_MIN : spec.bounds[i - 1];
+        long long hi = spec.maxValue && i == n - 1 ? LLONG_MAX : spec.bounds[i] - 1;
+        if (where.rangeMayMatch(lo, hi))
+            out.push_back(i);
+    }
+    return out;
+}
+
+// CREATE TABLE ... PARTITION BY: the table (schema only) and one empty table per partition
+ResultSet Database::createPartitioned(const string& key, const Statement& p, const TableSchema& schema) {
+    PartitionSpec spec;
+    spec.hash = iequals(p.ddl().partKind, "HASH");
+    spec.col = lowerCopy(p.ddl().partCol);
+    int c = -1;
+    for (int i = 0; i < (int)schema.names.size(); ++i)
+        if (schema.names[i] == spec.col)
+            c = i;
+    if (c < 0)
+        return ResultSet::error("CREATE: unknown partition column " + spec.col);
+    ValueType type = valueTypeOf(schema.types[c]);
+
+    if (spec.hash) {
+        long long n = 0;
+        if (!parseInt64(p.ddl().partCount, n) || n < 1 || n > 1024)
+            return ResultSet::error("CREATE: PARTITIONS must be 1..1024");
+        for (long long i = 0; i < n; ++i)
+            spec.names.push_back("p" + to_string(i));
+    }
+    else {
+        if (!isFixedWidth(type))
+            return ResultSet::error("CREATE: RANGE partitioning needs a fixed-width column, " + spec.col + " is STRING");
+        for (size_t i = 0; i + 1 < p.ddl().parts.size(); i += 2) {
+            string name = lowerCopy(p.ddl().parts[i]);
+            long long key = 0;
+            bool last = i + 2 >= p.ddl().parts.size();
+            if (name.find('.') != string::npos || find(spec.names.begin(), spec.names.end(), name) != spec.names.end())
+                return ResultSet::error("CREATE: bad or repeated partition name " + name);
+            if (iequals(p.ddl().parts[i + 1], "MAXVALUE")) {
+                if (!last)
+                    return ResultSet::error("CREATE: only the last partition can be MAXVALUE");
+                spec.maxValue = true;
+            }
+            else if (!encodeValue(type, p.ddl().parts[i + 1], key))
+                return ResultSet::error("CREATE: bound '" + string(p.ddl().parts[i + 1]) + "' not " + typeName(type));
+            else if (!spec.bounds.empty() && key <= spec.bounds.back())
+                return ResultSet::error("CREATE: partition bounds must ascend");
+            spec.names.push_back(name);
+            spec.bounds.push_back(key);
+        }
+    }
+
+    if (!catalog_.create(key, schema))
+        return ResultSet::error("Failed to create");
+    TableDynamic* t = catalog_.get(key);
+    t->setPartitions(spec);
+    for (size_t i = 0; i < spec.names.size(); ++i)
+        catalog_.create(t->partitionKey(i), schema);
+    return ResultSet::done("[OK] Created " + key + " (" + to_string(spec.names.size()) + " partitions)");
+}
+
+// ALTER TABLE t ADD PARTITION p VALUES LESS THAN (v) | DROP PARTITION p.
+// Dropping deletes the partition's file: its rows go with it, at no cost per row
+ResultSet Database::alterTable(const Statement& p) {
+    if (p.ddl().alterColumn)
+        return alterColumns(p);
+    TableDynamic* t = catalog_.get(lowerCopy(p.table));
+    if (!t)
+        return ResultSet::error("ALTER: table not found");
+    if (!t->partitions())
+        return ResultSet::error("ALTER: " + t->name() + " is not partitioned");
+
+    PartitionSpec spec = *t->partitions();
+    string name = lowerCopy(p.ddl().parts[0]);
+    auto it = find(spec.names.begin(), spec.names.end(), name);
+    size_t at = it - spec.names.begin();
+
+    if (iequals(p.ddl().alterOp, "DROP")) {
+        if (spec.hash)
+            return ResultSet::error("ALTER: HASH partitions can't be dropped");
+        if (it == spec.names.end())
+            return ResultSet::error("ALTER: " + t->name() + " has no partition " + name);
+        if (spec.names.size() == 1)
+            return ResultSet::error("ALTER: " + name + " is the only partition of " + t->name());
+        string key = t->partitionKey(at);
+        if (spec.maxValue && at + 1 == spec.names.size())
+            spec.maxValue = false;
+        spec.names.erase(it);
+        spec.bounds.erase(spec.bounds.begin() + at);
+        t->setPartitions(std::move(spec));
+        catalog_.drop(key);
+        return ResultSet::done("[OK] Dropped partition " + key);
+    }
+
+    if (spec.hash)
+        return ResultSet::error("ALTER: partitions can only be added to a RANGE partitioned table");
+    if (it != spec.names.end() || name.find('.') != string::npos)
+        return ResultSet::error("ALTER: bad or repeated partition name " + name);
+    if (spec.maxValue)
+        return ResultSet::error("ALTER: " + t->name() + " already ends with a MAXVALUE partition");
+
+    int c = t->columnIndex(spec.col);
+    ValueType type = valueTypeOf(t->schema().types[c]);
+    long long key = 0;
+    if (iequals(p.ddl().parts[1], "MAXVALUE"))
+        spec.maxValue = true;
+    else if (!encodeValue(type, p.ddl().parts[1], key))
+        return ResultSet::error("ALTER: bound '" + string(p.ddl().parts[1]) + "' not " + typeName(type));
+    else if (key <= spec.bounds.back())
+        return ResultSet::error("ALTER: the new bound must be above " + formatValue(type, spec.bounds.back()));
+
+    TableDynamic* first = catalog_.get(t->partitionKey(0));
+    spec.names.push_back(name);
+    spec.bounds.push_back(key);
+    t->setPartitions(std::move(spec));
+    string pkey = t->partitionKey(t->partitions()->names.size() - 1);
+    catalog_.create(pkey, t->schema());
+    TableDynamic* added = catalog_.get(pkey);
+    for (int col = 0; first && added && col < (int)t->schema().names.size(); ++col)
+        if (first->bloom(col))
+            added->createBloom(col);   // filters are kept per table, give the new one the same
+    return ResultSet::done("[OK] Added partition " + pkey);
+}
+
+// SELECT / UPDATE / DELETE on a partitioned table: the statement runs against
+// every partition its WHERE can reach. SELECT plans and scans them on worker
+// threads and returns the rows copied in partition order; UPDATE and DELETE
+// go through them one at a time
+ResultSet Database::runPartitioned(const Statement& p, TableDynamic& t, Session& s) {
+    string what = Parse::kindName(p.kind);
+    Plan check;     // the statement against the (empty) table itself: columns, WHERE, SET
+    string err;
+    if (!planTable(&t, p, false, check, err))
+        return ResultSet::error(err);
+    for (auto& a : check.sets)
+        if (t.schema().names[a.col] == t.partitions()->col)
+            return ResultSet::error("UPDATE: " + t.partitions()->col + " is the partition column and can't be changed");
+
+    Predicate where;
+    wherePredicate(t, p, where, err);
+    vector<int> ids = prunePartitions(t, where);
+    bool writes = p.kind != StmtKind::Select;
+    vector<TableDynamic*> parts;
+    for (int i : ids)
+        parts.push_back(partition(t, i, s, writes));
+
+    if (writes) {
+        int total = 0;
+        for (TableDynamic* pt : parts) {
+            Plan pl;
+            if (!planTable(pt, p, false, pl, err))
+                return ResultSet::error(err);
+            ResultSet r = runPlan(p, pl, s);
+            if (!r.ok())
+                return r;
+            total += r.affected();
+        }
+        return ResultSet::done(p.kind == StmtKind::Update ? "[OK] UPDATE changed: " + to_string(total)
+                                                          : "[OK] DELETE removed: " + to_string(total), total);
+    }
+
+    vector<ResultSet> res(parts.size());
+    atomic<size_t> next{ 0 };
+    auto work = [&] {
+        for (size_t k; (k = next++) < parts.size();) {
+            Plan pl;
+            string e;
+            res[k] = planTable(parts[k], p, false, pl, e) ? runPlan(p, pl, s) : ResultSet::error(e);
+        }
+    };
+    int workers = min((int)parts.size(), clamp((int)thread::hardware_concurrency(), 1, kMaxScanWorkers));
+    vector<thread> threads;
+    for (int k = 1; k < workers; ++k)
+        threads.emplace_back(work);
+    work();
+    for (auto& th : threads)
+        th.join();
+
+    ResultSet out;
+    for (int idx : check.colMap) {
+        out.names_.push_back(t.schema().names[idx]);
+        out.types_.push_back(t.schema().types[idx]);
+    }
+    size_t total = 0;
+    for (auto& r : res) {
+        if (!r.ok())
+            return r;
+        total += r.rowCount();
+    }
+    out.owned_.reserve(total);
+    for (auto& r : res)
+        for (size_t i = 0; i < r.rowCount(); ++i) {
+            auto& row = out.owned_.emplace_back();
+            row.reserve(r.columnCount());
+            for (size_t c = 0; c < r.columnCount(); ++c)
+                row.emplace_back(r.cell(i, c));
+        }
+    return out;
+}
+
+// EXPLAIN on a partitioned table: the partitions left after pruning, each with
+// its own plan. EXPLAIN ANALYZE runs them one after another
+ResultSet Database::explainPartitioned(const Statement& p, TableDynamic& t, Session& s) {
+    auto t0 = chrono::steady_clock::now();
+    Plan check;
+    string err;
+    if (!planTable(&t, p, false, check, err))
+        return ResultSet::error(err);
+
+    Predicate where;
+    wherePredicate(t, p, where, err);
+    vector<int> ids = prunePartitions(t, where);
+    const PartitionSpec& spec = *t.partitions();
+
+    ResultSet out;
+    out.names_ = { "QUERY PLAN" };
+    out.types_ = { "STRING" };
+    string head = string(p.kind == StmtKind::Select ? "Append" : p.kind == StmtKind::Update ? "Update" : "Delete")
+        + " on " + t.name() + " (" + to_string(ids.size()) + " of " + to_string(spec.names.size()) + " partitions, "
+        + (spec.hash ? "hash" : "range") + " on " + spec.col;
+    if (ids.size() < spec.names.size())
+        head += ", pruned by " + where.describe();
+    out.owned_.push_back({ head + ")" });
+
+    long long rows = 0;
+    bool writes = p.kind != StmtKind::Select && p.analyze;
+    for (int i : ids) {
+        TableDynamic* pt = partition(t, i, s, writes);
+        Plan pl;
+        if (!planTable(pt, p, p.analyze, pl, err))
+            return ResultSet::error(err);
+        if (p.analyze) {
+            ResultSet r = runPlan(p, pl, s);
+            if (!r.ok())
+                return r;
+            rows += r.hasRows() ? (long long)r.rowCount() : r.affected();
+        }
+        out.owned_.push_back({ "  -> Partition " + spec.names[i] + " (" + to_string(pt->liveRows()) + " rows)" });
+        planLines(pl.root.get(), 2, p.analyze, out.owned_);
+        if (!pl.access.empty())
+            out.owned_.push_back({ "      " + pl.access });
+    }
+    if (p.analyze)
+        out.owned_.push_back({ string(p.kind == StmtKind::Select ? "Rows: " : "Rows affected: ") + to_string(rows)
+            + ", total: " + fmtMs(chrono::duration<double>(chrono::steady_clock::now() - t0).count()) });
+    return out;
+}
+
+// the part of a cache key that changes with the rows a SELECT reads: the
+// table's version, or the versions of the partitions it reaches
+string Database::versionTag(TableDynamic& t, const Statement& p) {
+    string tag = to_string(t.version());
+    if (!t.partitions())
+        return tag;
+    Predicate where;
+    string err;
+    wherePredicate(t, p, where, err);
+    for (int i : prunePartitions(t, where)) {
+        TableDynamic* pt = catalog_.get(t.partitionKey(i));
+        tag += "." + to_string(pt ? pt->version() : 0);
+    }
+    return tag;
+}
+
+// result cache key: the SELECT with names folded to lower case, and the version tag
+static string cacheKey(const Statement& p, const string& version) {
+    string k = lowerCopy(p.table);
+    for (auto c : p.cols) {
+        k += '\x1f';
+        k += lowerCopy(c);
+    }
+    k += '\x1e';
+    k += lowerCopy(p.whereCol);
+    k += '\x1f';
+    k += p.whereOp;
+    k += '\x1f';
+    k += p.whereVal;
+    k += '\x1e';
+    k += version;
+    return k;
+}
+
+// BEGIN / COMMIT / ROLLBACK. COMMIT fails, and rolls back, when a table the
+// transaction copied was changed or dropped by someone else in the meantime
+ResultSet Database::transaction(const Statement& p, Session& s) {
+    string what = Parse::kindName(p.kind);
+    if (p.kind == StmtKind::Begin) {
+        if (s.open_)
+            return ResultSet::error("BEGIN: a transaction is already open");
+        s.open_ = true;
+        return ResultSet::done("[OK] BEGIN");
+    }
+
+    if (!s.open_)
+        return ResultSet::error(what + ": no transaction is open");
+
+    // the copies, and with them the holds on the committed tables, go when this returns
+    auto pending = std::move(s.tables_);
+    s.tables_.clear();
+    s.open_ = false;
+    if (p.kind == StmtKind::Rollback)
+        return ResultSet::done("[OK] ROLLBACK");
+
+    vector<pair<TableDynamic*, TableDynamic*>> publish;     // committed <- copy
+    for (auto& [key, pt] : pending) {
+        TableDynamic* t = catalog_.get(key);
+        if (!t || t->version() != pt.base) {
+            return ResultSet::error("COMMIT: table " + key + " was changed by another session, transaction rolled back");
+        }
+        if (pt.table.version() != pt.base)
+            publish.push_back({ t, &pt.table });
+    }
+
+    WriteBatch batch;   // the tables are written concurrently
+    for (auto& [t, copy] : publish) {
+        copy->deferSaves(false);
+        *t = std::move(*copy);
+        t->save(batch);
+    }
+    bool written = batch.wait();
+    pending.clear();
+    for (auto& [t, copy] : publish)
+        compactIfDue(*t, s);    // a table the transaction held may be due by now
+    if (!written)
+        return ResultSet::error("COMMIT: the changes are applied but the table files could not be written");
+    return ResultSet::done("[OK] COMMIT", (int)publish.size());
+}
+
+ResultSet Database::run(const Statement& p, Session& s) {
+    StmtKind cmd = p.kind;
+    string tname = lowerCopy(p.table);
+
+    if (readOnly_ && &s != &applier_ && changesData(p))
+        return ResultSet::error(string(Parse::kindName(cmd)) + ": read-only replica, send writes to the primary");
+
+    if (cmd == StmtKind::Begin || cmd == StmtKind::Commit || cmd == StmtKind::Rollback)
+        return transaction(p, s);
+
+    // schema changes, views, filters and statistics are not transactional
+    if (s.open_ && !p.explain && (p.bloom || p.view || cmd == StmtKind::Create || cmd == StmtKind::Drop || cmd == StmtKind::Analyze || cmd == StmtKind::Alter))
+        return ResultSet::error(string(Parse::kindName(cmd)) + (p.bloom ? " BLOOM FILTER" : p.view ? " MATERIALIZED VIEW" : "")
+            + ": not allowed inside a transaction");
+
+    if (p.explain)
+        return explain(p, s);
+
+    if (p.bloom)
+        return bloomFilter(p);
+
+    if (p.view)
+        return cmd == StmtKind::Create ? createView(p) : dropView(p);
+
+    if (cmd == StmtKind::Create) {
+
+        if (catalog_.has(tname))
+            return ResultSet::error("Error: table already exists");
+
+        TableSchema s = schemaFromCreateCols(p.cols);
+
+        if (s.names.empty())
+            return ResultSet::error("CREATE: no columns");
+
+        if (isPartition(tname))
+            return ResultSet::error("CREATE: table names can't contain '.'");
+
+        if (!p.ddl().shardCol.empty())
+            return ResultSet::error("CREATE: SHARD BY is for a coordinator (db --shards)");
+
+        if (!p.ddl().partKind.empty())
+            return createPartitioned(tname, p, s);
+
+        bool ok = catalog_.create(tname, s);
+
+        return ok ? ResultSet::done("[OK] Created " + tname) : ResultSet::error("Failed to create");
+    }
+
+
+    if (cmd == StmtKind::Insert) {
+        TableDynamic* t = table(tname, s, true);
+        if (!t)
+            return ResultSet::error("INSERT: table not found");
+
+        string err;
+
+        if (!validateInsert(t->schema(), p.vals, err))
+            return ResultSet::error("INSERT validation: " + err);
+
+        if (t->view())
+            return ResultSet::error("INSERT: " + tname + " is a materialized view");
+
+        if (isPartition(tname))
+            return ResultSet::error("INSERT: " + tname + " is a partition, insert through its table");
+
+        if (t->partitions()) {
+            int part = routeRow(*t, p.vals, err);
+            if (part < 0)
+                return ResultSet::error("INSERT: " + err);
+            TableDynamic* pt = partition(*t, part, s, true);
+            pt->insertRow(vector<string>(p.vals.begin(), p.vals.end()));
+            compactIfDue(*pt, s);
+            return ResultSet::done("[OK] Inserted into " + tname, 1);
+        }
+
+        t->insertRow(vector<string>(p.vals.begin(), p.vals.end()));
+        maintainViews(*t, { RowDelta::Insert, t->rowCount() - 1, t->rowCount(), {}, {} }, s);
+        compactIfDue(*t, s);
+        return ResultSet::done("[OK] Inserted into " + tname, 1);
+    }
+
+
+    // identical SELECTs between two writes to the table are answered from the
+    // cache (not inside a transaction, whose copies share the committed version)
+    if (cmd == StmtKind::Select && cache_.enabled() && !s.open_) {
+        if (TableDynamic* t = catalog_.get(tname)) {
+            string key = cacheKey(p, versionTag(*t, p));
+            if (auto hit = cache_.get(key)) {
+                ResultSet rs = *hit;
+                if (rs.table_)
+                    rs.table_ = t;
+                metrics::add(metrics::RowsReturned, rs.rowCount());
+                return rs;
+            }
+
+            ResultSet rs;
+            if (t->partitions())
+                rs = runPartitioned(p, *t, s);
+            else {
+                Plan pl;
+                string err;
+                if (!plan(p, false, pl, err, s))
+                    return ResultSet::error(err);
+                rs = runPlan(p, pl, s);
+            }
+            if (rs.ok())
+                cache_.put(std::move(key), rs, rs.memoryBytes());
+            return rs;
+        }
+    }
+
+    if (cmd == StmtKind::Select || cmd == StmtKind::Update || cmd == StmtKind::Delete) {
+        if (TableDynamic* t = table(tname, s, false); t && t->partitions())
+            return runPartitioned(p, *t, s);
+
+        Plan pl;
+        string err;
+        if (!plan(p, false, pl, err, s))
+            return ResultSet::error(err);
+
+        return runPlan(p, pl, s);
+    }
+
+
+    if (cmd == StmtKind::Drop) {
+        if (TableDynamic* t = catalog_.get(tname); t && t->view())
+            return ResultSet::error("DROP: '" + tname + "' is a materialized view, use DROP MATERIALIZED VIEW");
+        if (auto* vs = viewsOf(tname); vs && !vs->empty())
+            return ResultSet::error("DROP: materialized view '" + vs->front() + "' depends on '" + tname + "'");
+        if (isPartition(tname))
+            return ResultSet::error("DROP: '" + tname + "' is a partition, use ALTER TABLE ... DROP PARTITION");
+        if (TableDynamic* t = catalog_.get(tname); t && t->partitions())
+            for (size_t i = 0; i < t->partitions()->names.size(); ++i)
+                catalog_.drop(t->partitionKey(i));
+        if (catalog_.drop(tname))
+            return ResultSet::done("Table '" + tname + "' dropped successfully.");
+
+        return ResultSet::error("DROP: table '" + tname + "' not found or already dropped.");
+    }
+
+    if (cmd == StmtKind::Show)
+        return iequals(p.table, "REPLICATION") ? showReplication() : showStats();
+
+    if (cmd == StmtKind::Alter)
+        return alterTable(p);
+
+    if (cmd == StmtKind::Analyze)
+        return analyzeTable(tname);
+
+    if (cmd == StmtKind::None)
+        return ResultSet::error("Invalid query or unsupported format");
+
+    return ResultSet::error("Unsupported command: " + string(Parse::kindName(cmd)));
+}
+
+// base table -> its materialized views, read from the .view files on first use
+void Database::loadViews() {
+    if (viewsLoaded_)
+        return;
+    viewsLoaded_ = true;
+    error_code ec;
+    for (auto& e : fs::directory_iterator(catalog_.folder(), ec)) {
+        if (e.path().extension() != ".view")
+            continue;
+        ifstream in(e.path());
+        string word, base;
+        if (in >> word >> base && word == "base")
+            viewsOf_[lowerCopy(base)].push_back(lowerCopy(e.path().stem().string()));
+    }
+}
+
+const vector<string>* Database::viewsOf(const string& base) {
+    loadViews();
+    auto it = viewsOf_.find(base);
+    return it == viewsOf_.end() ? nullptr : &it->second;
+}
+
+// a view's SELECT against its base: output columns and WHERE
+static bool compileView(const TableDynamic& base, const ViewInfo& v, vector<int>& cols, Predicate& where, string& err) {
+    Statement sel;
+    if (!Parse::parseStatement(v.query, sel) || sel.kind != StmtKind::Select || sel.explain) {
+        err = "only SELECT cols FROM table [WHERE col op val] can be materialized";
+        return false;
+    }
+    return selectColumns(base, sel, cols, err) && wherePredicate(base, sel, where, err);
+}
+
+static vector<string> viewRow(const TableDynamic& base, int r, const vector<int>& cols) {
+    vector<string> row;
+    row.reserve(cols.size());
+    for (int c : cols)
+        row.push_back(base.cellText(r, c));
+    return row;
+}
+
+// recomputes the view from scratch (CREATE, or a mapping lost on disk)
+static void rebuildView(const TableDynamic& base, TableDynamic& view, const vector<int>& cols, Predicate& where) {
+    vector<int> all(view.rowCount());
+    iota(all.begin(), all.end(), 0);
+    view.deleteRowIds(all);
+    view.compact();
+
+    vector<int>& src = view.view()->src;
+    src.clear();
+    vector<vector<string>> rows;
+    where.prepare(base);
+    int n = base.rowCount();
+    for (int r = 0; r < n; ++r) {
+        if (where.col >= 0 && r % IntColumn::kBlock == 0 && (r = where.nextCandidate(r, n)) >= n)
+            break;
+        if ((r = base.nextLive(r, n)) >= n)
+            break;
+        if (where.col >= 0 && !where.matchAt(base, r))
+            continue;
+        rows.push_back(viewRow(base, r, cols));
+        src.push_back(r);
+    }
+    view.appendRows(std::move(rows));
+}
+
+// applies a change to base's rows to each of its materialized views as a
+// delta: new rows are filtered and appended, deleted rows are deleted from the
+// view too, updated rows enter, leave or are rewritten in place.
+// Each view is saved once per statement (or at COMMIT inside a transaction),
+// deletes only append to its delete journal
+void Database::maintainViews(TableDynamic& base, const RowDelta& d, Session& s) {
+    const vector<string>* names = viewsOf(base.name());
+    if (!names)
+        return;
+
+    for (const string& name : *names) {
+        TableDynamic* v = table(name, s, true);
+        vector<int> cols;
+        Predicate where;
+        string err;
+        if (!v || !v->view() || !compileView(base, *v->view(), cols, where, err))
+            continue;
+
+        if (d.kind == RowDelta::Update) {
+            bool touches = false;
+            for (int c : d.cols)
+                touches = touches || c == where.col || find(cols.begin(), cols.end(), c) != cols.end();
+            if (!touches)
+                continue;
+        }
+
+        bool deferred = v->savesDeferred();
+        v->deferSaves(true);
+        vector<int>& src = v->view()->src;
+        where.prepare(base);
+        auto matches = [&](int r) { return where.col < 0 || where.matchAt(base, r); };
+
+        if (src.size() != (size_t)v->rowCount()) {
+            rebuildView(base, *v, cols, where);
+        }
+        else if (d.kind == RowDelta::Insert) {
+            vector<vector<string>> rows;
+            for (int r = d.from; r < d.to; ++r)
+                if (matches(r)) {
+                    rows.push_back(viewRow(base, r, cols));
+                    src.push_back(r);
+                }
+            v->appendRows(std::move(rows));
+        }
+        else if (d.kind == RowDelta::Delete) {
+            vector<int> drop;
+            for (size_t k = 0; k < src.size(); ++k)
+                if (!v->deleted((int)k) && binary_search(d.ids.begin(), d.ids.end(), src[k]))
+                    drop.push_back((int)k);
+            // like a DELETE on the view: journaled, the view file is not rewritten
+            v->deferSaves(deferred);
+            v->deleteRowIds(drop);
+            compactIfDue(*v, s);
+            continue;
+        }
+        else {
+            unordered_map<int, int> at;     // updated base row -> live view row
+            for (size_t k = 0; k < src.size(); ++k)
+                if (!v->deleted((int)k) && binary_search(d.ids.begin(), d.ids.end(), src[k]))
+                    at[src[k]] = (int)k;
+
+            vector<int> drop, addSrc;
+            vector<vector<string>> add;
+            for (int r : d.ids) {
+                auto it = at.find(r);
+                if (it == at.end()) {
+                    if (matches(r)) {
+                        add.push_back(viewRow(base, r, cols));
+                        addSrc.push_back(r);
+                    }
+                }
+                else if (!matches(r))
+                    drop.push_back(it->second);
+                else
+                    for (size_t j = 0; j < cols.size(); ++j)
+                        if (find(d.cols.begin(), d.cols.end(), cols[j]) != d.cols.end())
+                            v->setCell(it->second, (int)j, base.cellText(r, cols[j]));
+            }
+
+            sort(drop.begin(), drop.end());
+            v->deleteRowIds(drop);
+            src.insert(src.end(), addSrc.begin(), addSrc.end());
+            v->appendRows(std::move(add));
+        }
+
+        v->deferSaves(deferred);
+        v->touch();
+        compactIfDue(*v, s);
+    }
+}
+
+// DELETE only marks rows (TableDynamic::deleteRowIds). Once the deleted ones
+// are kCompactAt of a table's row ids, the write statement that finds it so
+// compacts it before returning, still under its write lock. SELECT results
+// borrow row ids and stay valid until the next statement that modifies their
+// table, so rows are never renumbered between statements
+const double kCompactAt = 0.25;
+
+void Database::compactIfDue(TableDynamic& t, Session& s) {
+    if (s.open_ || t.deadFraction() < kCompactAt)
+        return;     // a transaction's copy is looked at again when COMMIT publishes it
+    compact(lowerCopy(t.name()));
+}
+
+// the views of a compacted base are compacted with it and their row mapping
+// follows the base's new row ids. A table copied by an open transaction is left
+// alone (the copy, in the old row ids, replaces it at COMMIT) until a statement
+// after the transaction writes it
+void Database::compact(const string& key) {
+    TableDynamic* t = catalog_.isLoaded(key) ? catalog_.get(key) : nullptr;
+    const vector<string>* names = t && !t->view() ? viewsOf(key) : nullptr;
+    {
+        lock_guard<mutex> g(compactMu_);
+        if (held_.count(key))
+            return;
+        for (size_t i = 0; names && i < names->size(); ++i)
+            if (held_.count((*names)[i]))
+                return;
+    }
+    if (!t || t->deadFraction() < kCompactAt)
+        return;
+
+    vector<int> gone = t->compact();
+    metrics::add(metrics::Compactions);
+    metrics::add(metrics::RowsCompacted, gone.size());
+    for (size_t i = 0; names && i < names->size(); ++i) {
+        TableDynamic* v = catalog_.get((*names)[i]);
+        if (!v || !v->view())
+            continue;
+        bool deferred = v->savesDeferred();
+        v->deferSaves(true);
+        v->compact();
+        for (int& r : v->view()->src)
+            r -= (int)(lower_bound(gone.begin(), gone.end(), r) - gone.begin());
+        v->deferSaves(deferred);
+        v->touch();
+    }
+}
+
+shared_ptr<void> Database::hold(const string& key) {
+    lock_guard<mutex> lk(compactMu_);
+    ++held_[key];
+    return shared_ptr<void>(nullptr, [this, key](void*) {
+        lock_guard<mutex> lk(compactMu_);
+        if (--held_[key] == 0)
+            held_.erase(key);
+    });
+}
+
+// CREATE MATERIALIZED VIEW v AS SELECT cols FROM t [WHERE col op val]
+ResultSet Database::createView(const Statement& p) {
+    string key = lowerCopy(p.table);
+    if (catalog_.has(key))
+        return ResultSet::error("Error: table already exists");
+
+    ViewInfo info;
+    info.query = string(p.ddl().query);
+    Statement sel;
+    if (!Parse::parseStatement(info.query, sel) || sel.kind != StmtKind::Select || sel.explain)
+        return ResultSet::error("CREATE MATERIALIZED VIEW: only SELECT cols FROM table [WHERE col op val] can be materialized");
+
+    TableDynamic* base = catalog_.get(lowerCopy(sel.table));
+    if (!base)
+        return ResultSet::error("CREATE MATERIALIZED VIEW: table not found");
+    if (base->view())
+        return ResultSet::error("CREATE MATERIALIZED VIEW: " + base->name() + " is itself a view");
+    if (base->partitions())
+        return ResultSet::error("CREATE MATERIALIZED VIEW: " + base->name() + " is partitioned, views of partitioned tables are not supported");
+
+    vector<int> cols;
+    Predicate where;
+    string err;
+    if (!compileView(*base, info, cols, where, err))
+        return ResultSet::error("CREATE MATERIALIZED VIEW: " + err);
+
+    TableSchema schema;
+    for (int c : cols) {
+        schema.names.push_back(base->schema().names[c]);
+        schema.types.push_back(base->schema().types[c]);
+    }
+    if (!catalog_.create(key, schema))
+        return ResultSet::error("Failed to create");
+
+    TableDynamic* v = catalog_.get(key);
+    info.base = base->name();
+    v->setView(std::move(info));
+    v->deferSaves(true);
+    rebuildView(*base, *v, cols, where);
+    v->deferSaves(false);
+    v->touch();
+
+    loadViews();
+    viewsOf_[base->name()].push_back(key);
+    return ResultSet::done("[OK] Created materialized view " + key + " (" + to_string(v->liveRows()) + " rows)", v->liveRows());
+}
+
+ResultSet Database::dropView(const Statement& p) {
+    string key = lowerCopy(p.table);
+    TableDynamic* v = catalog_.get(key);
+    if (!v || !v->view())
+        return ResultSet::error("DROP MATERIALIZED VIEW: '" + key + "' is not a materialized view");
+
+    loadViews();
+    auto& vs = viewsOf_[lowerCopy(v->view()->base)];
+    vs.erase(remove(vs.begin(), vs.end(), key), vs.end());
+    catalog_.drop(key);
+    return ResultSet::done("Materialized view '" + key + "' dropped successfully.");
+}
+
+// ALTER TABLE t ADD [COLUMN] c TYPE [DEFAULT v] | DROP [COLUMN] c. Only the
+// schema changes: the rows already there read the default and a dropped
+// column's values stay in the file, both until the table is next saved (see
+// TableDynamic::addColumn). A partitioned table changes with its partitions
+ResultSet Database::alterColumns(const Statement& p) {
+    string key = lowerCopy(p.table);
+    TableDynamic* t = catalog_.get(key);
+    if (!t)
+        return ResultSet::error("ALTER: table not found");
+    if (t->view())
+        return ResultSet::error("ALTER: " + t->name() + " is a materialized view");
+
+    bool add = iequals(p.ddl().alterOp, "ADD");
+    string col = lowerCopy(p.cols[0]);
+    int c = t->columnIndex(col);
+    TableSchema schema = t->schema();
+    ValueType type = ValueType::String;
+    string value = p.vals.empty() ? string() : string(p.vals[0]);
+    if (add) {
+        if (c >= 0)
+            return ResultSet::error("ALTER: " + t->name() + " already has a column " + col);
+        parseValueType(p.cols[1], type);    // unknown types are kept as STRING, as in CREATE
+        if (p.vals.empty() && isFixedWidth(type))
+            return ResultSet::error("ALTER: a " + string(typeName(type)) + " column needs a DEFAULT");
+        if (!valueFits(type, value))
+            return ResultSet::error("ALTER: DEFAULT '" + value + "' not " + typeName(type));
+        schema.names.push_back(col);
+        schema.types.push_back(typeName(type));
+    }
+    else {
+        if (c < 0)
+            return ResultSet::error("ALTER: " + t->name() + " has no column " + col);
+        if (schema.names.size() == 1)
+            return ResultSet::error("ALTER: " + col + " is the only column of " + t->name());
+        if (t->partitions() && t->partitions()->col == col)
+            return ResultSet::error("ALTER: " + col + " is the partition column of " + t->name());
+        schema.names.erase(schema.names.begin() + c);
+        schema.types.erase(schema.types.begin() + c);
+    }
+
+    // a view must read the same columns from the new schema (SELECT * would not)
+    TableDynamic probe;
+    probe.setSchema(schema);
+    const vector<string>* names = viewsOf(key);
+    for (size_t i = 0; names && i < names->size(); ++i) {
+        TableDynamic* v = catalog_.get((*names)[i]);
+        vector<int> cols;
+        Predicate where;
+        string err;
+        if (!v || !v->view())
+            continue;
+        bool same = compileView(probe, *v->view(), cols, where, err) && cols.size() == v->schema().names.size();
+        for (size_t k = 0; same && k < cols.size(); ++k)
+            same = schema.names[cols[k]] == v->schema().names[k];
+        if (!same)
+            return ResultSet::error("ALTER: materialized view " + v->name() + (add ? " selects every column of " + t->name() : " reads " + col));
+    }
+
+    vector<TableDynamic*> tables{ t };
+    for (size_t i = 0; t->partitions() && i < t->partitions()->names.size(); ++i)
+        if (TableDynamic* pt = catalog_.get(t->partitionKey(i)))
+            tables.push_back(pt);
+    for (TableDynamic* tb : tables) {
+        if (add)
+            tb->addColumn(col, typeName(type), value);
+        else
+            tb->dropColumn(c);
+    }
+    return ResultSet::done(add ? "[OK] Added column " + col + " to " + t->name() : "[OK] Dropped column " + col + " from " + t->name());
+}
+
+// CREATE / DROP BLOOM FILTER ON t (col)
+ResultSet Database::bloomFilter(const Statement& p) {
+    bool create = p.kind == StmtKind::Create;
+    string what = create ? "CREATE BLOOM FILTER" : "DROP BLOOM FILTER";
+    TableDynamic* t = catalog_.get(lowerCopy(p.table));
+    if (!t)
+        return ResultSet::error(what + ": table not found");
+
+    int col = t->columnIndex(p.cols[0]);
+    if (col < 0)
+        return ResultSet::error(what + ": unknown column " + string(p.cols[0]));
+
+    string target = t->name() + "(" + t->schema().names[col] + ")";
+    if (const PartitionSpec* spec = t->partitions()) {
+        // one filter per partition
+        int n = 0;
+        for (size_t i = 0; i < spec->names.size(); ++i) {
+            TableDynamic* pt = partition(*t, i, session_, false);
+            n += create ? pt->createBloom(col) : pt->dropBloom(col);
+        }
+        return ResultSet::done("[OK] Bloom filter " + string(create ? "created on " : "dropped from ") + target
+            + " in " + to_string(n) + " of " + to_string(spec->names.size()) + " partitions");
+    }
+    if (create)
+        return t->createBloom(col) ? ResultSet::done("[OK] Bloom filter created on " + target)
+                                   : ResultSet::error(what + ": " + target + " already has one");
+    return t->dropBloom(col) ? ResultSet::done("[OK] Bloom filter dropped from " + target)
+                             : ResultSet::error(what + ": " + target + " has none");
+}
+
+// ANALYZE t: rebuilds and persists the table statistics, one row per column
+ResultSet Database::analyzeTable(const string& name) {
+    TableDynamic* t = catalog_.get(name);
+    if (!t)
+        return ResultSet::error("ANALYZE: table not found");
+
+    if (const PartitionSpec* spec = t->partitions()) {
+        // each partition keeps its own statistics, rows are prefixed with its name
+        ResultSet out;
+        for (size_t i = 0; i < spec->names.size(); ++i) {
+            partition(*t, i, session_, false);
+            ResultSet r = analyzeTable(t->partitionKey(i));
+            if (out.names_.empty()) {
+                out.names_ = r.names_;
+                out.types_ = r.types_;
+                out.names_.insert(out.names_.begin(), "partition");
+                out.types_.insert(out.types_.begin(), "STRING");
+            }
+            for (auto& row : r.owned_) {
+                row.insert(row.begin(), spec->names[i]);
+                out.owned_.push_back(std::move(row));
+            }
+        }
+        return out;
+    }
+
+    t->analyze();
+    const TableStats& st = t->stats();
+
+    ResultSet out;
+    out.names_ = { "column", "type", "ndv", "min", "max", "histogram", "storage", "bytes" };
+    out.types_ = { "STRING", "STRING", "INT", "STRING", "STRING", "STRING", "STRING", "INT" };
+
+    for (size_t c = 0; c < st.columns().size(); ++c) {
+        const ColumnStats& cs = st.columns()[c];
+        string lo, hi;
+        if (!cs.empty) {
+            lo = cs.isInt ? formatValue(cs.type, cs.minI) : cs.minS;
+            hi = cs.isInt ? formatValue(cs.type, cs.maxI) : cs.maxS;
+        }
+        string hist = cs.bounds.size() > 1 ? to_string(cs.bounds.size() - 1) + " buckets" : "-";
+        string storage = t->column((int)c).describe();
+        size_t bytes = t->column((int)c).memoryBytes();
+        if (const BlockBloom* bf = t->bloom((int)c)) {
+            storage += " + bloom filter";
+            bytes += bf->memoryBytes();
+        }
+        out.owned_.push_back({ t->schema().names[c], t->schema().types[c],
+            to_string((long long)llround(st.distinct((int)c))), lo, hi, hist,
+            storage, to_string(bytes) });
+    }
+    return out;
+}
+
+static const StmtKind kStatKinds[] = {
+    StmtKind::Create, StmtKind::Insert, StmtKind::Select, StmtKind::Update,
+    StmtKind::Delete, StmtKind::Drop, StmtKind::Show, StmtKind::Analyze,
+    StmtKind::Begin, StmtKind::Commit, StmtKind::Rollback, StmtKind::Alter
+};
+
+static string usStr(uint64_t ns) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.1f", (double)ns / 1000.0);
+    return buf;
+}
+
+// SHOW STATS: one (metric, value) row per counter, plus a latency summary for
+// every statement kind that has run. Latencies are in microseconds.
+ResultSet Database::showStats() {
+    metrics::Snapshot s = metrics::snapshot();
+
+    ResultSet out;
+    out.names_ = { "metric", "value" };
+    out.types_ = { "STRING", "STRING" };
+
+    for (int c = 0; c < metrics::kCounters; ++c)
+        out.owned_.push_back({ metrics::counterName(c), to_string(s.counters[c]) });
+
+    if (cache_.enabled()) {
+        uint64_t hits = s.counters[metrics::ResultCacheHits], looks = hits + s.counters[metrics::ResultCacheMisses];
+        char rate[32];
+        snprintf(rate, sizeof(rate), "%.1f%%", looks ? 100.0 * hits / looks : 0.0);
+        out.owned_.push_back({ "result_cache.hit_rate", rate });
+        out.owned_.push_back({ "result_cache.entries", to_string(cache_.entries()) });
+        out.owned_.push_back({ "result_cache.bytes", to_string(cache_.bytes()) });
+    }
+
+    if (repl_)
+        for (auto& row : showReplication().owned_)
+            out.owned_.push_back(std::move(row));
+
+    for (StmtKind k : kStatKinds) {
+        int i = (int)k;
+        string name = lowerCopy(Parse::kindName(k));
+        out.owned_.push_back({ "statements." + name, to_string(s.statements[i]) });
+    }
+
+    for (StmtKind k : kStatKinds) {
+        int i = (int)k;
+        if (s.statements[i] == 0)
+            continue;
+        string pre = "latency_us." + lowerCopy(Parse::kindName(k)) + ".";
+        out.owned_.push_back({ pre + "mean", usStr(s.sumNs[i] / s.statements[i]) });
+        out.owned_.push_back({ pre + "p50", usStr(s.quantileNs(i, 0.50)) });
+        out.owned_.push_back({ pre + "p90", usStr(s.quantileNs(i, 0.90)) });
+        out.owned_.push_back({ pre + "p99", usStr(s.quantileNs(i, 0.99)) });
+        out.owned_.push_back({ pre + "p999", usStr(s.quantileNs(i, 0.999)) });
+        out.owned_.push_back({ pre + "max", usStr(s.maxNs[i]) });
+    }
+
+    if (!statsFile_.empty()) {
+        string err;
+        if (!dumpStats(err))
+            return ResultSet::error("SHOW STATS: " + err);
+    }
+    return out;
+}
+
+// SHOW REPLICATION: the role and, on a follower, how far behind the primary it is.
+// lag_ms is the age of the last change replayed while newer ones are known, 0 when caught up
+ResultSet Database::showReplication() {
+    ResultSet out;
+    out.names_ = { "metric", "value" };
+    out.types_ = { "STRING", "STRING" };
+    auto add = [&](const string& k, const string& v) { out.owned_.push_back({ "replication." + k, v }); };
+
+    if (!repl_ || repl_->role == ReplicationState::None) {
+        add("role", "none");
+        return out;
+    }
+
+    int64_t now = wallMicros();
+    if (repl_->role == ReplicationState::Primary) {
+        add("role", "primary");
+        add("epoch", to_string(repl_->epoch));
+        add("lsn", to_string(changeLog_ ? changeLog_->lsn() : 0));
+        add("followers", to_string(repl_->followers));
+        return out;
+    }
+
+    uint64_t applied = repl_->appliedLsn, newest = repl_->primaryLsn;
+    int64_t contact = repl_->contactTs;
+    add("role", "follower");
+    add("primary", repl_->peer);
+    add("connected", repl_->connected ? "yes" : "no");
+    add("epoch", to_string(repl_->epoch));
+    add("applied_lsn", to_string(applied));
+    add("primary_lsn", to_string(newest));
+    add("lag_ms", to_string(applied >= newest ? 0 : max<int64_t>(0, now - repl_->appliedTs) / 1000));
+    add("last_contact_ms", contact ? to_string(max<int64_t>(0, now - contact) / 1000) : "-");
+    return out;
+}
+
+// primary: the text of a statement that changed data goes to the log; inside
+// a transaction it waits in the session until COMMIT logs them all as one entry
+void Database::logChange(const Statement& st, const ResultSet& rs, Session& s) {
+    if (!changeLog_)
+        return;
+
+    if (st.kind == StmtKind::Commit || st.kind == StmtKind::Rollback) {
+        if (st.kind == StmtKind::Commit && rs.ok() && !s.logged_.empty())
+            changeLog_->append(std::move(s.logged_));
+        s.logged_.clear();
+        return;
+    }
+    if (!rs.ok() || !changesData(st) || st.text.empty())
+        return;
+
+    string sql(st.text);
+    replace_if(sql.begin(), sql.end(), [](char c) { return c == '\n' || c == '\r'; }, ' ');
+    if (s.open_)
+        s.logged_.push_back(std::move(sql));
+    else
+        changeLog_->append({ std::move(sql) });
+}
+
+// writers hold rw_ exclusively while they change files and log, so the files
+// read under the shared lock are exactly the state at lsn
+bool Database::snapshot(vector<pair<string, string>>& files, uint64_t& lsn, string& err) {
+    shared_lock<shared_mutex> lk(rw_);
+    lsn = changeLog_ ? changeLog_->lsn() : 0;
+
+    const string& dir = catalog_.folder();
+    ensure_dir(dir);
+    error_code ec;
+    for (auto& e : fs::directory_iterator(dir, ec)) {
+        if (!e.is_regular_file())
+            continue;
+        ifstream in(e.path(), ios::binary);
+        if (!in.is_open()) {
+            err = "cannot read " + e.path().string();
+            return false;
+        }
+        files.push_back({ e.path().filename().string(), string(istreambuf_iterator<char>(in), istreambuf_iterator<char>()) });
+    }
+    if (ec) {
+        err = dir + ": " + ec.message();
+        return false;
+    }
+    return true;
+}
+
+bool Database::restore(vector<pair<string, string>> files, string& err) {
+    for (auto& f : files)
+        if (f.first.empty() || f.first[0] == '.' || f.first.find_first_of("/\\") != string::npos) {
+            err = "bad file name '" + f.first + "' in snapshot";
+            return false;
+        }
+
+    unique_lock<shared_mutex> lk(rw_);
+    const string& dir = catalog_.folder();
+    ensure_dir(dir);
+    catalog_.unloadAll();
+    viewsOf_.clear();
+    viewsLoaded_ = false;
+
+    error_code ec;
+    vector<fs::path> old;
+    for (auto& e : fs::directory_iterator(dir, ec))
+        if (e.is_regular_file())
+            old.push_back(e.path());
+    for (auto& p : old)
+        fs::remove(p, ec);
+
+    WriteBatch batch;
+    for (auto& [name, data] : files)
+        batch.add(dir + name, std::move(data));
+    if (!batch.wait()) {
+        err = "cannot write the snapshot into " + dir;
+        return false;
+    }
+    return true;
+}
+
+bool Database::applyLogged(const vector<string>& sqls, bool transaction, string& err) {
+    vector<string_view> texts;
+    if (transaction)
+        texts.push_back("BEGIN");
+    texts.insert(texts.end(), sqls.begin(), sqls.end());
+    if (transaction)
+        texts.push_back("COMMIT");
+
+    vector<Statement> sts(texts.size());
+    for (size_t i = 0; i < texts.size(); ++i)
+        Parse::parseStatement(texts[i], sts[i]);    // unparsable ones stay StmtKind::None and fail
+
+    bool ok = true;
+    executeBatch(sts.data(), sts.size(), applier_, [&](size_t i, const ResultSet& rs) {
+        if (!rs.ok() && ok) {
+            err = string(texts[i]) + ": " + rs.message();
+            ok = false;
+        }
+    });
+    return ok;
+}
+
+// JSON with the raw counters and the non-empty histogram buckets
+// ([lower bound ns, count]) so percentiles can be recomputed or merged offline.
+// Written to a temp file and renamed, readers never see a partial dump.
+bool Database::dumpStats(string& err) const {
+    if (statsFile_.empty())
+        return true;
+
+    lock_guard<mutex> lk(statsMu_);
+    metrics::Snapshot s = metrics::snapshot();
+    string tmp = statsFile_ + ".tmp";
+    {
+        ofstream out(tmp, ios::trunc);
+        if (!out.is_open()) {
+            err = "cannot write " + tmp;
+            return false;
+        }
+
+        out << "{\n  \"counters\": {";
+        for (int c = 0; c < metrics::kCounters; ++c)
+            out << (c ? ", " : "") << "\"" << metrics::counterName(c) << "\": " << s.counters[c];
+        out << "},\n  \"statements\": {";
+
+        bool first = true;
+        for (StmtKind k : kStatKinds) {
+            int i = (int)k;
+            out << (first ? "" : ",") << "\n    \"" << lowerCopy(Parse::kindName(k)) << "\": {"
+                << "\"count\": " << s.statements[i]
+                << ", \"sum_ns\": " << s.sumNs[i]
+                << ", \"max_ns\": " << s.maxNs[i]
+                << ", \"p50_ns\": " << s.quantileNs(i, 0.50)
+                << ", \"p99_ns\": " << s.quantileNs(i, 0.99)
+                << ", \"p999_ns\": " << s.quantileNs(i, 0.999)
+                << ", \"buckets\": [";
+            bool firstBucket = true;
+            for (int b = 0; b < metrics::kBuckets; ++b) {
+                if (!s.hist[i][b])
+                    continue;
+                out << (firstBucket ? "" : ", ") << "[" << metrics::bucketLow(b) << ", " << s.hist[i][b] << "]";
+                firstBucket = false;
+            }
+            out << "]}";
+            first = false;
+        }
+        out << "\n  }\n}\n";
+
+        if (!out) {
+            err = "cannot write " + tmp;
+            return false;
+        }
+    }
+
+    error_code ec;
+    fs::rename(tmp, statsFile_, ec);
+    if (ec) {
+        err = "cannot write " + statsFile_ + ": " + ec.message();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,321 @@
+#ifndef DATABASE_H
+#define DATABASE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include <unordered_map>
+#include "utils.h"
+#include "parser.h"
+#include "db.h"
+#include "operators.h"
+#include "result_cache.h"
+#include "replication.h"
+using namespace std;
+
+// result of one statement. SELECT results borrow rows straight from the table
+// (row ids + column map), so they stay valid only until the next statement
+// that modifies or drops that table. Other results own their rows.
+class ResultSet {
+    bool ok_ = true;
+    string message_;
+    int affected_ = 0;
+
+    vector<string> names_;
+    vector<string> types_;
+
+    const TableDynamic* table_ = nullptr; // borrowed rows
+    vector<int> rowIds_;
+    vector<int> colMap_;
+
+    // fixed-width columns have no text to borrow: their keys are decoded
+    // once into ints_ and printed into text_ (row r is text_[offs_[r]..offs_[r+1]))
+    struct IntOut {
+        vector<long long> ints;
+        string text;
+        vector<uint32_t> offs;
+    };
+    vector<int> intOut_;                  // output column -> index in decoded_, or -1
+    vector<IntOut> decoded_;
+
+    vector<vector<string>> owned_;        // materialized rows
+
+    friend class Database;
+    friend class Coordinator;           // builds results gathered from shards
+
+    void decodeInts()
+    {
+        intOut_.assign(colMap_.size(), -1);
+        for (size_t c = 0; c < colMap_.size(); ++c) {
+            const Column& col = table_->column(colMap_[c]);
+            if (!col.isInt())
+                continue;
+            intOut_[c] = (int)decoded_.size();
+            IntOut& o = decoded_.emplace_back();
+            o.ints.reserve(rowIds_.size());
+            o.offs.reserve(rowIds_.size() + 1);
+            o.offs.push_back(0);
+
+            // row ids come in table order, so each block is decoded once
+            vector<long long> block(IntColumn::kBlock);
+            long long blockNo = -1;
+            char buf[32];
+            for (int r : rowIds_) {
+                long long b = r / IntColumn::kBlock;
+                if (b != blockNo) {
+                    col.ints().decodeBlock((size_t)b, block.data());
+                    blockNo = b;
+                }
+                long long v = block[r % IntColumn::kBlock];
+                o.ints.push_back(v);
+                o.text.append(buf, formatValue(col.type(), v, buf));
+                o.offs.push_back((uint32_t)o.text.size());
+            }
+        }
+    }
+
+public:
+    class Row {
+        const ResultSet* rs_;
+        size_t idx_;
+
+    public:
+        Row(const ResultSet* rs, size_t idx) : rs_(rs), idx_(idx) {}
+
+        size_t size() const { return rs_->columnCount(); }
+        string_view operator[](size_t col) const { return rs_->cell(idx_, col); }
+        string_view getString(size_t col) const { return rs_->cell(idx_, col); }
+        long long getInt(size_t col) const { return rs_->getInt(idx_, col); }
+    };
+
+    class iterator {
+        const ResultSet* rs_;
+        size_t idx_;
+
+    public:
+        iterator(const ResultSet* rs, size_t idx) : rs_(rs), idx_(idx) {}
+
+        Row operator*() const { return Row(rs_, idx_); }
+        iterator& operator++() { ++idx_; return *this; }
+        bool operator!=(const iterator& o) const { return idx_ != o.idx_; }
+        bool operator==(const iterator& o) const { return idx_ == o.idx_; }
+    };
+
+    static ResultSet error(const string& msg)
+    {
+        ResultSet r;
+        r.ok_ = false;
+        r.message_ = msg;
+        return r;
+    }
+
+    static ResultSet done(const string& msg, int affected = 0)
+    {
+        ResultSet r;
+        r.message_ = msg;
+        r.affected_ = affected;
+        return r;
+    }
+
+    bool ok() const { return ok_; }
+    const string& message() const { return message_; }
+    int affected() const { return affected_; }
+    bool hasRows() const { return !names_.empty(); }
+
+    const vector<string>& columnNames() const { return names_; }
+    const vector<string>& columnTypes() const { return types_; }
+    size_t columnCount() const { return names_.size(); }
+    bool isInt(size_t col) const { return isIntegral(valueTypeOf(types_.at(col))); }
+
+    size_t rowCount() const { return table_ ? rowIds_.size() : owned_.size(); }
+
+    string_view cell(size_t row, size_t col) const
+    {
+        if (table_) {
+            if (intOut_[col] >= 0) {
+                const IntOut& o = decoded_[intOut_[col]];
+                return string_view(o.text).substr(o.offs[row], o.offs[row + 1] - o.offs[row]);
+            }
+            return table_->cell(rowIds_[row], colMap_[col]);
+        }
+        return owned_[row][col];
+    }
+
+    // approximate heap footprint, for the result cache budget
+    size_t memoryBytes() const
+    {
+        size_t n = sizeof(*this) + message_.capacity() + rowIds_.capacity() * sizeof(int) + colMap_.capacity() * sizeof(int);
+        for (auto& s : names_)
+            n += sizeof(string) + s.capacity();
+        for (auto& s : types_)
+            n += sizeof(string) + s.capacity();
+        for (auto& o : decoded_)
+            n += sizeof(IntOut) + o.ints.capacity() * sizeof(long long) + o.text.capacity() + o.offs.capacity() * sizeof(uint32_t);
+        for (auto& r : owned_) {
+            n += sizeof(r) + r.capacity() * sizeof(string);
+            for (auto& s : r)
+                n += s.capacity() > 15 ? s.capacity() : 0;
+        }
+        return n;
+    }
+
+    long long getInt(size_t row, size_t col) const
+    {
+        if (table_ && intOut_[col] >= 0 && valueTypeOf(types_[col]) != ValueType::Double)
+            return decoded_[intOut_[col]].ints[row];    // the key, the number itself for INT / BIGINT
+        long long v = 0;
+        parseInt64(cell(row, col), v);
+        return v;
+    }
+
+    Row operator[](size_t row) const { return Row(this, row); }
+    iterator begin() const { return iterator(this, 0); }
+    iterator end() const { return iterator(this, rowCount()); }
+};
+
+// one client's BEGIN ... COMMIT state. The first write to a table inside a
+// transaction makes a private copy of it; the session's later statements read
+// and write that copy while everyone else keeps seeing the committed table.
+// COMMIT publishes the copies and saves each table once; ROLLBACK, or
+// destroying the session, discards them. A session is used by one thread at a time.
+class Session {
+    struct Pending {
+        TableDynamic table;
+        uint64_t base;          // version of the committed table when copied
+        shared_ptr<void> hold;  // keeps the committed table from being compacted
+
+        explicit Pending(const TableDynamic& t) : table(t), base(t.version()) { table.deferSaves(true); }
+    };
+
+    bool open_ = false;
+    unordered_map<string, Pending> tables_;    // by table key
+    vector<string> logged_;     // its statements that changed data, logged at COMMIT
+
+    friend class Database;
+
+public:
+    bool inTransaction() const { return open_; }
+};
+
+// statements may be executed from several threads: SELECTs share rw_,
+// everything that modifies the catalog or a table holds it exclusively
+class Database {
+    Catalog catalog_;
+    shared_mutex rw_;
+    string statsFile_;
+    mutable mutex statsMu_;     // one dump at a time
+
+    // operator tree for SELECT / UPDATE / DELETE
+    struct Plan {
+        Arena arena;            // operators and their buffers, freed with the plan (declared first)
+        TableDynamic* table = nullptr;
+        OpPtr root;
+        vector<int> colMap;     // SELECT output columns
+        vector<Assignment> sets; // UPDATE col = expr, compiled
+        string access;          // access path choice, for EXPLAIN
+    };
+
+    mutex compactMu_;
+    unordered_map<string, int> held_;       // tables copied by open transactions
+    Session session_;           // used by the overloads without a session
+    ResultCache<ResultSet> cache_;  // SELECT results, off until setResultCache()
+    unordered_map<string, vector<string>> viewsOf_;    // base table -> its materialized views
+    bool viewsLoaded_ = false;
+    ChangeLog* changeLog_ = nullptr;        // primary: where changes are logged
+    const ReplicationState* repl_ = nullptr;
+    bool readOnly_ = false;                 // follower: only applyLogged() changes data
+    Session applier_;                       // follower: replays the primary's log
+
+    // a change to a table's rows, handed to its materialized views
+    struct RowDelta {
+        enum Kind { Insert, Update, Delete } kind;
+        int from = 0, to = 0;       // Insert: the new rows [from, to)
+        span<const int> ids;        // Update: rows changed, Delete: rows deleted (ascending)
+        vector<int> cols;           // Update: columns assigned
+    };
+
+    ResultSet run(const Statement& st, Session& s);
+    bool plan(const Statement& st, bool analyze, Plan& pl, string& err, Session& s);
+    bool planTable(TableDynamic* t, const Statement& st, bool analyze, Plan& pl, string& err);
+    ResultSet runPlan(const Statement& st, Plan& pl, Session& s);
+    ResultSet explain(const Statement& st, Session& s);
+    ResultSet createPartitioned(const string& key, const Statement& st, const TableSchema& schema);
+    ResultSet alterTable(const Statement& st);
+    ResultSet alterColumns(const Statement& st);
+    ResultSet runPartitioned(const Statement& st, TableDynamic& t, Session& s);
+    ResultSet explainPartitioned(const Statement& st, TableDynamic& t, Session& s);
+    TableDynamic* partition(TableDynamic& t, size_t i, Session& s, bool write);
+    string versionTag(TableDynamic& t, const Statement& st);
+    ResultSet showStats();
+    ResultSet showReplication();
+    void logChange(const Statement& st, const ResultSet& rs, Session& s);
+    ResultSet analyzeTable(const string& name);
+    ResultSet bloomFilter(const Statement& st);
+    ResultSet transaction(const Statement& st, Session& s);
+    ResultSet createView(const Statement& st);
+    ResultSet dropView(const Statement& st);
+    void loadViews();
+    const vector<string>* viewsOf(const string& base);
+    void maintainViews(TableDynamic& base, const RowDelta& d, Session& s);
+    void compactIfDue(TableDynamic& t, Session& s);
+    void compact(const string& key);
+    shared_ptr<void> hold(const string& key);
+    TableDynamic* table(const string& key, Session& s, bool write);
+    void insertGroup(const Statement* sts, size_t n, Session& s, const function<void(size_t, const ResultSet&)>& consume);
+
+public:
+    Database() {
+        metrics::registry();    // made first so it outlives a static Database
+    }
+
+    // parse and run one statement
+    ResultSet execute(string_view sql);
+    ResultSet execute(const Statement& st);
+    ResultSet execute(const Statement& st, Session& s);
+
+    // runs st and hands the result to consume while the statement's lock is
+    // still held, so borrowed SELECT rows can be read safely next to writers
+    void execute(const Statement& st, const function<void(const ResultSet&)>& consume);
+    void execute(const Statement& st, Session& s, const function<void(const ResultSet&)>& consume);
+
+    // runs n statements in order, consume(i, result) is called for each one.
+    // consecutive INSERTs into the same table are validated one by one but
+    // appended and saved together, under a single lock
+    void executeBatch(const Statement* sts, size_t n, const function<void(size_t, const ResultSet&)>& consume);
+    void executeBatch(const Statement* sts, size_t n, Session& s, const function<void(size_t, const ResultSet&)>& consume);
+
+    Catalog& catalog() { return catalog_; }
+
+    // caches SELECT results up to bytes of memory (LRU), 0 turns it off.
+    // Entries are keyed by table version, so writes never return stale rows
+    void setResultCache(size_t bytes) { cache_.setBudget(bytes); }
+
+    // primary: every statement that changes data is appended to log, in the
+    // order the write lock ran it (a transaction as one entry, at COMMIT)
+    void setChangeLog(ChangeLog* log, const ReplicationState* st) { changeLog_ = log; repl_ = st; }
+
+    // follower: statements that change data are refused, the rows come from
+    // restore() and applyLogged()
+    void setReplica(const ReplicationState* st) { readOnly_ = true; repl_ = st; }
+
+    // copies every file of the catalog folder, consistent with lsn (the last logged change)
+    bool snapshot(vector<pair<string, string>>& files, uint64_t& lsn, string& err);
+
+    // replaces the catalog folder with a primary's snapshot and drops the loaded tables
+    bool restore(vector<pair<string, string>> files, string& err);
+
+    // replays log entries in order: the statements of one committed
+    // transaction, or a run of single-statement entries batched together
+    bool applyLogged(const vector<string>& sqls, bool transaction, string& err);
+
+    // machine-readable metrics dump (JSON), rewritten on SHOW STATS and
+    // whenever dumpStats() is called. Empty path disables it.
+    void setStatsFile(const string& path) { statsFile_ = path; }
+    const string& statsFile() const { return statsFile_; }
+    bool dumpStats(string& err) const;
+};
+
+#endif // DATABASE_H
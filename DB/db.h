@@ -8,7 +8,19 @@
 #include <sstream>
 #include <functional>
 #include <filesystem>
+#include <mutex>
+#include <atomic>
+#include <optional>
+#include <span>
+#include <memory_resource>
 #include "utils.h"
+#include "stats.h"
+#include "table_stats.h"
+#include "column.h"
+#include "bloom.h"
+#include "tombstones.h"
+#include "expr.h"
+#include "async_io.h"
 
 using namespace std;
 namespace fs = std::filesystem;
@@ -18,17 +30,359 @@ struct TableSchema {
     vector<string> types;
 };
 
+// a materialized view's definition, kept with the view's own table.
+// src[i] is the base table row behind view row i
+struct ViewInfo {
+    string base;
+    string query;       // the SELECT ... text
+    vector<int> src;
+};
+
+// hash of a value for HASH partitions and shards. Fixed-width values hash by
+// their key, so two spellings of one value (7, 007) land in the same place
+static inline uint64_t valueHash(string_view v, ValueType type) {
+    long long key = 0;
+    return isFixedWidth(type) && encodeValue(type, v, key) ? hash64(to_string(key)) : hash64(v);
+}
+
+// how a partitioned table spreads its rows. The table itself keeps the schema
+// and no rows; partition i is the table "<name>.<names[i]>" with its own file.
+// RANGE: partition i takes keys below bounds[i] (and at or above the bound
+// before it), the last one everything when maxValue. HASH: the value's hash
+struct PartitionSpec {
+    bool hash = false;
+    string col;
+    vector<string> names;
+    vector<long long> bounds;   // RANGE: ascending keys, the last unused when maxValue
+    bool maxValue = false;
+
+    // partition for a value of the column, -1 when no partition takes it
+    int route(string_view v, ValueType type) const
+    {
+        if (hash)
+            return (int)(valueHash(v, type) % names.size());
+        long long key = 0;
+        if (!encodeValue(type, v, key))
+            return -1;
+        size_t n = maxValue ? bounds.size() - 1 : bounds.size();
+        size_t i = upper_bound(bounds.begin(), bounds.begin() + n, key) - bounds.begin();
+        return i < n || maxValue ? (int)i : -1;
+    }
+};
+
+// one "col = expr" of an UPDATE
+struct Assignment {
+    int col = -1;
+    Expr expr;
+};
+
 class TableDynamic {
     string name_;
     TableSchema schema_;
-    vector<vector<string>> rows_;
+    vector<Column> cols_;       // one per schema column, see column.h
+    int rowCount_ = 0;          // row ids in use, deleted rows included
+    Tombstones dead_;           // deleted rows, dropped by compact()
     string folder_ = "./db/";
+    TableStats stats_;
+    vector<optional<BlockBloom>> blooms_;   // per column, set by CREATE BLOOM FILTER
+    optional<ViewInfo> view_;   // set when this table is a materialized view
+    optional<PartitionSpec> part_;  // set when the rows live in partitions
+    uint64_t version_ = 0;      // stamp of the last change, unique across tables
+    bool deferSave_ = false;    // a transaction's copy: saved once at COMMIT
+
+    static uint64_t nextVersion()
+    {
+        static atomic<uint64_t> v{ 0 };
+        return ++v;
+    }
+
+    // every change to the rows ends here
+    void changed()
+    {
+        version_ = nextVersion();
+        if (!deferSave_)
+            save();
+    }
+
+    // empty columns for the current schema, STRING columns dictionary encoded
+    void resetColumns()
+    {
+        cols_.clear();
+        for (auto& t : schema_.types)
+            cols_.push_back(Column::forType(t));
+        blooms_.assign(cols_.size(), nullopt);
+        rowCount_ = 0;
+        dead_.clear();
+    }
+
+    void pushRow(const vector<string>& vals)
+    {
+        for (size_t c = 0; c < cols_.size(); ++c)
+            cols_[c].push(c < vals.size() ? string_view(vals[c]) : string_view());
+        for (size_t c = 0; c < cols_.size(); ++c)
+            if (blooms_[c])
+                blooms_[c]->add(rowCount_, bloomHash(rowCount_, (int)c));
+        ++rowCount_;
+    }
+
+    void rebuildBloom(int col)
+    {
+        blooms_[col]->clear();
+        for (int r = 0; r < rowCount_; ++r)
+            blooms_[col]->add(r, bloomHash(r, col));
+    }
 
     string filepath() const // return full path of table file
     {
         return folder_ + name_ + ".txt";
     }
 
+    string statsPath() const
+    {
+        return folder_ + name_ + ".stats";
+    }
+
+    string bloomPath() const
+    {
+        return folder_ + name_ + ".bloom";
+    }
+
+    string viewPath() const
+    {
+        return folder_ + name_ + ".view";
+    }
+
+    string partPath() const
+    {
+        return folder_ + name_ + ".part";
+    }
+
+    string alterPath() const
+    {
+        return folder_ + name_ + ".alter";
+    }
+
+    string deletePath() const
+    {
+        return folder_ + name_ + ".del";
+    }
+
+    void insertColumn(const string& name, const string& type, string_view v)
+    {
+        schema_.names.push_back(toLower(name));
+        schema_.types.push_back(type);
+        cols_.push_back(Column::forType(type));
+        cols_.back().pushRepeat(v, rowCount_);
+        blooms_.push_back(nullopt);
+    }
+
+    void eraseColumn(int c)
+    {
+        schema_.names.erase(schema_.names.begin() + c);
+        schema_.types.erase(schema_.types.begin() + c);
+        cols_.erase(cols_.begin() + c);
+        blooms_.erase(blooms_.begin() + c);
+    }
+
+    // column changes the table file doesn't have yet: "add name TYPE" with the
+    // default on the next line, or "drop name". The next save() writes the
+    // file in the new layout and removes them
+    void appendAlter(const string& entry) const
+    {
+        ensure_dir(folder_);
+        ofstream(alterPath(), ios::app) << entry << "\n";
+    }
+
+    void loadAlters()
+    {
+        ifstream in(alterPath());
+        string line, v;
+        while (getline(in, line)) {
+            stringstream ss(line);
+            string op, name, type;
+            ss >> op >> name >> type;
+            int c = columnIndex(name);
+            if (op == "add" && getline(in, v) && c < 0)
+                insertColumn(name, type, v);
+            else if (op == "drop" && c >= 0 && schema_.names.size() > 1)
+                eraseColumn(c);
+        }
+    }
+
+    // rows deleted since the table file was written, one line per DELETE:
+    // "count <base64 of the int32 row ids>". The next save() writes them into
+    // the file's bitmap and removes the journal
+    void appendDeletes(span<const int> ids) const
+    {
+        ensure_dir(folder_);
+        ofstream(deletePath(), ios::app) << ids.size() << " " << base64Encode(ids.data(), ids.size() * sizeof(int)) << "\n";
+    }
+
+    void loadDeletes()
+    {
+        ifstream in(deletePath());
+        string line;
+        vector<int> ids;
+        while (getline(in, line)) {
+            size_t sp = line.find(' ');
+            long long n = 0;
+            if (sp == string::npos || !parseInt64(string_view(line).substr(0, sp), n) || n < 0 || n > rowCount_)
+                break;
+            ids.resize((size_t)n);
+            if (!base64Decode(string_view(line).substr(sp + 1), ids.data(), ids.size() * sizeof(int)))
+                break;  // a torn last line: the DELETE it records did not finish
+            for (int r : ids)
+                if (r >= 0 && r < rowCount_)
+                    dead_.kill(r);
+        }
+    }
+
+    // "range col" or "hash col", then one "name [bound]" line per partition
+    void savePartitions() const
+    {
+        if (!part_)
+            return;
+        ofstream out(partPath());
+        if (!out.is_open())
+            return;
+        int c = columnIndex(part_->col);
+        ValueType type = c >= 0 ? valueTypeOf(schema_.types[c]) : ValueType::String;
+        out << (part_->hash ? "hash " : "range ") << part_->col << "\n";
+        for (size_t i = 0; i < part_->names.size(); ++i) {
+            out << part_->names[i];
+            if (!part_->hash)
+                out << " " << (part_->maxValue && i + 1 == part_->names.size() ? string("MAXVALUE") : formatValue(type, part_->bounds[i]));
+            out << "\n";
+        }
+    }
+
+    void loadPartitions()
+    {
+        part_.reset();
+        ifstream in(partPath());
+        if (!in.is_open())
+            return;
+
+        PartitionSpec p;
+        string kind, line;
+        if (!(in >> kind >> p.col) || (kind != "range" && kind != "hash"))
+            return;
+        p.hash = kind == "hash";
+        int c = columnIndex(p.col);
+        ValueType type = c >= 0 ? valueTypeOf(schema_.types[c]) : ValueType::String;
+        getline(in, line);
+        while (getline(in, line)) {
+            stringstream ss(line);
+            string name, bound;
+            if (!(ss >> name))
+                continue;
+            long long key = 0;
+            if (!p.hash) {
+                ss >> bound;
+                p.maxValue = bound == "MAXVALUE";
+                if (!p.maxValue && !encodeValue(type, bound, key))
+                    return;
+            }
+            p.names.push_back(name);
+            p.bounds.push_back(key);
+        }
+        if (!p.names.empty())
+            part_ = std::move(p);
+    }
+
+    // "base b", "query SELECT ...", then "rows n" and the base row ids (base64 int32)
+    void saveView() const
+    {
+        if (!view_)
+            return;
+        ofstream out(viewPath());
+        if (!out.is_open())
+            return;
+        const vector<int>& src = view_->src;
+        out << "base " << view_->base << "\nquery " << view_->query << "\nrows " << src.size() << "\n"
+            << (src.empty() ? "-" : base64Encode(src.data(), src.size() * sizeof(int))) << "\n";
+    }
+
+    // a view whose mapping doesn't fit its rows keeps the definition only
+    void loadView()
+    {
+        view_.reset();
+        ifstream in(viewPath());
+        if (!in.is_open())
+            return;
+
+        ViewInfo v;
+        string word, line;
+        size_t n = 0;
+        if (!(in >> word >> v.base) || word != "base" || !(in >> word) || word != "query")
+            return;
+        getline(in, v.query);
+        v.query = string(trimView(v.query));
+        if (in >> word >> n && word == "rows" && n == (size_t)rowCount_ && in >> line) {
+            v.src.resize(n);
+            if (n && !base64Decode(line, v.src.data(), n * sizeof(int)))
+                v.src.clear();
+        }
+        view_ = std::move(v);
+    }
+
+    // "blooms n", then per filter "column blocks" and one line per block
+    void saveBlooms() const
+    {
+        int n = 0;
+        for (auto& b : blooms_)
+            n += b.has_value();
+
+        error_code ec;
+        if (n == 0) {
+            fs::remove(bloomPath(), ec);
+            return;
+        }
+
+        ofstream out(bloomPath());
+        if (!out.is_open())
+            return;
+        out << "blooms " << n << "\n";
+        for (size_t c = 0; c < blooms_.size(); ++c)
+            if (blooms_[c]) {
+                out << schema_.names[c] << " " << blooms_[c]->blocks() << "\n";
+                blooms_[c]->write(out);
+            }
+    }
+
+    // filters that are missing, damaged or out of step with the rows are rebuilt
+    void loadBlooms()
+    {
+        ifstream in(bloomPath());
+        if (!in.is_open())
+            return;
+
+        string word, line;
+        int n = 0;
+        if (!(in >> word >> n) || word != "blooms")
+            return;
+
+        size_t want = ((size_t)rowCount_ + BlockBloom::kBlock - 1) / BlockBloom::kBlock;
+        for (int i = 0; i < n; ++i) {
+            string name;
+            size_t blocks = 0;
+            if (!(in >> name >> blocks))
+                return;
+            getline(in, line);
+
+            int col = columnIndex(name);
+            BlockBloom b;
+            bool ok = true;
+            for (size_t k = 0; k < blocks; ++k)
+                ok = getline(in, line) && b.readLine(line) && ok;
+            if (col < 0)
+                continue;
+            blooms_[col] = std::move(b);
+            if (!ok || blocks != want)
+                rebuildBloom(col);
+        }
+    }
+
 public:
     TableDynamic()
     {
@@ -59,6 +413,7 @@ public:
 
     void setSchema(const TableSchema& s)
     {
+        version_ = nextVersion();
         schema_.names.clear();
         schema_.types.clear();
 
@@ -66,18 +421,20 @@ public:
             schema_.names.push_back(toLower(s.names[i]));
             schema_.types.push_back(s.types[i]);
         }
+        resetColumns();
+        stats_.clear();
     }
     const TableSchema& schema() const
     {
         return schema_;
     }
 
-    int columnIndex(const string& col) const
+    int columnIndex(string_view col) const
     {
-        string want = toLower(trim(col));
+        string_view want = trimView(col);
 
         for (int i = 0; i < (int)schema_.names.size(); ++i) {
-            if (schema_.names[i] == want)
+            if (iequals(schema_.names[i], want))
                 return i;
         }
         return -1;
@@ -85,172 +442,756 @@ public:
 
     void insertRow(const vector<string>& vals)
     {
-        rows_.push_back(vals);
+        pushRow(vals);
+        if (stats_.analyzed())
+            stats_.observe(vals);
+
+        changed();
+    }
+    // appends many rows with a single save()
+    void appendRows(vector<vector<string>>&& rows)
+    {
+        if (rows.empty())
+            return;
+
+        for (auto& c : cols_)
+            c.reserve(rowCount_ + rows.size());
+        for (auto& r : rows) {
+            if (stats_.analyzed())
+                stats_.observe(r);
+            pushRow(r);
+        }
 
-        save();
+        changed();
     }
+
+    // row ids run from 0 to rowCount(), deleted ones included: scans skip
+    // them with nextLive(). liveRows() is what the table holds
     int rowCount() const
     {
-        return (int)rows_.size();
+        return rowCount_;
     }
 
-    vector<string>& getRow(int idx)
+    int liveRows() const
     {
-        return rows_.at(idx);
+        return rowCount_ - (int)dead_.count();
     }
 
-    int updateRows(function<bool(const vector<string>&)> pred, int targetIdx, const string& newVal) {
-        int changed = 0;
+    bool deleted(int row) const
+    {
+        return dead_.dead(row);
+    }
+
+    // first row >= row (up to end) that is not deleted
+    int nextLive(int row, int end) const
+    {
+        return dead_.nextLive(row, end);
+    }
+
+    // deleted share of the row ids, compaction starts above a threshold
+    double deadFraction() const
+    {
+        return rowCount_ ? (double)dead_.count() / rowCount_ : 0.0;
+    }
+
+    // the live row ids, ascending
+    vector<int> liveIds() const
+    {
+        vector<int> ids;
+        ids.reserve(liveRows());
+        for (int r = nextLive(0, rowCount_); r < rowCount_; r = nextLive(r + 1, rowCount_))
+            ids.push_back(r);
+        return ids;
+    }
+
+    // changes when the table does: a transaction checks it at COMMIT
+    uint64_t version() const
+    {
+        return version_;
+    }
+
+    // on: changes stay in memory until the caller save()s
+    void deferSaves(bool on)
+    {
+        deferSave_ = on;
+    }
+
+    bool savesDeferred() const
+    {
+        return deferSave_;
+    }
+
+    // records a change made through view() or several deferred calls
+    void touch()
+    {
+        changed();
+    }
+
+    // ALTER TABLE ADD COLUMN: the rows already there read v. They are not
+    // rewritten, the change is appended to <table>.alter (see appendAlter)
+    void addColumn(const string& name, const string& type, string_view v)
+    {
+        version_ = nextVersion();
+        insertColumn(name, type, v);
+        if (stats_.analyzed()) {
+            stats_.addColumn(valueTypeOf(type), v);
+            stats_.save(statsPath());
+        }
+        appendAlter("add " + schema_.names.back() + " " + type + "\n" + string(v));
+    }
+
+    // ALTER TABLE DROP COLUMN: the column's storage is released, its values
+    // stay in the table file until the next save()
+    void dropColumn(int c)
+    {
+        version_ = nextVersion();
+        string name = schema_.names[c];
+        eraseColumn(c);
+        if (stats_.analyzed()) {
+            stats_.dropColumn(c);
+            stats_.save(statsPath());
+        }
+        appendAlter("drop " + name);
+    }
+
+    // partitioned tables only
+    const PartitionSpec* partitions() const
+    {
+        return part_ ? &*part_ : nullptr;
+    }
+
+    // "<table>.<partition>", the catalog key of partition i
+    string partitionKey(size_t i) const
+    {
+        return name_ + "." + part_->names[i];
+    }
+
+    void setPartitions(PartitionSpec p)
+    {
+        version_ = nextVersion();
+        part_ = std::move(p);
+        ensure_dir(folder_);
+        savePartitions();
+    }
+
+    // materialized views only
+    const ViewInfo* view() const
+    {
+        return view_ ? &*view_ : nullptr;
+    }
+
+    ViewInfo* view()
+    {
+        return view_ ? &*view_ : nullptr;
+    }
+
+    void setView(ViewInfo v)
+    {
+        view_ = std::move(v);
+    }
+
+    const Column& column(int c) const
+    {
+        return cols_[c];
+    }
+
+    // value hashed into a Bloom filter: the cell as text, the key for fixed-width columns
+    uint64_t bloomHash(int row, int col) const
+    {
+        const Column& c = cols_[col];
+        return c.isInt() ? BlockBloom::hashOf(to_string(c.getInt(row))) : BlockBloom::hashOf(c.get(row));
+    }
+
+    const BlockBloom* bloom(int col) const
+    {
+        return blooms_[col] ? &*blooms_[col] : nullptr;
+    }
+
+    // CREATE BLOOM FILTER: false when the column already has one
+    bool createBloom(int col)
+    {
+        if (blooms_[col])
+            return false;
+        version_ = nextVersion();
+        blooms_[col].emplace();
+        rebuildBloom(col);
+        ensure_dir(folder_);
+        saveBlooms();
+        return true;
+    }
+
+    bool dropBloom(int col)
+    {
+        if (!blooms_[col])
+            return false;
+        version_ = nextVersion();
+        blooms_[col].reset();
+        saveBlooms();
+        return true;
+    }
+
+    // text columns (column(col).isInt() == false) only
+    string_view cell(int row, int col) const
+    {
+        return cols_[col].get(row);
+    }
+
+    // compressed INT columns only
+    long long intCell(int row, int col) const
+    {
+        return cols_[col].getInt(row);
+    }
+
+    // any column, as text
+    string cellText(int row, int col) const
+    {
+        return cols_[col].text(row);
+    }
+
+    // any column, as text, into a caller-owned string (reuses its capacity)
+    template <class Str>
+    void cellInto(int row, int col, Str& out) const
+    {
+        const Column& c = cols_[col];
+        if (c.isInt()) {
+            char buf[32];
+            out.assign(buf, formatValue(c.type(), c.getInt(row), buf));
+        }
+        else
+            out.assign(c.get(row));
+    }
+
+    // rowValues() into an existing row buffer
+    template <class Row>
+    void rowInto(int row, Row& out) const
+    {
+        out.resize(cols_.size());
+        for (size_t c = 0; c < cols_.size(); ++c)
+            cellInto(row, (int)c, out[c]);
+    }
+
+    // copies one row out of the columns
+    vector<string> rowValues(int row) const
+    {
+        vector<string> r;
+        r.reserve(cols_.size());
+        for (auto& c : cols_)
+            r.push_back(c.text(row));
+        return r;
+    }
+
+    // a Bloom filter keeps the old value's bits: harmless, it may only say "maybe"
+    void setCell(int row, int col, string_view v)
+    {
+        version_ = nextVersion();
+        cols_[col].set(row, v);
+        if (blooms_[col])
+            blooms_[col]->add(row, bloomHash(row, col));
+    }
 
-        for (auto& row : rows_) {
-            if (pred(row)) {
-                row[targetIdx] = newVal;
-                ++changed;
+    // UPDATE: applies sets to the given ascending rows. Every right-hand side
+    // sees the row as it was before the statement. Computed values (the keys of
+    // INT, BIGINT and DOUBLE cells) are evaluated block by block from the
+    // decoded source columns, then written back a block at a time: only cells
+    // whose value changes are written and only blocks holding one are re-encoded. Saves once, if anything changed.
+    // Returns the rows matched, or -1 with err set and the table untouched
+    int updateRowIds(span<const int> ids, span<const Assignment> sets, string& err,
+        pmr::memory_resource* mr = pmr::get_default_resource())
+    {
+        size_t n = ids.size();
+        if (n == 0)
+            return 0;
+
+        // 1) new values, nothing is written yet so a failing row changes nothing
+        pmr::vector<pmr::vector<long long>> ints(mr);     // per set, computed keys
+        pmr::vector<pmr::vector<pmr::string>> texts(mr);  // per set, copied columns
+        for (auto& a : sets) {
+            ints.emplace_back();
+            texts.emplace_back();
+            if (a.expr.isLiteral())
+                continue;
+            int src = a.expr.copiedColumn();
+            if (src >= 0 && !isIntegral(valueTypeOf(schema_.types[a.col]))) {
+                texts.back().resize(n);
+                for (size_t i = 0; i < n; ++i)
+                    cellInto(ids[i], src, texts.back()[i]);
+                continue;
             }
+            ints.back().resize(n);
+        }
+
+        // source INT columns decoded one block at a time
+        pmr::vector<pmr::vector<long long>> blockOf(cols_.size(), mr);
+        for (size_t k = 0; k < sets.size(); ++k)
+            if (!ints[k].empty())
+                sets[k].expr.forColumns([&](int c) { blockOf[c].resize(IntColumn::kBlock); });
+
+        const char* why = nullptr;
+        for (size_t i = 0; i < n;) {
+            int b = ids[i] / IntColumn::kBlock;
+            for (size_t c = 0; c < cols_.size(); ++c)
+                if (!blockOf[c].empty() && cols_[c].isInt())
+                    cols_[c].ints().decodeBlock(b, blockOf[c].data());
+
+            for (; i < n && ids[i] / IntColumn::kBlock == b; ++i) {
+                int r = ids[i];
+                bool bad = false;
+                auto get = [&](int c) -> long long {
+                    if (cols_[c].isInt())
+                        return blockOf[c][r % IntColumn::kBlock];
+                    long long x = 0;       // INT column holding wider values
+                    bad |= !parseInt64(cols_[c].get(r), x);
+                    return x;
+                };
+                for (size_t k = 0; k < sets.size(); ++k) {
+                    if (ints[k].empty())
+                        continue;
+                    const Expr& e = sets[k].expr;
+                    double d = 0;
+                    if (!(e.isReal() ? e.evalReal(get, d, why) : e.evalInt(get, ints[k][i], why)) || bad) {
+                        err = bad ? "integer out of range" : why;
+                        return -1;
+                    }
+                    if (e.isReal())
+                        ints[k][i] = doubleKey(d);
+                }
+            }
+        }
+
+        // 2) write, column by column
+        bool any = false;
+        pmr::vector<char> diff(n, 0, mr);
+        pmr::vector<long long> same(mr);
+        for (size_t k = 0; k < sets.size(); ++k) {
+            int c = sets[k].col;
+            Column& col = cols_[c];
+            const Expr& e = sets[k].expr;
+            fill(diff.begin(), diff.end(), 0);
+
+            long long lit = 0;
+            span<const long long> vals = ints[k];
+            if (e.isLiteral() && col.isInt() && encodeValue(col.type(), e.literal(), lit)) {
+                same.assign(n, lit);
+                vals = same;
+            }
+
+            if (!vals.empty() && col.isInt())
+                any |= col.ints().setMany(ids, vals, diff) > 0;
+            else {
+                string cur;
+                for (size_t i = 0; i < n; ++i) {
+                    string_view v;
+                    char buf[24];
+                    if (!vals.empty())
+                        v = string_view(buf, to_chars(buf, buf + sizeof(buf), vals[i]).ptr);
+                    else if (e.isLiteral())
+                        v = e.literal();
+                    else
+                        v = texts[k][i];
+                    cellInto(ids[i], c, cur);
+                    if (cur != v) {
+                        col.set(ids[i], v);
+                        diff[i] = 1;
+                        any = true;
+                    }
+                }
+            }
+
+            // a Bloom filter keeps the old value's bits: harmless, it may only say "maybe"
+            if (blooms_[c])
+                for (size_t i = 0; i < n; ++i)
+                    if (diff[i])
+                        blooms_[c]->add(ids[i], bloomHash(ids[i], c));
         }
-        if (changed > 0)
-            save();
 
-        return changed;
+        if (any)
+            changed();
+        return (int)n;
     }
 
-    int deleteRows(vector<string> pred)
+    int updateRows(function<bool(const vector<string>&)> pred, int targetIdx, const string& newVal) {
+        vector<int> ids;
+        for (int r : liveIds())
+            if (pred(rowValues(r)))
+                ids.push_back(r);
+
+        Assignment a;
+        a.col = targetIdx;
+        string err;
+        if (!a.expr.compile(newVal, schema_.names, schema_.types, schema_.types[targetIdx], err))
+            return 0;
+        return max(updateRowIds(ids, span<const Assignment>(&a, 1), err), 0);
+    }
+
+    int deleteRows(function<bool(const vector<string>&)> pred)
     {
-        vector<vector<string>> remain;
-        int deleted = 0;
+        vector<int> ids;
+        for (int r : liveIds())
+            if (pred(rowValues(r)))
+                ids.push_back(r);
 
-        for (auto& row : rows_)
-        {
-            if (row==pred)
-                deleted++;    
-            else
-                remain.push_back(row);
+        return deleteRowIds(ids);
+    }
+
+    // marks the rows deleted, no other row moves. The table file is not
+    // rewritten: the ids go to <table>.del (see appendDeletes), compaction or
+    // the next other change writes the file. Returns the rows newly deleted
+    int deleteRowIds(span<const int> ids)
+    {
+        vector<int> fresh;
+        for (int r : ids)
+            if (dead_.kill(r))
+                fresh.push_back(r);
+        if (fresh.empty())
+            return 0;
+
+        version_ = nextVersion();
+        stats_.setRows(liveRows());
+        if (!deferSave_) {
+            if (stats_.analyzed())
+                stats_.save(statsPath());
+            appendDeletes(fresh);
+        }
+        return (int)fresh.size();
+    }
+
+    // drops the deleted rows for good, the rows after them move down. Returns
+    // the ids removed (ascending, old numbering) so views can renumber
+    vector<int> compact()
+    {
+        vector<int> ids = dead_.ids();
+        if (ids.empty())
+            return ids;
+
+        for (auto& c : cols_)
+            c.erase(ids);
+        if (view_ && view_->src.size() == (size_t)rowCount_) {
+            size_t w = 0, k = 0;
+            for (size_t r = 0; r < view_->src.size(); ++r) {
+                if (k < ids.size() && ids[k] == (int)r) {
+                    ++k;
+                    continue;
+                }
+                view_->src[w++] = view_->src[r];
+            }
+            view_->src.resize(w);
         }
+        rowCount_ -= (int)ids.size();
+        dead_.clear();
+        for (size_t c = 0; c < blooms_.size(); ++c)
+            if (blooms_[c])     // rows moved between blocks
+                rebuildBloom((int)c);
+
+        changed();
+        return ids;
+    }
 
-        rows_.swap(remain);
+    // ANALYZE: rebuilds the statistics from the rows and persists them
+    void analyze()
+    {
+        version_ = nextVersion();
+        vector<int> live = liveIds();
+        stats_.build(schema_.types, (int)live.size(), [&](int r, int c) { return cellText(live[r], c); });
+        ensure_dir(folder_);
+        stats_.save(statsPath());
+    }
 
-        if (deleted > 0)
-            save();
+    const TableStats& stats() const
+    {
+        return stats_;
+    }
 
-        return deleted;
+    bool save() const {
+        WriteBatch batch;
+        save(batch);
+        return batch.wait();
     }
 
-    void save() const {
+    // the table file is built in memory and handed to the batch, so several
+    // tables saved into one batch are written concurrently
+    void save(WriteBatch& batch) const {
         // ensure file exestence
         ensure_dir(folder_);
 
-        ofstream out(filepath()); // open file to write and save at out
-
-        if (!out.is_open())
-            return;
+        if (stats_.analyzed()) // keep the persisted row count / NDV / min / max in step
+            stats_.save(statsPath());
+        saveBlooms();
+        saveView();
+        savePartitions();
 
+        ostringstream out;
         int coloums = (int)schema_.names.size();
 
+        // dictionary columns: "name STRING DICT n" followed by the n values,
+        // rows then hold the code instead of the string.
+        // INT columns: "name INT PACKED rows lines" followed by one line per
+        // compressed block, they are not repeated in the rows.
+        vector<vector<uint32_t>> remap(coloums);
+        bool anyText = false;
+
         out << coloums << "\n";
-        for (int i = 0; i < coloums; ++i)
-            out << schema_.names[i] << " " << schema_.types[i] << "\n";
+        for (int i = 0; i < coloums; ++i) {
+            out << schema_.names[i] << " " << schema_.types[i];
+            const Column& col = cols_[i];
+            if (col.isDict()) {
+                uint32_t live = col.liveCodes(remap[i]);
+                out << " DICT " << live << "\n";
+                for (uint32_t c = 0; c < (uint32_t)col.dictSize(); ++c)
+                    if (remap[i][c] != UINT32_MAX)
+                        out << col.dictValue(c) << "\n";
+            }
+            else if (col.isInt()) {
+                out << " PACKED " << col.size() << " " << col.ints().lineCount() << "\n";
+                col.ints().write(out);
+            }
+            else
+                out << "\n";
+            anyText = anyText || !col.isInt();
+        }
 
-        for (int i = 0; i < (int)rows_.size(); ++i) {
-            out << (i + 1);
-            for (auto& v : rows_[i]) out << "," << v;
+        // "DELETED count blocks" and the bitmap: deleted rows keep their place in the file
+        if (dead_.any())
+            out << "DELETED " << dead_.header() << "\n" << dead_.encode() << "\n";
+
+        for (int r = 0; anyText && r < rowCount_; ++r) {
+            out << (r + 1);
+            for (int i = 0; i < coloums; ++i) {
+                if (cols_[i].isInt())
+                    continue;
+                out << ",";
+                if (cols_[i].isDict())
+                    out << remap[i][cols_[i].code(r)];
+                else
+                    out << cols_[i].get(r);
+            }
             out << "\n";
         }
+
+        string data = std::move(out).str();
+        uint64_t bytes = data.size();
+        if (!batch.add(filepath(), std::move(data)))
+            return;
+        // once on disk the file has the current columns and bitmap
+        batch.removeWhenWritten(alterPath());
+        batch.removeWhenWritten(deletePath());
+
+        metrics::add(metrics::TableSaves);
+        metrics::add(metrics::BytesWritten, bytes);
     }
 
     void load() {
-        rows_.clear();
-        ifstream in(filepath()); // open file
+        version_ = nextVersion();
+        schema_.names.clear();
+        schema_.types.clear();
+        resetColumns();
+        ReadAhead in(filepath()); // reads run ahead of the parsing below
 
         if (!in.is_open())
             return;
 
+        metrics::add(metrics::TableLoads);
+        metrics::add(metrics::BytesRead, in.size());
+
         int c = 0;
+        string line;
 
-        if (!(in >> c))
+        if (!getline(in, line) || !(stringstream(line) >> c))
             return;
 
-        string line;
-        getline(in, line);
-        schema_.names.clear();
-        schema_.types.clear();
+        vector<Column> cols;
+        vector<char> coded(c, 0);   // rows hold dictionary codes for this column
+        vector<char> packed(c, 0);  // column stored as blocks, not in the rows
+        long long packedRows = -1;
+
+        auto fail = [this] { // damaged header: load as an empty table
+            schema_.names.clear();
+            schema_.types.clear();
+            resetColumns();
+        };
 
         for (int i = 0; i < c; ++i) { // load colounns
             if (!getline(in, line))
-                return;
+                return fail();
 
             stringstream ss(line);
-            string name, type;
-            ss >> name >> type;
+            string name, type, enc;
+            size_t n = 0, lines = 0;
+            ss >> name >> type >> enc >> n >> lines;
 
             schema_.names.push_back(toLower(name));
             schema_.types.push_back(type);
+            cols.push_back(Column::forType(type));
+
+            if (enc == "PACKED") {
+                if (!cols.back().isInt())
+                    return fail();
+                for (size_t k = 0; k < lines; ++k)
+                    if (!getline(in, line) || !cols.back().ints().readLine(line))
+                        return fail();
+                if (cols.back().size() != n || (packedRows >= 0 && (long long)n != packedRows))
+                    return fail();
+                packedRows = (long long)n;
+                packed[i] = 1;
+            }
+
+            if (enc == "DICT") {
+                vector<string> values(n);
+                for (auto& v : values)
+                    if (!getline(in, v))
+                        return fail();
+                cols.back().setDictionary(std::move(values));
+                coded[i] = 1;
+            }
+        }
+        cols_ = std::move(cols);
+        blooms_.assign(cols_.size(), nullopt);
+
+        bool more = getline(in, line);
+        if (more && line.rfind("DELETED ", 0) == 0) {
+            size_t count = 0, blocks = 0;
+            string bitmap;
+            if (!(stringstream(line.substr(8)) >> count >> blocks) || !getline(in, bitmap) || !dead_.decode(blocks, bitmap))
+                return fail();
+            more = getline(in, line);
+        }
+
+        int textCols = 0;
+        for (int j = 0; j < c; ++j)
+            textCols += !packed[j];
+
+        if (textCols == 0) { // only packed columns, no row lines
+            rowCount_ = (int)max(0LL, packedRows);
+            dead_.truncate(rowCount_);
+            loadDeletes();
+            loadAlters();
+            if (stats_.load(statsPath(), schema_.types))
+                stats_.setRows(liveRows());
+            loadBlooms();
+            loadView();
+            loadPartitions();
+            return;
         }
-        while (getline(in, line))  // load rows
+
+        vector<string_view> fields;
+        for (; more; more = getline(in, line))  // load rows
         {
             if (line.empty())
                 continue;
 
-            vector<string> fields;
-            string cur;
+            fields.clear();
+            string_view rest(line);
+            while (true) {
+                size_t comma = rest.find(',');
+                fields.push_back(rest.substr(0, comma));
+                if (comma == string_view::npos)
+                    break;
+                rest.remove_prefix(comma + 1);
+            }
 
-            for (char ch : line) {
-                if (ch == ',')
-                {
-                    fields.push_back(cur);
-                    cur.clear();
+            bool ok = (int)fields.size() >= 1 + textCols;
+            for (int j = 0, f = 1; j < c && ok; ++j) {
+                if (packed[j])
+                    continue;
+                long long code = 0;
+                if (coded[j])
+                    ok = parseInt64(fields[f], code) && code >= 0 && code < (long long)cols_[j].dictSize();
+                ++f;
+            }
+            if (!ok) {
+                if (packedRows >= 0)
+                    break;  // rows must stay aligned with the packed columns, keep the good prefix
+                continue;   // drop the broken row
+            }
+            for (int j = 0, f = 1; j < c; ++j) {
+                if (packed[j])
+                    continue;
+                if (coded[j]) {
+                    long long code = 0;
+                    parseInt64(fields[f], code);
+                    cols_[j].pushCode((uint32_t)code);
                 }
                 else
-                    cur.push_back(ch);
+                    cols_[j].push(fields[f]);
+                ++f;
             }
-            if (!cur.empty())
-                fields.push_back(cur);
-
-            if ((int)fields.size() >= 1 + c) {
-                vector<string> vals;
-                for (int j = 1; j <= c; ++j)
-                    vals.push_back(fields[j]);
+            ++rowCount_;
+        }
 
-                rows_.push_back(vals);
+        if (packedRows >= 0 && packedRows != rowCount_) {
+            // damaged file: keep the rows every column has
+            int keep = (int)min<long long>(packedRows, rowCount_);
+            vector<int> extra;
+            for (auto& col : cols_) {
+                extra.clear();
+                for (int r = keep; r < (int)col.size(); ++r)
+                    extra.push_back(r);
+                col.erase(extra);
             }
+            rowCount_ = keep;
         }
-    }
-
-    const vector<vector<string>>& rows() const
-    {
-        return rows_;
+        dead_.truncate(rowCount_);
+        loadDeletes();
+        loadAlters();
+
+        if (stats_.load(statsPath(), schema_.types))
+            stats_.setRows(liveRows());
+        loadBlooms();
+        loadView();
+        loadPartitions();
     }
 };
 
+// the table map is guarded by mu_ so several threads can look tables up at once,
+// access to the rows themselves is serialized by the caller (see Database)
 class Catalog {
     unordered_map<string, TableDynamic> tables_;
     string folder_ = "./db/";
+    mutable mutex mu_;
+
+    bool hasLocked(const string& key) const {
+        if (tables_.count(key))
+            return true;
+
+        string path = folder_ + key + ".txt";
+        return fs::exists(path); // check file exsist at folder
+    }
 
 public:
     Catalog() {
 
     }
 
+    const string& folder() const { return folder_; }
+
     void loadExisting(const string& folder = "./db/") {
         ensure_dir(folder);
     }
 
     bool has(const string& name) const {
         string key = toLower(trim(name));
+        lock_guard<mutex> lk(mu_);
 
-        if (tables_.count(key))
-            return true;
+        return hasLocked(key);
+    }
 
-        string path = folder_ + key + ".txt";
-        return fs::exists(path); // check file exsist at folder
+    bool isLoaded(const string& name) const {
+        string key = toLower(trim(name));
+        lock_guard<mutex> lk(mu_);
+
+        return tables_.count(key) > 0;
     }
 
     TableDynamic* get(const string& name) {
         string key = toLower(trim(name));
+        lock_guard<mutex> lk(mu_);
 
         auto it = tables_.find(key);
-        if (it != tables_.end())
+        if (it != tables_.end()) {
+            metrics::add(metrics::CatalogHits);
             return &it->second;
+        }
 
+        metrics::add(metrics::CatalogMisses);
         string path = folder_ + key + ".txt";
         if (fs::exists(path)) {
             TableDynamic t(key);
@@ -264,8 +1205,9 @@ public:
 
     bool create(const string& name, const TableSchema& schema) {
         string key = toLower(trim(name));
+        lock_guard<mutex> lk(mu_);
 
-        if (has(key))
+        if (hasLocked(key))
             return false;
         TableDynamic t(key);
 
@@ -277,7 +1219,14 @@ public:
     }
 
 
+    // forgets the loaded tables, the next get() reads them from disk again
+    void unloadAll() {
+        lock_guard<mutex> lk(mu_);
+        tables_.clear();
+    }
+
     vector<string> listTables() const {
+        lock_guard<mutex> lk(mu_);
         vector<string> r;
         for (auto& p : tables_) r.push_back(p.first);
         return r;
@@ -285,7 +1234,8 @@ public:
 
     void registerExisting(const string& name) {  // load specific file if dont exsist at ram
         string key = toLower(trim(name));
-        if (!has(key)) {
+        lock_guard<mutex> lk(mu_);
+        if (!hasLocked(key)) {
             TableDynamic t(key);
             t.load();
             tables_.emplace(key, std::move(t));
@@ -294,9 +1244,18 @@ public:
 
     bool drop(const string& name) {
         string key = toLower(trim(name));
+        lock_guard<mutex> lk(mu_);
 
         tables_.erase(key);
 
+        error_code ec;
+        fs::remove(folder_ + key + ".stats", ec);
+        fs::remove(folder_ + key + ".bloom", ec);
+        fs::remove(folder_ + key + ".view", ec);
+        fs::remove(folder_ + key + ".part", ec);
+        fs::remove(folder_ + key + ".alter", ec);
+        fs::remove(folder_ + key + ".del", ec);
+
         string path = folder_ + key + ".txt";
         if (fs::exists(path)) {
             fs::remove(path);
@@ -307,12 +1266,15 @@ public:
     }
 
     void registerExistingAll() {
+        lock_guard<mutex> lk(mu_);
         ensure_dir(folder_);
         for (auto& p : fs::directory_iterator(folder_)) { // loop all files at folder ("db/")
             if (p.path().extension() == ".txt") {
                 string name = p.path().stem().string(); // cut file without extention (user.txt -> user)
+                if (name.find('.') != string::npos)
+                    continue;   // a partition, loaded through its table
                 string key = toLower(name);
-                if (!has(key)) {
+                if (!hasLocked(key)) {
                     TableDynamic t(name);
                     t.load();
                     tables_.emplace(key, std::move(t));
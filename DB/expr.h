@@ -0,0 +1,313 @@
+#ifndef EXPR_H
+#define EXPR_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <climits>
+#include <cmath>
+#include <charconv>
+#include "utils.h"
+#include "value_type.h"
+using namespace std;
+
+// right-hand side of UPDATE ... SET col = expr.
+// INT / BIGINT / DOUBLE targets take + - * / and parentheses over INT, BIGINT
+// and DOUBLE columns and numeric literals, e.g. "salary * 1.1 + 100". Integer
+// operands keep integer math (checked for overflow, / truncates); a decimal
+// literal or a DOUBLE column makes that step floating point. An integer target
+// rounds the result when it is stored, a DOUBLE target keeps it.
+// Other targets take a single column or a literal. A plain integer literal
+// stays text, so INT values wider than 64 bits are stored as before. Other
+// fixed-width targets only take a valid literal or a column of the same type.
+class Expr {
+public:
+    enum class Op : uint8_t { Lit, Int, Real, Col, RealCol, Add, Sub, Mul, Div, Neg };
+    static constexpr int kMaxDepth = 32;
+    static constexpr int kMaxNest = 256;    // nested '-' and '(': bounds the parser's recursion
+
+private:
+    struct Step {
+        Op op;
+        int col = -1;
+        long long i = 0;
+        double d = 0;
+    };
+
+    // a value on the evaluation stack
+    struct Num {
+        long long i;
+        double d;
+        bool real;
+        double asReal() const { return real ? d : (double)i; }
+    };
+
+    vector<Step> code_;     // postfix
+    string text_;           // as written, for EXPLAIN
+    string lit_;            // Op::Lit payload
+    bool real_ = false;     // DOUBLE target, evalReal() computes it
+
+    // recursive descent over the raw text: sum := term {(+|-) term}, term := unary {(*|/) unary}
+    struct Parser {
+        string_view s;
+        size_t at = 0;
+        const vector<string>& names;
+        const vector<string>& types;
+        vector<Step>& out;
+        string err;
+        int depth = 0, maxDepth = 0;
+        int nest = 0;
+
+        void skip() { while (at < s.size() && isspace((unsigned char)s[at])) ++at; }
+        bool eat(char c) { skip(); if (at < s.size() && s[at] == c) { ++at; return true; } return false; }
+        bool enter() {
+            if (++nest <= kMaxNest) return true;
+            err = "expression too complex";
+            return false;
+        }
+        void push(Step st, int delta) {
+            out.push_back(st);
+            depth += delta;
+            maxDepth = max(maxDepth, depth);
+        }
+
+        bool sum() {
+            if (!term()) return false;
+            for (;;) {
+                if (eat('+')) { if (!term()) return false; push({ Op::Add }, -1); }
+                else if (eat('-')) { if (!term()) return false; push({ Op::Sub }, -1); }
+                else return true;
+            }
+        }
+        bool term() {
+            if (!unary()) return false;
+            for (;;) {
+                if (eat('*')) { if (!unary()) return false; push({ Op::Mul }, -1); }
+                else if (eat('/')) { if (!unary()) return false; push({ Op::Div }, -1); }
+                else return true;
+            }
+        }
+        bool unary() {
+            if (eat('-')) {
+                if (!enter() || !unary()) return false;
+                push({ Op::Neg }, 0);
+                --nest;
+                return true;
+            }
+            return primary();
+        }
+        bool primary() {
+            skip();
+            if (eat('(')) {
+                if (!enter() || !sum()) return false;
+                if (!eat(')')) { err = "missing )"; return false; }
+                --nest;
+                return true;
+            }
+            size_t b = at;
+            while (at < s.size() && (isalnum((unsigned char)s[at]) || s[at] == '_' || s[at] == '.'))
+                ++at;
+            string_view w = s.substr(b, at - b);
+            if (w.empty()) {
+                err = at < s.size() ? "unexpected '" + string(1, s[at]) + "'" : "missing operand";
+                return false;
+            }
+            if (isdigit((unsigned char)w[0]) || w[0] == '.') {
+                Step st{ Op::Int };
+                auto r = from_chars(w.data(), w.data() + w.size(), st.i);
+                if (r.ec != errc() || r.ptr != w.data() + w.size()) {
+                    st.op = Op::Real;
+                    auto rd = from_chars(w.data(), w.data() + w.size(), st.d);
+                    if (rd.ec != errc() || rd.ptr != w.data() + w.size()) {
+                        err = "bad number " + string(w);
+                        return false;
+                    }
+                }
+                push(st, 1);
+                return true;
+            }
+            for (int c = 0; c < (int)names.size(); ++c) {
+                if (!iequals(names[c], w))
+                    continue;
+                ValueType t = valueTypeOf(types[c]);
+                if (!isIntegral(t) && t != ValueType::Double) {
+                    err = "type mismatch";
+                    return false;
+                }
+                Step st{ t == ValueType::Double ? Op::RealCol : Op::Col };
+                st.col = c;
+                push(st, 1);
+                return true;
+            }
+            err = "unknown column " + string(w);
+            return false;
+        }
+    };
+
+    static bool addOk(long long a, long long b) { return b > 0 ? a <= LLONG_MAX - b : a >= LLONG_MIN - b; }
+    static bool subOk(long long a, long long b) { return b < 0 ? a <= LLONG_MAX + b : a >= LLONG_MIN + b; }
+    static bool mulOk(long long a, long long b) {
+        if (a > 0)
+            return b > 0 ? a <= LLONG_MAX / b : b >= LLONG_MIN / a;
+        if (b > 0)
+            return a >= LLONG_MIN / b;
+        return a == 0 || b >= LLONG_MAX / a;
+    }
+
+public:
+    // compiles text for a target of type targetType; on failure err says why
+    bool compile(string_view text, const vector<string>& names, const vector<string>& types,
+        const string& targetType, string& err)
+    {
+        code_.clear();
+        text = trimView(text);
+        text_ = string(text);
+
+        ValueType target = valueTypeOf(targetType);
+        real_ = target == ValueType::Double;
+        long long key = 0;
+        bool copy = false;      // DOUBLE target: a DOUBLE column copied as is
+        for (int c = 0; c < (int)names.size() && real_; ++c)
+            copy |= iequals(names[c], text) && valueTypeOf(types[c]) == target;
+        bool arith = isIntegral(target) ? !isNumberString(text)
+            : real_ && !copy && !encodeValue(target, text, key);
+
+        if (!arith) {
+            Step st{ Op::Lit };
+            for (int c = 0; c < (int)names.size() && !isIntegral(target); ++c)
+                if (iequals(names[c], text)) {
+                    st.op = Op::Col;
+                    st.col = c;
+                }
+            if (st.op == Op::Col && isFixedWidth(target) && valueTypeOf(types[st.col]) != target) {
+                err = "type mismatch";
+                return false;
+            }
+            if (st.op == Op::Lit && target != ValueType::Int && isFixedWidth(target) && !encodeValue(target, text, key)) {
+                err = target == ValueType::BigInt ? "integer out of range" : "value '" + text_ + "' not " + typeName(target);
+                return false;
+            }
+            lit_ = text_;
+            code_.push_back(st);
+            return true;
+        }
+
+        Parser p{ text, 0, names, types, code_, {}, 0, 0, 0 };
+        if (!p.sum() || (p.skip(), p.at != text.size())) {
+            if (p.err.empty())
+                p.err = "unexpected '" + string(1, text[p.at]) + "'";
+            err = p.err;
+            return false;
+        }
+        if (p.maxDepth > kMaxDepth) {
+            err = "expression too complex";
+            return false;
+        }
+        return true;
+    }
+
+    const string& text() const { return text_; }
+
+    // the whole expression is a literal / one column copied as is
+    bool isLiteral() const { return code_.size() == 1 && code_[0].op == Op::Lit; }
+    const string& literal() const { return lit_; }
+    int copiedColumn() const { return code_.size() == 1 && code_[0].op == Op::Col ? code_[0].col : -1; }
+
+    // columns read by the expression
+    template <class F>
+    void forColumns(F&& f) const {
+        for (auto& st : code_)
+            if (st.op == Op::Col || st.op == Op::RealCol)
+                f(st.col);
+    }
+
+    // integer result for one row, col(c) gives the row's key of column c (the
+    // number for INT / BIGINT). false with err set on overflow or division by zero
+    template <class Get>
+    bool evalInt(Get&& col, long long& out, const char*& err) const
+    {
+        Num r{};
+        if (!run(col, r, err))
+            return false;
+        if (!r.real) {
+            out = r.i;
+            return true;
+        }
+        double d = round(r.d);
+        if (!(d >= -9.2233720368547758e18 && d < 9.2233720368547758e18)) {
+            err = "integer out of range";
+            return false;
+        }
+        out = (long long)d;
+        return true;
+    }
+
+    // DOUBLE result for one row, for a target compiled as DOUBLE (isReal())
+    template <class Get>
+    bool evalReal(Get&& col, double& out, const char*& err) const
+    {
+        Num r{};
+        if (!run(col, r, err))
+            return false;
+        out = r.asReal();
+        if (!isfinite(out)) {
+            err = "value out of range";
+            return false;
+        }
+        return true;
+    }
+
+    bool isReal() const { return real_; }
+
+private:
+    template <class Get>
+    bool run(Get&& col, Num& out, const char*& err) const
+    {
+        Num st[kMaxDepth];
+        int n = 0;
+        for (auto& s : code_) {
+            switch (s.op) {
+            case Op::Int:     st[n++] = { s.i, 0, false }; continue;
+            case Op::Real:    st[n++] = { 0, s.d, true }; continue;
+            case Op::Col:     st[n++] = { col(s.col), 0, false }; continue;
+            case Op::RealCol: st[n++] = { 0, keyDouble(col(s.col)), true }; continue;
+            case Op::Lit:     err = "not a number"; return false;
+            case Op::Neg:
+                if (st[n - 1].real)
+                    st[n - 1].d = -st[n - 1].d;
+                else if (st[n - 1].i == LLONG_MIN) { err = "integer out of range"; return false; }
+                else
+                    st[n - 1].i = -st[n - 1].i;
+                continue;
+            default:
+                break;
+            }
+
+            Num b = st[--n];
+            Num& a = st[n - 1];
+            if (a.real || b.real) {
+                double x = a.asReal(), y = b.asReal();
+                if (s.op == Op::Div && y == 0) { err = "division by zero"; return false; }
+                a.d = s.op == Op::Add ? x + y : s.op == Op::Sub ? x - y : s.op == Op::Mul ? x * y : x / y;
+                a.real = true;
+                continue;
+            }
+            long long x = a.i, y = b.i;
+            switch (s.op) {
+            case Op::Add: if (!addOk(x, y)) { err = "integer out of range"; return false; } a.i = x + y; break;
+            case Op::Sub: if (!subOk(x, y)) { err = "integer out of range"; return false; } a.i = x - y; break;
+            case Op::Mul: if (!mulOk(x, y)) { err = "integer out of range"; return false; } a.i = x * y; break;
+            default:
+                if (y == 0) { err = "division by zero"; return false; }
+                if (x == LLONG_MIN && y == -1) { err = "integer out of range"; return false; }
+                a.i = x / y;
+                break;
+            }
+        }
+        out = st[0];
+        return true;
+    }
+};
+
+#endif // EXPR_H
@@ -0,0 +1,484 @@
+#ifndef INT_COLUMN_H
+#define INT_COLUMN_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <bit>
+#include <ostream>
+#include <span>
+#include "utils.h"
+using namespace std;
+
+// INT column values, compressed in blocks of kBlock rows. Each full block picks
+// the smallest of three encodings:
+//   For   - frame of reference: min + (v - min) bit-packed at the width of max - min
+//   Delta - first value + bit-packed (difference to previous - smallest difference),
+//           a few bits per row for ids and other increasing sequences. Every
+//           kMark-th value is kept decoded so a random read sums at most kMark deltas
+//   Rle   - (value, run end) pairs, for sorted or low-variety data
+// The last, partly filled block stays as plain long longs until it fills up.
+class IntColumn {
+public:
+    static constexpr int kBlock = 1024;
+    static constexpr int kMark = 64;
+    enum Enc : uint8_t { For, Delta, Rle };
+
+    struct Block {
+        Enc enc = For;
+        uint8_t width = 0;          // bits per packed value
+        uint16_t n = 0;             // values in the block
+        long long ref = 0;          // For: min, Delta: first value
+        long long ref2 = 0;         // Delta: smallest difference
+        long long minV = 0, maxV = 0;   // zone map, kept current by set()
+        vector<uint64_t> bits;      // For / Delta payload
+        vector<long long> marks;    // Delta: value of every kMark-th row
+        vector<long long> runVals;  // Rle
+        vector<uint16_t> runEnds;   // Rle: exclusive end position of each run
+
+        size_t bytes() const
+        {
+            return sizeof(Block) + bits.size() * 8 + marks.size() * 8 + runVals.size() * 8 + runEnds.size() * 2;
+        }
+    };
+
+private:
+    vector<Block> blocks_;
+    vector<long long> tail_;
+
+    static uint8_t bitsFor(uint64_t range) { return (uint8_t)(64 - countl_zero(range)); }
+
+    static void pack(const uint64_t* v, size_t n, uint8_t w, vector<uint64_t>& out)
+    {
+        out.assign((n * w + 63) / 64, 0);
+        if (w == 0)
+            return;
+        for (size_t i = 0; i < n; ++i) {
+            size_t pos = i * w, word = pos >> 6, off = pos & 63;
+            out[word] |= v[i] << off;
+            if (off + w > 64)
+                out[word + 1] |= v[i] >> (64 - off);
+        }
+    }
+
+    static uint64_t unpackOne(const vector<uint64_t>& bits, uint8_t w, size_t i)
+    {
+        if (w == 0)
+            return 0;
+        size_t pos = i * w, word = pos >> 6, off = pos & 63;
+        uint64_t v = bits[word] >> off;
+        if (off + w > 64)
+            v |= bits[word + 1] << (64 - off);
+        return w == 64 ? v : v & ((1ull << w) - 1);
+    }
+
+    // decode kernel: one pass over the packed words, out[i] = base + packed[i]
+    static void unpack(const vector<uint64_t>& bits, uint8_t w, size_t n, long long base, long long* out)
+    {
+        if (w == 0) {
+            fill(out, out + n, base);
+            return;
+        }
+        uint64_t mask = w == 64 ? ~0ull : (1ull << w) - 1;
+        const uint64_t* p = bits.data();
+        size_t pos = 0;
+        for (size_t i = 0; i < n; ++i, pos += w) {
+            size_t word = pos >> 6, off = pos & 63;
+            uint64_t v = p[word] >> off;
+            if (off + w > 64)
+                v |= p[word + 1] << (64 - off);
+            out[i] = (long long)((uint64_t)base + (v & mask));
+        }
+    }
+
+    static Block encode(const long long* v, size_t n)
+    {
+        Block b;
+        b.n = (uint16_t)n;
+        b.minV = *min_element(v, v + n);
+        b.maxV = *max_element(v, v + n);
+
+        size_t runs = 1;
+        for (size_t i = 1; i < n; ++i)
+            if (v[i] != v[i - 1])
+                ++runs;
+
+        long long dmin = 0, dmax = 0;
+        for (size_t i = 1; i < n; ++i) {
+            long long d = (long long)((uint64_t)v[i] - (uint64_t)v[i - 1]);
+            if (i == 1 || d < dmin) dmin = d;
+            if (i == 1 || d > dmax) dmax = d;
+        }
+
+        uint8_t forW = bitsFor((uint64_t)b.maxV - (uint64_t)b.minV);
+        uint8_t deltaW = n > 1 ? bitsFor((uint64_t)dmax - (uint64_t)dmin) : 0;
+        size_t forBits = n * forW, deltaBits = (n - 1) * deltaW + 64, rleBits = runs * 80;
+
+        vector<uint64_t> tmp(n);
+        if (rleBits < forBits && rleBits < deltaBits) {
+            b.enc = Rle;
+            for (size_t i = 0; i < n; ++i) {
+                if (i > 0 && v[i] != v[i - 1])
+                    b.runEnds.push_back((uint16_t)i);
+                if (i == 0 || v[i] != v[i - 1])
+                    b.runVals.push_back(v[i]);
+            }
+            b.runEnds.push_back((uint16_t)n);
+        }
+        else if (deltaBits < forBits) {
+            b.enc = Delta;
+            b.ref = v[0];
+            b.ref2 = dmin;
+            b.width = deltaW;
+            for (size_t i = 1; i < n; ++i)
+                tmp[i - 1] = (uint64_t)v[i] - (uint64_t)v[i - 1] - (uint64_t)dmin;
+            pack(tmp.data(), n - 1, deltaW, b.bits);
+            for (size_t i = 0; i < n; i += kMark)
+                b.marks.push_back(v[i]);
+        }
+        else {
+            b.enc = For;
+            b.ref = b.minV;
+            b.width = forW;
+            for (size_t i = 0; i < n; ++i)
+                tmp[i] = (uint64_t)v[i] - (uint64_t)b.minV;
+            pack(tmp.data(), n, forW, b.bits);
+        }
+        return b;
+    }
+
+    static void decode(const Block& b, long long* out)
+    {
+        switch (b.enc) {
+        case For:
+            unpack(b.bits, b.width, b.n, b.ref, out);
+            break;
+        case Delta:
+            out[0] = b.ref;
+            unpack(b.bits, b.width, b.n - 1u, b.ref2, out + 1);
+            for (size_t i = 1; i < b.n; ++i)   // prefix sum turns differences back into values
+                out[i] = (long long)((uint64_t)out[i] + (uint64_t)out[i - 1]);
+            break;
+        case Rle: {
+            size_t i = 0;
+            for (size_t r = 0; r < b.runVals.size(); ++r)
+                for (; i < b.runEnds[r]; ++i)
+                    out[i] = b.runVals[r];
+            break;
+        }
+        }
+    }
+
+    static long long valueAt(const Block& b, size_t i)
+    {
+        switch (b.enc) {
+        case For:
+            return (long long)((uint64_t)b.ref + unpackOne(b.bits, b.width, i));
+        case Delta: {
+            uint64_t v = (uint64_t)b.marks[i / kMark];
+            for (size_t k = i / kMark * kMark; k < i; ++k)
+                v += (uint64_t)b.ref2 + unpackOne(b.bits, b.width, k);
+            return (long long)v;
+        }
+        case Rle: {
+            size_t r = upper_bound(b.runEnds.begin(), b.runEnds.end(), (uint16_t)i) - b.runEnds.begin();
+            return b.runVals[r];
+        }
+        }
+        return 0;
+    }
+
+    void rebuild(const vector<long long>& all)
+    {
+        blocks_.clear();
+        tail_.clear();
+        size_t full = all.size() / kBlock * kBlock;
+        for (size_t i = 0; i < full; i += kBlock)
+            blocks_.push_back(encode(all.data() + i, kBlock));
+        tail_.assign(all.begin() + full, all.end());
+    }
+
+    static string packedText(const Block& b)
+    {
+        return b.bits.empty() ? string("-") : base64Encode(b.bits.data(), b.bits.size() * 8);
+    }
+
+public:
+    size_t size() const { return blocks_.size() * kBlock + tail_.size(); }
+
+    // blocks including the unencoded tail
+    size_t blockCount() const { return blocks_.size() + (tail_.empty() ? 0 : 1); }
+    size_t blockRows(size_t b) const { return b < blocks_.size() ? blocks_[b].n : tail_.size(); }
+
+    long long get(size_t r) const
+    {
+        size_t b = r / kBlock;
+        if (b >= blocks_.size())
+            return tail_[r - blocks_.size() * kBlock];
+        return valueAt(blocks_[b], r % kBlock);
+    }
+
+    // zone map of block b: its smallest and largest value (the tail is scanned)
+    void zone(size_t b, long long& lo, long long& hi) const
+    {
+        if (b < blocks_.size()) {
+            lo = blocks_[b].minV;
+            hi = blocks_[b].maxV;
+            return;
+        }
+        auto mm = minmax_element(tail_.begin(), tail_.end());
+        lo = tail_.empty() ? 0 : *mm.first;
+        hi = tail_.empty() ? 0 : *mm.second;
+    }
+
+    // out must have room for kBlock values
+    void decodeBlock(size_t b, long long* out) const
+    {
+        if (b >= blocks_.size())
+            copy(tail_.begin(), tail_.end(), out);
+        else
+            decode(blocks_[b], out);
+    }
+
+    void push(long long v)
+    {
+        tail_.push_back(v);
+        if (tail_.size() == (size_t)kBlock) {
+            blocks_.push_back(encode(tail_.data(), kBlock));
+            tail_.clear();
+        }
+    }
+
+    // n copies of v: the full blocks are encoded once (frame of reference at
+    // width 0, no payload) and copied, so it costs blocks, not rows
+    void pushRepeat(long long v, size_t n)
+    {
+        for (; n > 0 && !tail_.empty(); --n)
+            push(v);
+        if (n >= (size_t)kBlock) {
+            long long buf[kBlock];
+            fill(buf, buf + kBlock, v);
+            blocks_.insert(blocks_.end(), n / kBlock, encode(buf, kBlock));
+            n %= kBlock;
+        }
+        tail_.insert(tail_.end(), n, v);
+    }
+
+    void reserve(size_t n)
+    {
+        if (blocks_.capacity() < n / kBlock + 1)
+            blocks_.reserve(max(n / kBlock + 1, blocks_.capacity() * 2));
+    }
+
+    void set(size_t r, long long v)
+    {
+        size_t b = r / kBlock;
+        if (b >= blocks_.size()) {
+            tail_[r - blocks_.size() * kBlock] = v;
+            return;
+        }
+        long long buf[kBlock];
+        decode(blocks_[b], buf);
+        buf[r % kBlock] = v;
+        blocks_[b] = encode(buf, blocks_[b].n);
+    }
+
+    // sets rows[i] = vals[i] for ascending rows. Each touched block is decoded
+    // once and re-encoded only if one of its values actually changed.
+    // changed[i] is set for the rows whose value differed, returns their count
+    size_t setMany(span<const int> rows, span<const long long> vals, span<char> changed)
+    {
+        size_t n = 0;
+        long long buf[kBlock];
+        for (size_t i = 0; i < rows.size();) {
+            size_t b = rows[i] / kBlock;
+            bool tail = b >= blocks_.size();
+            long long* p = tail ? tail_.data() : buf;
+            if (!tail)
+                decode(blocks_[b], buf);
+            bool dirty = false;
+            for (; i < rows.size() && rows[i] / kBlock == (int)b; ++i) {
+                long long& v = p[rows[i] % kBlock];
+                if (v != vals[i]) {
+                    v = vals[i];
+                    changed[i] = 1;
+                    dirty = true;
+                    ++n;
+                }
+            }
+            if (dirty && !tail)
+                blocks_[b] = encode(buf, blocks_[b].n);
+        }
+        return n;
+    }
+
+    vector<long long> all() const
+    {
+        vector<long long> v(size());
+        long long* p = v.data();
+        for (size_t b = 0; b < blocks_.size(); ++b, p += kBlock)
+            decode(blocks_[b], p);
+        copy(tail_.begin(), tail_.end(), p);
+        return v;
+    }
+
+    // removes the rows at the given ascending positions
+    void erase(span<const int> ids)
+    {
+        vector<long long> v = all();
+        size_t w = 0, k = 0;
+        for (size_t r = 0; r < v.size(); ++r) {
+            if (k < ids.size() && ids[k] == (int)r) {
+                ++k;
+                continue;
+            }
+            v[w++] = v[r];
+        }
+        v.resize(w);
+        rebuild(v);
+    }
+
+    void clear()
+    {
+        blocks_.clear();
+        tail_.clear();
+    }
+
+    size_t memoryBytes() const
+    {
+        size_t n = tail_.capacity() * sizeof(long long);
+        for (auto& b : blocks_)
+            n += b.bytes();
+        return n;
+    }
+
+    // bits a scan reads per value of row r
+    size_t bitsAt(size_t r) const
+    {
+        size_t b = r / kBlock;
+        if (b >= blocks_.size())
+            return 64;
+        const Block& bl = blocks_[b];
+        return bl.enc == Rle ? (bl.runVals.size() * 80 + bl.n - 1) / bl.n : bl.width;
+    }
+
+    // "for 10, delta 2, rle 1, tail 17"
+    string describe() const
+    {
+        size_t count[3] = {};
+        for (auto& b : blocks_)
+            ++count[b.enc];
+        return "for " + to_string(count[For]) + ", delta " + to_string(count[Delta])
+            + ", rle " + to_string(count[Rle]) + ", tail " + to_string(tail_.size());
+    }
+
+    // one line per block in the table file:
+    //   F n width min <base64>  |  D n width first mindiff <base64>  |  R n runs v:end ...  |  T n v v ...
+    // (width 0 has no packed words, its base64 is written as "-")
+    void write(ostream& out) const
+    {
+        for (auto& b : blocks_) {
+            if (b.enc == For)
+                out << "F " << b.n << " " << (int)b.width << " " << b.ref << " " << packedText(b);
+            else if (b.enc == Delta)
+                out << "D " << b.n << " " << (int)b.width << " " << b.ref << " " << b.ref2 << " " << packedText(b);
+            else {
+                out << "R " << b.n << " " << b.runVals.size();
+                for (size_t r = 0; r < b.runVals.size(); ++r)
+                    out << " " << b.runVals[r] << ":" << b.runEnds[r];
+            }
+            out << "\n";
+        }
+        if (!tail_.empty()) {
+            out << "T " << tail_.size();
+            for (long long v : tail_)
+                out << " " << v;
+            out << "\n";
+        }
+    }
+
+    size_t lineCount() const { return blockCount(); }
+
+    // parses one line written by write(), false if it is malformed
+    bool readLine(string_view line)
+    {
+        vector<string_view> t;
+        size_t start = 0;
+        while (start < line.size()) {
+            size_t sp = line.find(' ', start);
+            if (sp == string_view::npos)
+                sp = line.size();
+            if (sp > start)
+                t.push_back(line.substr(start, sp - start));
+            start = sp + 1;
+        }
+        if (t.size() < 2)
+            return false;
+
+        long long n = 0;
+        if (!parseInt64(t[1], n) || n <= 0 || n > kBlock)
+            return false;
+
+        if (t[0] == "T") {
+            if ((long long)t.size() != 2 + n)
+                return false;
+            for (long long i = 0; i < n; ++i) {
+                long long v = 0;
+                if (!parseInt64(t[2 + i], v))
+                    return false;
+                tail_.push_back(v);
+            }
+            return true;
+        }
+
+        if (!tail_.empty() || n != kBlock)
+            return false;   // only the last line may be a partial block
+
+        vector<long long> v((size_t)n);
+        if (t[0] == "R") {
+            long long runs = 0;
+            if (t.size() < 3 || !parseInt64(t[2], runs) || (long long)t.size() != 3 + runs)
+                return false;
+            size_t i = 0;
+            for (long long r = 0; r < runs; ++r) {
+                string_view tok = t[3 + r];
+                size_t colon = tok.find(':');
+                long long val = 0, end = 0;
+                if (colon == string_view::npos || !parseInt64(tok.substr(0, colon), val)
+                    || !parseInt64(tok.substr(colon + 1), end) || end <= (long long)i || end > n)
+                    return false;
+                for (; (long long)i < end; ++i)
+                    v[i] = val;
+            }
+            if ((long long)i != n)
+                return false;
+        }
+        else {
+            bool delta = t[0] == "D";
+            if ((!delta && t[0] != "F") || t.size() != (delta ? 6u : 5u))
+                return false;
+            Block b;
+            long long w = 0;
+            if (!parseInt64(t[2], w) || w < 0 || w > 64 || !parseInt64(t[3], b.ref))
+                return false;
+            if (delta && !parseInt64(t[4], b.ref2))
+                return false;
+            b.enc = delta ? Delta : For;
+            b.width = (uint8_t)w;
+            b.n = (uint16_t)n;
+            size_t packed = delta ? (size_t)n - 1 : (size_t)n;
+            b.bits.assign((packed * w + 63) / 64, 0);
+            string_view text = t[delta ? 5 : 4];
+            if (b.bits.empty() ? text != "-" : !base64Decode(text, b.bits.data(), b.bits.size() * 8))
+                return false;
+            decode(b, v.data());
+        }
+        // re-encode instead of trusting the stored min/max
+        blocks_.push_back(encode(v.data(), v.size()));
+        return true;
+    }
+};
+
+#endif // INT_COLUMN_H
@@ -1,309 +1,86 @@
 #include <iostream>
+#include <fstream>
 #include <vector>
-#include <functional>
 #include "utils.h"
 #include "parser.h"
-#include "db.h"
+#include "database.h"
+#include "output.h"
+#include "server.h"
+#include "coordinator.h"
 
 using namespace std;
 
-static Catalog CATALOG;
+static Database DB;
 
 
-TableSchema schemaFromCreateCols(const vector<string>& cols) {
-    TableSchema s;
-    for (int i = 0; i < cols.size(); i++) {
-        string ct = cols[i];
-        size_t pos = ct.find(':');
-
-        if (pos == string::npos) {
-            s.names.push_back(toLower(trim(ct)));
-            s.types.push_back("STRING");
-        }
-        else {
-            string n = toLower(trim(ct.substr(0, pos)));
-            string tp = toUpper(trim(ct.substr(pos + 1)));
-
-            if (tp != "INT" && tp != "STRING")
-                tp = "STRING";
-
-            s.names.push_back(n);
-            s.types.push_back(tp);
-        }
-    }
-    return s;
+static bool stdinIsTerminal() {
+#ifdef _WIN32
+    return _isatty(_fileno(stdin)) != 0;
+#else
+    return isatty(fileno(stdin)) != 0;
+#endif
 }
 
-
-bool validateInsert(const TableSchema& schema,vector<string>& vals, string& err) {
-    if (schema.names.size() != vals.size()) {
-        err = "column count mismatch";
-        return false;
-    }
-    for (int i = 0; i < vals.size(); i++) {
-        if (schema.types[i] == "INT" && !isNumberString(vals[i])) {
-            err = "value '" + vals[i] + "' not INT for column " + schema.names[i];
-            return false;
-        }
-    }
-    return true;
-}
-
-
-bool checkWhere(const vector<string>& row, int colIdx,string& op,string& val) {
-
-    if (colIdx < 0 || colIdx >= (int)row.size())
-        return false;
-
-    string cell = row[colIdx];
-    bool cellNum = isNumberString(cell);
-    bool valNum = isNumberString(val);
-
-    if (cellNum && valNum) {
-        long long a = stoll(cell);
-        long long b = stoll(val);
-        if (op == "=") return a == b;
-        if (op == "!=") return a != b;
-        if (op == ">") return a > b;
-        if (op == "<=") return a <= b;
-        if (op == ">=") return a >= b;
-    }
-    else {
-        if (op == "=") return cell == val;
-    }
-    return false;
+static void usage() {
+    cerr << "usage: db [-f script.sql] [--format table|csv|tsv]\n"
+        << "       db --serve ADDR [--threads N] [--format table|csv|tsv]\n"
+        << "       db --connect ADDR [--pipeline N]\n"
+        << "  --replicate RADDR (with --serve) streams every change to followers connecting on RADDR\n"
+        << "  --follow RADDR (with --serve) serves read-only from this directory, replaying the\n"
+        << "    primary's changes received on RADDR (run it in a directory of its own)\n"
+        << "  --shards ADDR1,ADDR2,... (with --serve) coordinates: tables are hash-sharded over the\n"
+        << "    engines serving on those addresses, this process keeps only the shard keys\n"
+        << "  --stats-file PATH writes the engine metrics (JSON) on SHOW STATS and at exit\n"
+        << "  --result-cache MB caches SELECT results in up to MB of memory (default off)\n"
+        << "  --io uring|threads selects how table files are read and written (default uring,\n"
+        << "    threads where io_uring is not available)\n"
+        << "  without -f, statements are read from stdin (prompt only on a terminal)\n"
+        << "  ADDR is a unix socket path or a TCP port on 127.0.0.1\n";
 }
 
+// one statement per line, no prompt, output goes through one large buffer
+static int runBatch(istream& in, OutputFormat fmt) {
+    ResultWriter out(stdout, fmt);
+    string line;
+    long long lineNo = 0;
 
-void executeParse(const Parse& p) {
-    string cmd = p.cmd();
-
-    if (cmd == "CREATE") {
-       
-        string tname = p.table();
-
-        if (CATALOG.has(tname))//
-        {
-            cout << "Error: table already exists\n";
-            return;
-        }
-
-        TableSchema s = schemaFromCreateCols(p.columns());
-
-        if (s.names.empty()) 
-        {
-            cout << "CREATE: no columns\n";
-            return; 
-        }
-
-        bool ok = CATALOG.create(tname, s);
-
-        cout << (ok ? "[OK] Created " + tname : "Failed to create") << "\n";
-        return;
-    }
-
-
-    if (cmd == "INSERT") {
-        string tname = p.table();
-        if (!CATALOG.has(tname))
-        { 
-            cout << "INSERT: table not found\n"; 
-            return;
-        }
-
-        TableDynamic* t = CATALOG.get(tname);
-        vector<string> vals = p.values();
-        string err;
-
-        if (!validateInsert(t->schema(), vals, err)) {
-            cout << "INSERT validation: " << err << "\n";
-            return;
-        }
-
-        t->insertRow(vals);
-        cout << "[OK] Inserted into " << tname << "\n";
-        return;
-    }
-
-
-    if (cmd == "SELECT") {
-        string tname = p.table();
-        if (!CATALOG.has(tname)) 
-        { 
-            cout << "SELECT: table not found\n";
-            return; 
-        }
-
-        TableDynamic* t = CATALOG.get(tname);
-        t->load();
-
-        vector<string> sel = p.columns();
-        vector<int> selIdx;
-
-        //*
-        if (sel.size() == 1 && sel[0] == "*") {
-            for (int i = 0; i < (int)t->schema().names.size(); i++)
-                selIdx.push_back(i);
-        }
-        else {// col name
-            for (int i = 0; i < (int)sel.size(); i++) {
-                int idx = t->columnIndex(sel[i]);
-                if (idx < 0) { cout << "SELECT: unknown column " << sel[i] << "\n"; return; }
-                selIdx.push_back(idx);
-            }
-        }
-
-        //where 
-        int whereIdx = -1;
-        string whereVal, whereOp;
-        if (!p.whereCol().empty()) {
-            whereIdx = t->columnIndex(p.whereCol());
-            if (whereIdx < 0)
-            { 
-                cout << "SELECT: unknown WHERE column\n";
-                return;
-            }
-            whereVal = p.whereVal();
-            whereOp = p.whereOp();
-        }
-
-        //print col name
-        for (int i = 0; i < (int)selIdx.size(); i++)
-            cout << t->schema().names[selIdx[i]] << "\t";
-        cout << "\n--------------------------------\n";
-
-        //print data
-        for (int r = 0; r < t->rowCount(); r++) {
-            const vector<string>& row = t->getRow(r);
-
-            if (whereIdx != -1 && !checkWhere(row, whereIdx, whereOp, whereVal))
-                continue;
+    while (getline(in, line)) {
+        ++lineNo;
+        string_view sql = trimView(line);
 
-            for (int i = 0; i < (int)selIdx.size(); i++)
-                cout << row[selIdx[i]] << "\t";
-
-            cout << "\n";
-        }
-        return;
-    }
-
-
-    if (cmd == "UPDATE") {
-        string tname = p.table();
-        if (!CATALOG.has(tname)) 
-        { 
-            cout << "UPDATE: table not found\n";
-            return;
-        }
-
-        TableDynamic* t = CATALOG.get(tname);
-        t->load();
-
-
-        string setCol = p.setCol();
-        string setVal = p.setVal();
-        int targetIdx = t->columnIndex(setCol);
-
-        if (targetIdx < 0)
-        { 
-            cout << "UPDATE: unknown column\n"; return;
-        }
+        if (sql.empty() || sql.substr(0, 2) == "--") // blank line or comment
+            continue;
 
-        if (t->schema().types[targetIdx] == "INT" && !isNumberString(setVal)) {
-            cout << "UPDATE: type mismatch\n"; 
-            return;
-        }
+        if (iequals(sql, "EXIT"))
+            break;
 
-        int whereIdx = -1;
-        string whereVal, whereOp;
-        if (!p.whereCol().empty()) {
-            whereIdx = t->columnIndex(p.whereCol());
-            if (whereIdx < 0)
-            {
-                cout << "UPDATE: unknown WHERE col\n"; return;
-            }
-            whereVal = p.whereVal();
-            whereOp = p.whereOp();
+        Statement p;
+        if (!Parse::parseStatement(sql, p)) {
+            out.flush();
+            cerr << "line " << lineNo << ": Invalid query or unsupported format\n";
+            continue;
         }
 
-        int changed = 0;
-        for (int r = 0; r < t->rowCount(); r++)
-        {
-            vector<string> row = t->getRow(r);
-            if (whereIdx == -1 || checkWhere(row, whereIdx, whereOp, whereVal)) {
-                row[targetIdx] = setVal;
-                t->getRow(r) = row;
-                changed++;
+        try {
+            ResultSet rs = DB.execute(p);
+            if (!rs.ok() && fmt != OutputFormat::Table) {
+                out.flush();
+                cerr << "line " << lineNo << ": " << rs.message() << "\n";
             }
+            out.write(rs);
         }
-
-        if (changed > 0) t->save();
-
-        cout << "[OK] UPDATE changed: " << changed << "\n";
-        return;
-    }
-
-
-    if (cmd == "DELETE") {
-        string tname = p.table();
-        if (!CATALOG.has(tname)) 
+        catch (const exception& ex)
         {
-            cout << "DELETE: table not found\n"; 
-            return;
-        }
-
-        TableDynamic* t = CATALOG.get(tname);
-        t->load();
-
-        int whereIdx = -1;
-        string whereVal, whereOp;
-        if (!p.whereCol().empty()) {
-            whereIdx = t->columnIndex(p.whereCol());
-            if (whereIdx < 0) 
-            {
-                cout << "DELETE: unknown WHERE col\n";
-                return;
-            }
-            whereVal = p.whereVal();
-            whereOp = p.whereOp();
-        }
-
-        int removed = 0;
-
-        for (int r = t->rowCount() - 1; r >= 0; r--) {
-            vector<string> row = t->getRow(r);
-            if (whereIdx == -1 || checkWhere(row, whereIdx, whereOp, whereVal)) {
-                t->deleteRows(row);
-                removed++;
-            }
-        }
-
-        if (removed > 0) t->save();
-
-        cout << "[OK] DELETE removed: " << removed << "\n";
-        return;
-    }
-    if (cmd == "DROP") {
-        if (!p.valid()) {
-            cout << "DROP: syntax error\n";
-            return;
+            out.flush();
+            cerr << "line " << lineNo << ": Error: " << ex.what() << "\n";
         }
-
-        if (CATALOG.drop(p.table())) {
-            cout << "Table '" << p.table() << "' dropped successfully.\n";
-        }
-        else {
-            cout << "DROP: table '" << p.table() << "' not found or already dropped.\n";
-        }
-        return;
     }
-
-
-
-    cout << "Unsupported command: " << cmd << "\n";
+    return 0;
 }
 
-int main() {
+static int runInteractive(OutputFormat fmt) {
+    ResultWriter out(stdout, fmt);
+
     cout << "Mini Dynamic DB Engine\n"
         << "--------------------------------------------------------\n"
         << "  CREATE TABLE t (name STRING, age INT)\n"
@@ -312,25 +89,27 @@ int main() {
         << "  UPDATE t SET age = 30 WHERE name = Ali\n"
         << "  DELETE FROM t WHERE age < 18\n"
         << "  DROP TABLE t\n"
+        << "  ALTER TABLE t ADD COLUMN score INT DEFAULT 0 / DROP COLUMN score\n"
+        << "  CREATE TABLE e (id INT, d DATE) PARTITION BY RANGE (d) (p1 VALUES LESS THAN (2025-01-01), p2 VALUES LESS THAN MAXVALUE)\n"
+        << "  BEGIN / COMMIT / ROLLBACK\n"
+        << "  SHOW STATS\n"
         << "  EXIT to exit from program\n"
         << "--------------------------------------------------------";
 
     while (true) {
         cout << "\nSQL> ";
         string line;
-        if (!getline(cin, line)) 
+        if (!getline(cin, line))
             break;
 
         if (line.empty())
             continue;
 
-        string up = toUpper(line);
-        if (up == "EXIT")
+        if (iequals(trimView(line), "EXIT"))
             break;
 
-        Parse p;
-        p.parse(line);
-        if (!p.valid()) {
+        Statement p;
+        if (!Parse::parseStatement(line, p)) {
             std::cout << "Invalid query or unsupported format. Examples:\n"
                 << "  CREATE TABLE t (name STRING, age INT)\n"
                 << "  INSERT INTO t VALUES (Ali,25)\n"
@@ -338,16 +117,177 @@ int main() {
                 << "  UPDATE t SET age = 30 WHERE name = Ali\n"
                 << "  DELETE FROM t WHERE age < 18\n"
                 << "  DROP TABLE t\n";
-            
+
             continue;
         }
-        try { executeParse(p); }
-        catch (const exception& ex) 
-        { 
-            cout << "Error: " << ex.what() << "\n";
+        cout.flush();
+        try { out.write(DB.execute(p)); }
+        catch (const exception& ex)
+        {
+            out.raw(string("Error: ") + ex.what() + "\n");
         }
+        out.flush();
     }
 
     cout << "Bye\n";
     return 0;
 }
+
+int main(int argc, char** argv) {
+    string script, serveAddr, connectAddr, statsFile, replicateAddr, followAddr;
+    vector<string> shards;
+    OutputFormat fmt = OutputFormat::Table;
+    bool fmtGiven = false;
+    long long threads = 4;
+    long long pipeline = 64;
+    long long cacheMb = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        string_view a = argv[i];
+
+        if ((a == "-f" || a == "--file") && i + 1 < argc)
+            script = argv[++i];
+        else if ((a == "-F" || a == "--format") && i + 1 < argc) {
+            if (!ResultWriter::parseFormat(argv[++i], fmt)) {
+                usage();
+                return 2;
+            }
+            fmtGiven = true;
+        }
+        else if (a == "--serve" && i + 1 < argc)
+            serveAddr = argv[++i];
+        else if (a == "--connect" && i + 1 < argc)
+            connectAddr = argv[++i];
+        else if (a == "--replicate" && i + 1 < argc)
+            replicateAddr = argv[++i];
+        else if (a == "--follow" && i + 1 < argc)
+            followAddr = argv[++i];
+        else if (a == "--shards" && i + 1 < argc) {
+            string_view list = argv[++i];
+            for (size_t at = 0; at <= list.size(); ) {
+                size_t comma = min(list.find(',', at), list.size());
+                if (comma > at)
+                    shards.emplace_back(trimView(list.substr(at, comma - at)));
+                at = comma + 1;
+            }
+            if (shards.empty()) {
+                usage();
+                return 2;
+            }
+        }
+        else if (a == "--stats-file" && i + 1 < argc)
+            statsFile = argv[++i];
+        else if (a == "--result-cache" && i + 1 < argc) {
+            if (!parseInt64(argv[++i], cacheMb) || cacheMb < 0) {
+                usage();
+                return 2;
+            }
+        }
+        else if (a == "--io" && i + 1 < argc) {
+            string_view v = argv[++i];
+            if (v != "uring" && v != "threads") {
+                usage();
+                return 2;
+            }
+            aio::uringEnabled() = v == "uring";
+        }
+        else if (a == "--pipeline" && i + 1 < argc) {
+            if (!parseInt64(argv[++i], pipeline) || pipeline <= 0) {
+                usage();
+                return 2;
+            }
+        }
+        else if (a == "--threads" && i + 1 < argc) {
+            if (!parseInt64(argv[++i], threads) || threads <= 0) {
+                usage();
+                return 2;
+            }
+        }
+        else {
+            usage();
+            return 2;
+        }
+    }
+
+    DB.setStatsFile(statsFile);
+    DB.setResultCache((size_t)cacheMb << 20);
+
+    if ((!replicateAddr.empty() || !followAddr.empty()) && (serveAddr.empty() || (!replicateAddr.empty() && !followAddr.empty()))) {
+        usage();
+        return 2;
+    }
+
+    if (!shards.empty() && (serveAddr.empty() || !replicateAddr.empty() || !followAddr.empty())) {
+        usage();
+        return 2;
+    }
+
+    if (!serveAddr.empty()) {
+        ChangeLog changeLog;
+        ReplicationState repl;
+        unique_ptr<LogShipper> shipper;
+        unique_ptr<Replica> replica;
+
+        if (!replicateAddr.empty()) {
+            DB.setChangeLog(&changeLog, &repl);
+            shipper = make_unique<LogShipper>(DB, changeLog, repl, replicateAddr);
+            string err;
+            if (!shipper->start(err)) {
+                cerr << "replication: " << err << "\n";
+                return 1;
+            }
+            cerr << "shipping changes to followers on " << replicateAddr << "\n";
+        }
+        if (!followAddr.empty()) {
+            repl.peer = followAddr;
+            DB.setReplica(&repl);
+            replica = make_unique<Replica>(DB, repl);
+            replica->start();
+            cerr << "following the primary at " << followAddr << "\n";
+        }
+
+        ServerOptions opt;
+        opt.addr = serveAddr;
+        opt.threads = (size_t)threads;
+        opt.format = fmtGiven ? fmt : OutputFormat::Tsv;
+
+        Server server(DB, opt);
+        unique_ptr<Coordinator> coord;
+        if (!shards.empty()) {
+            coord = make_unique<Coordinator>(DB, shards);
+            server.setCoordinator(coord.get());
+            cerr << "coordinating " << shards.size() << " shard(s)\n";
+        }
+        string err;
+        cerr << "serving on " << serveAddr << " with " << threads << " worker(s)\n";
+        if (!server.run(err)) {
+            cerr << "server: " << err << "\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    if (!connectAddr.empty())
+        return runClient(connectAddr, (size_t)pipeline);
+
+    int rc;
+    if (!script.empty()) {
+        ifstream in(script);
+        if (!in.is_open()) {
+            cerr << "cannot open " << script << "\n";
+            return 1;
+        }
+        rc = runBatch(in, fmt);
+    }
+    else if (!stdinIsTerminal()) {
+        ios::sync_with_stdio(false);
+        rc = runBatch(cin, fmt);
+    }
+    else
+        rc = runInteractive(fmt);
+
+    string err;
+    if (!DB.dumpStats(err))
+        cerr << "stats: " << err << "\n";
+    return rc;
+}
@@ -3,98 +3,541 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
 #include <memory>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <algorithm>
+#include <memory_resource>
 #include "db.h"
+#include "arena.h"
 using namespace std;
-// simple operator interface working with vector<string> rows
+
+static_assert(BlockBloom::kBlock == IntColumn::kBlock && Tombstones::kBlock == IntColumn::kBlock, "block skipping assumes one block size");
+
+// WHERE col op val. The literal is parsed once here instead of once per row:
+// for a fixed-width column into the column's key (value_type.h), so dates,
+// doubles and flags compare by value; for STRING a number still compares as one.
+struct Predicate {
+    int col = -1;
+    string colName, op, val;
+    ValueType type = ValueType::String;
+    bool valNum = false;
+    long long num = 0;
+    enum Cmp { Eq, Ne, Gt, Lt, Le, Ge, Never } cmp = Never;   // op, decoded once
+
+    // set by prepare() for dictionary columns: the result for every distinct
+    // value, so rows only compare their code
+    const Column* coded = nullptr;
+    pmr::vector<char> byCode;
+
+    // set by prepare() for compressed INT columns: rows are compared as numbers,
+    // one block is decoded at a time and kept for the following rows
+    const IntColumn* ints = nullptr;
+    mutable pmr::vector<long long> block;
+    mutable long long blockNo = -1;
+
+    // block skipping, set by prepare(): zone maps (ints above), the column's
+    // Bloom filter for equality, or no dictionary value matching at all
+    const BlockBloom* bloom = nullptr;
+    uint64_t bloomHash = 0;
+    bool none = false;
+    int rows = 0;
+
+    Predicate() {}
+    Predicate(int c, string_view name, string_view o, string_view v, ValueType t = ValueType::String)
+        : col(c), colName(name), op(o), val(v), type(t)
+    {
+        valNum = key(val, num);
+        cmp = op == "=" ? Eq : op == "!=" ? Ne : op == ">" ? Gt : op == "<" ? Lt
+            : op == "<=" ? Le : op == ">=" ? Ge : Never;
+    }
+
+    // copy whose buffers are allocated from mr (an operator's arena)
+    Predicate(const Predicate& o, pmr::memory_resource* mr) : byCode(mr), block(mr) { *this = o; }
+    Predicate(const Predicate&) = default;
+    Predicate& operator=(const Predicate&) = default;
+
+    bool key(string_view v, long long& x) const
+    {
+        return isFixedWidth(type) ? encodeValue(type, v, x) : parseInt64(v, x);
+    }
+
+    bool matchNum(long long a) const
+    {
+        switch (cmp) {
+        case Eq: return a == num;
+        case Ne: return a != num;
+        case Gt: return a > num;
+        case Lt: return a < num;
+        case Le: return a <= num;
+        case Ge: return a >= num;
+        default: return false;
+        }
+    }
+
+    bool matchCell(string_view cell) const
+    {
+        long long a = 0;
+
+        if (valNum && key(cell, a))
+            return matchNum(a);
+        return cmp == Eq && cell == val;
+    }
+
+    bool match(const vector<string>& row) const
+    {
+        if (col < 0 || col >= (int)row.size())
+            return false;
+        return matchCell(row[col]);
+    }
+
+    // call once per query before matchAt()
+    void prepare(const TableDynamic& t)
+    {
+        coded = nullptr;
+        byCode.clear();
+        ints = nullptr;
+        blockNo = -1;
+        bloom = nullptr;
+        none = false;
+        rows = t.rowCount();
+        if (col < 0 || col >= (int)t.schema().names.size())
+            return;
+
+        // the filter holds cells as text: usable when equality means equal text
+        const BlockBloom* bf = t.bloom(col);
+        if (bf && cmp == Eq && t.column(col).isInt() == valNum) {
+            bloom = bf;
+            bloomHash = BlockBloom::hashOf(valNum ? to_string(num) : val);
+        }
+
+        if (t.column(col).isInt()) {
+            ints = &t.column(col).ints();
+            block.resize(IntColumn::kBlock);
+            return;
+        }
+        if (!t.column(col).isDict())
+            return;
+
+        const Column& c = t.column(col);
+        if (cmp == Eq && !valNum) {
+            // plain equality: one dictionary lookup for the whole query
+            byCode.assign(c.dictSize(), 0);
+            long long code = c.findCode(val);
+            if (code >= 0)
+                byCode[code] = 1;
+        }
+        else {
+            byCode.resize(c.dictSize());
+            for (uint32_t i = 0; i < (uint32_t)c.dictSize(); ++i)
+                byCode[i] = matchCell(c.dictValue(i));
+        }
+        coded = &c;
+        none = find(byCode.begin(), byCode.end(), 1) == byCode.end();
+    }
+
+    // zone map test: can any value in [lo, hi] match?
+    bool rangeMayMatch(long long lo, long long hi) const
+    {
+        if (!valNum)
+            return false;
+        switch (cmp) {
+        case Eq: return lo <= num && num <= hi;
+        case Ne: return lo != num || hi != num;
+        case Gt: return hi > num;
+        case Lt: return lo < num;
+        case Le: return lo <= num;
+        case Ge: return hi >= num;
+        default: return false;
+        }
+    }
+
+    // true once prepare() found a way to rule out whole blocks
+    bool canSkip() const { return ints || bloom || none; }
+
+    // "zone map", "bloom filter", "zone map + bloom filter" or "dictionary"
+    string skipKind() const
+    {
+        if (none)
+            return "dictionary";
+        string k = ints ? "zone map" : "";
+        if (bloom)
+            k += k.empty() ? "bloom filter" : " + bloom filter";
+        return k;
+    }
+
+    bool blockMayMatch(size_t b) const
+    {
+        if (none)
+            return false;
+        if (bloom && !bloom->mayContain(b, bloomHash))
+            return false;
+        if (ints) {
+            long long lo = 0, hi = 0;
+            ints->zone(b, lo, hi);
+            return rangeMayMatch(lo, hi);
+        }
+        return true;
+    }
+
+    // first row >= row (up to end) whose block may hold a match;
+    // row is returned as is when no block can be ruled out
+    int nextCandidate(int row, int end) const
+    {
+        if (!canSkip())
+            return row;
+        while (row < end && !blockMayMatch((size_t)row / IntColumn::kBlock))
+            row = (row / IntColumn::kBlock + 1) * IntColumn::kBlock;
+        return min(row, end);
+    }
+
+    // rows in blocks that may match, for the planner; -1 without skipping
+    long long candidateRows() const
+    {
+        if (!canSkip())
+            return -1;
+        long long n = 0;
+        for (int from = 0; from < rows; from += IntColumn::kBlock)
+            if (blockMayMatch((size_t)from / IntColumn::kBlock))
+                n += min(IntColumn::kBlock, rows - from);
+        return n;
+    }
+
+    bool matchIntAt(int row) const
+    {
+        if (!valNum)
+            return false;   // a key's text never equals a value the type can't hold
+        long long b = row / IntColumn::kBlock;
+        if (b != blockNo) {
+            ints->decodeBlock((size_t)b, block.data());
+            blockNo = b;
+        }
+        return matchNum(block[row % IntColumn::kBlock]);
+    }
+
+    // not thread safe once prepared (block cache), give each thread its own copy
+    bool matchAt(const TableDynamic& t, int row) const
+    {
+        if (ints)
+            return matchIntAt(row);
+        if (coded) {
+            uint32_t code = coded->code(row);
+            if (code < byCode.size())
+                return byCode[code] != 0;
+        }
+        return matchCell(t.cell(row, col));
+    }
+
+    string describe() const { return colName + " " + op + " " + val; }
+};
+
+// counters kept by Analyze for EXPLAIN ANALYZE
+struct OpStats {
+    long long nextCalls = 0;
+    long long rowsOut = 0;
+    double seconds = 0;
+};
+
+// simple operator interface. rowId() is the table row behind the current
+// output, so callers can keep row ids instead of copying rows; getRow() copies
+// into a row buffer that lives in the statement's arena.
+// Operators are made with Arena::make and owned through OpPtr.
 class Operator {
 public:
     virtual void open() = 0;
     virtual bool next() = 0;
-    virtual vector<string> getRow() = 0;
-    virtual void updateRow(const vector<string>& newRow) {} // optional
+    virtual const ArenaRow& getRow() = 0;
+    virtual int rowId() const { return -1; }
+    virtual void updateRow(const ArenaRow&) {} // optional
     virtual void close() = 0;
+
+    // EXPLAIN support
+    virtual string describe() const = 0;                        // one line of the plan
+    virtual Operator* input() const { return nullptr; }         // child in the plan
+    virtual const OpStats* stats() const { return nullptr; }    // only when wrapped by Analyze
+    virtual long long bytesRead() const { return 0; }
     virtual ~Operator() {}
 };
 
+using OpPtr = unique_ptr<Operator, ArenaDelete>;
+
+// reads every live row, or with a skip predicate jumps over the blocks that
+// cannot match (zone maps of an INT column, a Bloom filter for equality, see
+// Predicate::blockMayMatch). Deleted rows are passed over by their block's
+// bitmap. The Filter above still tests each row returned.
 class TableScan : public Operator {
     TableDynamic& table_;
     int idx_;
-    vector<string> current_;
+    int tableRows_;     // size when the plan was built, for EXPLAIN
+    bool countBytes_;
+    long long bits_ = 0;
+    long long scanned_ = 0;
+    bool useZones_ = false;
+    Predicate zone_;
+    long long blocks_ = 0, skipped_ = 0;
+    int zoneBlock_ = -1;        // last block whose zone was checked
+    bool ran_ = false;
+    ArenaRow current_;          // getRow() copy
 public:
-    TableScan(TableDynamic& t) : table_(t), idx_(-1) {}
-    void open() override { idx_ = -1; table_.load(); }
-    bool next() override { ++idx_; if (idx_ < table_.rowCount()) 
-    { 
-        current_ = table_.getRow(idx_);
+    TableScan(pmr::memory_resource* mr, TableDynamic& t, bool countBytes = false, const Predicate* zone = nullptr)
+        : table_(t), idx_(-1), tableRows_(t.liveRows()), countBytes_(countBytes), zone_(Predicate(), mr), current_(mr)
+    {
+        if (zone) {
+            useZones_ = true;
+            zone_ = *zone;
+            zone_.prepare(t);   // for describe() before open()
+        }
+    }
+    void open() override {
+        idx_ = -1; bits_ = 0; scanned_ = 0; skipped_ = 0; zoneBlock_ = -1; ran_ = true;
+        blocks_ = (table_.rowCount() + IntColumn::kBlock - 1) / IntColumn::kBlock;
+        if (useZones_)
+            zone_.prepare(table_);
+    }
+    bool next() override {
+        int n = table_.rowCount();
+        for (++idx_; idx_ < n; ) {
+            // check each block's zone once, also when nextLive() lands mid-block
+            if (idx_ / IntColumn::kBlock != zoneBlock_ && zone_.canSkip()) {
+                int from = idx_;
+                idx_ = zone_.nextCandidate(idx_, n);
+                skipped_ += (idx_ - from + IntColumn::kBlock - 1) / IntColumn::kBlock;
+                if (idx_ >= n)
+                    break;
+                zoneBlock_ = idx_ / IntColumn::kBlock;
+            }
+            int live = table_.nextLive(idx_, n);
+            if (live == idx_)
+                break;
+            idx_ = live;
+        }
+        if (idx_ >= n)
+            return false;
+        ++scanned_;
+
+        if (countBytes_)
+            for (int c = 0; c < (int)table_.schema().names.size(); ++c)
+                bits_ += (long long)table_.column(c).bitsAt(idx_);
         return true;
-    } 
-    return false; }
-    vector<string> getRow() override { return current_; }
-    void updateRow(const vector<string>& newRow) override 
+    }
+    const ArenaRow& getRow() override { table_.rowInto(idx_, current_); return current_; }
+    int rowId() const override { return idx_; }
+    void updateRow(const ArenaRow& newRow) override
     { if (idx_ >= 0 && idx_ < table_.rowCount())
-        table_.getRow(idx_) = const_cast<vector<string>&>(newRow); }
-    void close() override {}
+        for (int c = 0; c < (int)newRow.size(); ++c)
+            table_.setCell(idx_, c, newRow[c]); }
+    void close() override { metrics::add(metrics::RowsScanned, (uint64_t)scanned_); scanned_ = 0; }
+
+    string describe() const override
+    {
+        string d = "TableScan " + table_.name() + " (full scan, " + to_string(tableRows_) + " rows)";
+        if (useZones_ && zone_.canSkip()) {
+            d += " " + zone_.skipKind() + " " + zone_.describe();
+            if (ran_)
+                d += ", skipped " + to_string(skipped_) + " of " + to_string(blocks_) + " blocks";
+        }
+        return d;
+    }
+    long long bytesRead() const override { return bits_ / 8; }
 };
 
+static inline string estimateNote(double estRows) {
+    return estRows < 0 ? string() : "  [est. rows=" + to_string((long long)llround(estRows)) + "]";
+}
+
+// tests the predicate on the child's current table row (the child is a scan of table_)
 class Filter : public Operator {
-    unique_ptr<Operator> child_;
-    int colIdx_;
-    string op_, val_;
-    vector<string> current_;
+    OpPtr child_;
+    const TableDynamic& table_;
+    Predicate pred_;
+    double estRows_;
 public:
-    Filter(unique_ptr<Operator> child, int colIdx, const string& op, const string& val)
-        : child_(move(child)), colIdx_(colIdx), op_(op), val_(val) {}
-    void open() override { child_->open(); }
+    Filter(pmr::memory_resource* mr, OpPtr child, const TableDynamic& t, const Predicate& pred, double estRows = -1)
+        : child_(move(child)), table_(t), pred_(pred, mr), estRows_(estRows) {}
+    void open() override { pred_.prepare(table_); child_->open(); }
     bool next() override {
         while (child_->next()) {
-            auto r = child_->getRow();
-            if (colIdx_ < 0 || colIdx_ >= (int)r.size()) continue;
-            string cell = r[colIdx_];
-            bool ok = false;
-            bool cellNum = isNumberString(cell), valNum = isNumberString(val_);
-            if (cellNum && valNum) {
-                try {
-                    long long a = stoll(cell), b = stoll(val_);
-                    if (op_ == "=") ok = (a == b);
-                    else if (op_ == ">") ok = (a > b);
-                    else if (op_ == "<") ok = (a < b);
+            if (pred_.matchAt(table_, child_->rowId()))
+                return true;
+        }
+        return false;
+    }
+    const ArenaRow& getRow() override { return child_->getRow(); }
+    int rowId() const override { return child_->rowId(); }
+    void updateRow(const ArenaRow& newRow) override { child_->updateRow(newRow); }
+    void close() override { child_->close(); }
+
+    string describe() const override { return "Filter " + pred_.describe() + estimateNote(estRows_); }
+    Operator* input() const override { return child_.get(); }
+};
+
+// scan + filter split over worker threads: each worker applies the predicate to
+// one contiguous range of rows, the matching ids are joined back in table order.
+// The table must not change while the scan runs (the caller holds the lock).
+// Workers keep their partial results on the heap, the arena is single-threaded.
+class ParallelScan : public Operator {
+    TableDynamic& table_;
+    Predicate pred_;
+    int workers_;
+    int tableRows_;
+    double estRows_;
+    bool countBytes_;
+    pmr::vector<int> ids_;
+    size_t pos_ = 0;
+    int cur_ = -1;
+    long long bytes_ = 0;
+    ArenaRow current_;
+public:
+    ParallelScan(pmr::memory_resource* mr, TableDynamic& t, const Predicate& pred, int workers, double estRows = -1, bool countBytes = false)
+        : table_(t), pred_(pred, mr), workers_(max(1, workers)), tableRows_(t.liveRows()), estRows_(estRows), countBytes_(countBytes),
+          ids_(mr), current_(mr) {}
+
+    void open() override {
+        int n = table_.rowCount();
+        int w = max(1, min(workers_, n));
+        vector<vector<int>> parts(w);
+        vector<long long> partBits(w, 0);
+
+        pred_.prepare(table_);
+        int ncols = (int)table_.schema().names.size();
+
+        auto work = [&](int k) {
+            Predicate pred = pred_;
+            int from = (int)((long long)n * k / w), to = (int)((long long)n * (k + 1) / w);
+            for (int i = from, checked = -1; i < to; ++i) {
+                if (i / IntColumn::kBlock != checked) {
+                    i = pred.nextCandidate(i, to);  // zone maps: skip blocks that cannot match
+                    if (i >= to)
+                        break;
+                    checked = i / IntColumn::kBlock;
                 }
-                catch (...) 
-                { 
-                    ok = false; 
+                if ((i = table_.nextLive(i, to)) >= to)
+                    break;
+                if (i / IntColumn::kBlock != checked) {
+                    --i;    // landed in a later block, check its zone first
+                    continue;
                 }
+                if (countBytes_)
+                    for (int c = 0; c < ncols; ++c)
+                        partBits[k] += (long long)table_.column(c).bitsAt(i);
+                if (pred.matchAt(table_, i))
+                    parts[k].push_back(i);
             }
-            else {
-                if (op_ == "=") ok = (cell == val_);
-                else ok = false;
-            }
-            if (ok) { current_ = r; return true; }
+        };
+
+        vector<thread> threads;
+        for (int k = 1; k < w; ++k)
+            threads.emplace_back(work, k);
+        work(0);
+        for (auto& th : threads)
+            th.join();
+
+        ids_.clear();
+        bytes_ = 0;
+        size_t total = 0;
+        for (auto& p : parts)
+            total += p.size();
+        ids_.reserve(total);
+        for (int k = 0; k < w; ++k) {
+            ids_.insert(ids_.end(), parts[k].begin(), parts[k].end());
+            bytes_ += partBits[k] / 8;
         }
-        return false;
+        pos_ = 0;
+        cur_ = -1;
+        metrics::add(metrics::RowsScanned, (uint64_t)n);
     }
-    vector<string> getRow() override { return current_; }
-    void updateRow(const vector<string>& newRow) override { child_->updateRow(newRow); }
-    void close() override { child_->close(); }
+    bool next() override {
+        if (pos_ >= ids_.size())
+            return false;
+        cur_ = ids_[pos_++];
+        return true;
+    }
+    const ArenaRow& getRow() override { table_.rowInto(cur_, current_); return current_; }
+    int rowId() const override { return cur_; }
+    void updateRow(const ArenaRow& newRow) override
+    { for (int c = 0; c < (int)newRow.size(); ++c)
+        table_.setCell(cur_, c, newRow[c]); }
+    void close() override {}
+
+    string describe() const override
+    {
+        return "ParallelScan " + table_.name() + " (" + to_string(workers_) + " workers, "
+            + to_string(tableRows_) + " rows) filter " + pred_.describe() + estimateNote(estRows_);
+    }
+    long long bytesRead() const override { return bytes_; }
 };
 
+// rows are only copied when getRow() is asked for, callers that work with
+// rowId() and the column map get projection for free
 class Projection : public Operator {
-    unique_ptr<Operator> child_;
+    OpPtr child_;
     vector<int> idxs_;
-    vector<string> current_;
+    vector<string> names_;
+    ArenaRow current_;
 public:
-    Projection(unique_ptr<Operator> child, const vector<int>& idxs) : child_(move(child)), idxs_(idxs) {}
+    Projection(pmr::memory_resource* mr, OpPtr child, const vector<int>& idxs, const vector<string>& names = {})
+        : child_(move(child)), idxs_(idxs), names_(names), current_(mr) {}
     void open() override { child_->open(); }
-    bool next() override {
-        if (!child_->next()) return false;
-        auto r = child_->getRow();
-        vector<string> out; out.reserve(idxs_.size());
-        for (int i : idxs_) out.push_back((i >= 0 && i < (int)r.size()) ? r[i] : string());
-        current_ = out; return true;
-    }
-    vector<string> getRow() override { return current_; }
-    void updateRow(const vector<string>& newRow) override { child_->updateRow(newRow); }
+    bool next() override { return child_->next(); }
+    const ArenaRow& getRow() override {
+        const ArenaRow& r = child_->getRow();
+        current_.resize(idxs_.size());
+        for (size_t k = 0; k < idxs_.size(); ++k) {
+            int i = idxs_[k];
+            if (i >= 0 && i < (int)r.size())
+                current_[k].assign(r[i]);
+            else
+                current_[k].clear();
+        }
+        return current_;
+    }
+    int rowId() const override { return child_->rowId(); }
+    void updateRow(const ArenaRow& newRow) override { child_->updateRow(newRow); }
     void close() override { child_->close(); }
+
+    const vector<int>& columns() const { return idxs_; }
+
+    string describe() const override {
+        string d = "Projection [";
+        for (size_t i = 0; i < names_.size(); ++i)
+            d += (i ? ", " : "") + names_[i];
+        return d + "]";
+    }
+    Operator* input() const override { return child_.get(); }
+};
+
+// wraps one plan node for EXPLAIN ANALYZE: counts next() calls and rows,
+// and measures wall time spent inside the node (children included)
+class Analyze : public Operator {
+    OpPtr inner_;
+    OpStats stats_;
+public:
+    explicit Analyze(OpPtr inner) : inner_(move(inner)) {}
+    void open() override {
+        auto t0 = chrono::steady_clock::now();
+        inner_->open();
+        stats_.seconds += chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+    }
+    bool next() override {
+        auto t0 = chrono::steady_clock::now();
+        bool ok = inner_->next();
+        stats_.seconds += chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        ++stats_.nextCalls;
+        if (ok)
+            ++stats_.rowsOut;
+        return ok;
+    }
+    const ArenaRow& getRow() override { return inner_->getRow(); }
+    int rowId() const override { return inner_->rowId(); }
+    void updateRow(const ArenaRow& newRow) override { inner_->updateRow(newRow); }
+    void close() override { inner_->close(); }
+
+    string describe() const override { return inner_->describe(); }
+    Operator* input() const override { return inner_->input(); }
+    const OpStats* stats() const override { return &stats_; }
+    long long bytesRead() const override { return inner_->bytesRead(); }
 };
 
 #endif // OPERATORS_H
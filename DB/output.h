@@ -0,0 +1,141 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include "utils.h"
+#include "database.h"
+using namespace std;
+
+enum class OutputFormat { Table, Csv, Tsv };
+
+// formats ResultSets into one large buffer and hands it to the FILE in big
+// chunks, so dumping many rows costs a few write() calls instead of one per cell.
+// With out == nullptr the text just accumulates and can be taken with take().
+class ResultWriter {
+    FILE* out_;
+    OutputFormat fmt_;
+    size_t limit_;
+    string buf_;
+
+public:
+    ResultWriter(FILE* out, OutputFormat fmt = OutputFormat::Table, size_t bufferBytes = 1 << 20)
+        : out_(out), fmt_(fmt), limit_(bufferBytes)
+    {
+        buf_.reserve(out_ ? limit_ + 4096 : 256);
+    }
+
+    ~ResultWriter()
+    {
+        flush();
+    }
+
+    ResultWriter(const ResultWriter&) = delete;
+    ResultWriter& operator=(const ResultWriter&) = delete;
+
+    static bool parseFormat(string_view name, OutputFormat& fmt)
+    {
+        if (iequals(name, "table")) fmt = OutputFormat::Table;
+        else if (iequals(name, "csv")) fmt = OutputFormat::Csv;
+        else if (iequals(name, "tsv")) fmt = OutputFormat::Tsv;
+        else return false;
+        return true;
+    }
+
+    OutputFormat format() const { return fmt_; }
+
+    void raw(string_view s)
+    {
+        buf_.append(s);
+        if (out_ && buf_.size() >= limit_)
+            flush();
+    }
+
+    // writes the rows of rs, or its message for statements without rows
+    // (messages are only part of the table format, csv/tsv stay pure data)
+    void write(const ResultSet& rs)
+    {
+        if (!rs.hasRows()) {
+            if (fmt_ == OutputFormat::Table) {
+                buf_.append(rs.message());
+                buf_.push_back('\n');
+            }
+            return;
+        }
+
+        size_t cols = rs.columnCount();
+
+        for (size_t i = 0; i < cols; ++i)
+            field(rs.columnNames()[i], i);
+        if (fmt_ == OutputFormat::Table)
+            buf_.append("\n--------------------------------");
+        buf_.push_back('\n');
+
+        for (auto row : rs) {
+            for (size_t i = 0; i < cols; ++i)
+                field(row[i], i);
+            buf_.push_back('\n');
+
+            if (out_ && buf_.size() >= limit_)
+                flush();
+        }
+    }
+
+    void flush()
+    {
+        if (!out_ || buf_.empty())
+            return;
+
+        fwrite(buf_.data(), 1, buf_.size(), out_);
+        fflush(out_);
+        buf_.clear();
+    }
+
+    string take()
+    {
+        string r;
+        r.swap(buf_);
+        return r;
+    }
+
+private:
+    void field(string_view v, size_t col)
+    {
+        switch (fmt_) {
+        case OutputFormat::Table:
+            buf_.append(v);
+            buf_.push_back('\t');
+            break;
+
+        case OutputFormat::Tsv:
+            if (col > 0)
+                buf_.push_back('\t');
+            for (char ch : v) { // keep one record per line
+                if (ch == '\t') buf_.append("\\t");
+                else if (ch == '\n') buf_.append("\\n");
+                else if (ch == '\\') buf_.append("\\\\");
+                else buf_.push_back(ch);
+            }
+            break;
+
+        case OutputFormat::Csv:
+            if (col > 0)
+                buf_.push_back(',');
+            if (v.find_first_of(",\"\n\r") == string_view::npos) {
+                buf_.append(v);
+                break;
+            }
+            buf_.push_back('"');
+            for (char ch : v) {
+                if (ch == '"')
+                    buf_.push_back('"');
+                buf_.push_back(ch);
+            }
+            buf_.push_back('"');
+            break;
+        }
+    }
+};
+
+#endif // OUTPUT_H
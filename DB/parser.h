@@ -2,128 +2,276 @@
 #define PARSER_H
 
 #include <string>
+#include <string_view>
 #include <vector>
-#include <sstream>
+#include <memory>
 #include "utils.h"
 using namespace std;
 
+enum class StmtKind : unsigned char { None, Create, Insert, Select, Update, Delete, Drop, Show, Analyze, Begin, Commit, Rollback, Alter };
+
+using Tokens = SmallVec<string_view, 48>;
+using Fields = SmallVec<string_view, 8>;   // a statement's column / value list
+
+// clauses of the less common DDL statements, allocated only when one is parsed
+struct DdlClauses {
+    string_view query;                // CREATE MATERIALIZED VIEW: the SELECT text
+    string_view partKind, partCol;    // CREATE ... PARTITION BY RANGE | HASH (col)
+    string_view partCount;            // HASH: PARTITIONS n
+    Fields parts;                     // RANGE: name,bound pairs (bound MAXVALUE for the last)
+    string_view alterOp;              // ALTER TABLE t ADD | DROP PARTITION name [VALUES LESS THAN (v)]
+    bool alterColumn = false;         // ALTER TABLE t ADD | DROP COLUMN: name[,type] in cols, DEFAULT in vals
+    string_view shardCol, shardBy;    // CREATE ... SHARD BY (col): the column, and the clause's text
+};
+
+// parsed statement, every field is a view into the original query text
+// (the text must stay alive while the statement is used). Lists longer than
+// their inline capacity spill to the heap
+struct Statement {
+    StmtKind kind = StmtKind::None;
+    string_view table;
+    Fields cols;                      // CREATE: name,type pairs | SELECT: col list
+    Fields vals;                      // INSERT values
+    string_view whereCol, whereOp, whereVal;
+    SmallVec<string_view, 4> setCols, setExprs;  // UPDATE: col = expr pairs
+    bool explain = false;             // EXPLAIN [ANALYZE] prefix
+    bool analyze = false;
+    bool bloom = false;               // CREATE / DROP BLOOM FILTER ON table (col)
+    bool view = false;                // CREATE / DROP MATERIALIZED VIEW table
+    string_view text;                 // the whole statement, replicas replay it
+    unique_ptr<DdlClauses> ddlClauses;
+
+    Statement() = default;
+    Statement(const Statement& o) { *this = o; }
+    Statement(Statement&&) = default;
+    Statement& operator=(Statement&&) = default;
+    Statement& operator=(const Statement& o)
+    {
+        if (this == &o)
+            return *this;
+        kind = o.kind;
+        table = o.table;
+        cols = o.cols;
+        vals = o.vals;
+        whereCol = o.whereCol;
+        whereOp = o.whereOp;
+        whereVal = o.whereVal;
+        setCols = o.setCols;
+        setExprs = o.setExprs;
+        explain = o.explain;
+        analyze = o.analyze;
+        bloom = o.bloom;
+        view = o.view;
+        text = o.text;
+        ddlClauses = o.ddlClauses ? make_unique<DdlClauses>(*o.ddlClauses) : nullptr;
+        return *this;
+    }
+
+    bool valid() const { return kind != StmtKind::None; }
+    bool hasWhere() const { return !whereCol.empty(); }
+
+    // the DDL clauses, all empty when the statement has none
+    const DdlClauses& ddl() const
+    {
+        static const DdlClauses none;
+        return ddlClauses ? *ddlClauses : none;
+    }
+    DdlClauses& makeDdl()
+    {
+        if (!ddlClauses)
+            ddlClauses = make_unique<DdlClauses>();
+        return *ddlClauses;
+    }
+};
+
 class Parse {
-    string cmd_;
-    string table_;
-    vector<string> cols_;      // CREATE: name:TYPE  | SELECT: col list
-    vector<string> vals_;      // INSERT values
-    string whereCol_, whereOp_, whereVal_;
-    string setCol_, setVal_;
-    bool valid_ = false;
+    string query_;     // owned copy, stmt_ points into it
+    Statement stmt_;
 
 public:
     Parse() {
 
     }
 
-    void reset() {
+    Parse(const Parse&) = delete;
+    Parse& operator=(const Parse&) = delete;
 
-        cmd_.clear();
-        table_.clear();
-        cols_.clear();
-        vals_.clear();
-        whereCol_.clear();
-        whereOp_.clear();
-        whereVal_.clear();
-        setCol_.clear();
-        setVal_.clear();
-        valid_ = false;
+    void reset() {
+        query_.clear();
+        stmt_ = Statement();
+    }
 
+    static bool isSpecial(char ch)
+    {
+        return ch == '(' || ch == ')' || ch == ',' || ch == '=' || ch == '<' || ch == '>' || ch == '!';
     }
 
-    static vector<string> tokenize(const string& q)
+    static void tokenize(string_view s, Tokens& tok)
     {
-        // simple tokenizer to cut by space and special chars
-        vector<string> tok;
-        string current;
-        string s = q;
+        // simple tokenizer to cut by space and special chars, tokens are views into s
+        tok.clear();
         if (!s.empty() && s.back() == ';') // remove trailing semicolon
-            s.pop_back();
+            s.remove_suffix(1);
+
+        size_t start = string_view::npos; // start of current word
 
         for (size_t i = 0; i < s.size(); ++i) {
             char ch = s[i];
 
-            if (ch == '(' || ch == ')' || ch == ',' || ch == '=' || ch == '<' || ch == '>' || ch == '!') // special chars
+            if (isSpecial(ch) || isspace((unsigned char)ch))
             {
-                if (!current.empty())
+                if (start != string_view::npos)
                 {
-                    tok.push_back(current);
-                    current.clear();
+                    tok.push_back(s.substr(start, i - start));
+                    start = string_view::npos;
                 }
 
+                if (!isSpecial(ch)) // space
+                    continue;
+
                 if ((ch == '<' || ch == '>' || ch == '!' || ch == '=') && i + 1 < s.size() && s[i + 1] == '=')
                 {
-                    tok.push_back(string(1, ch) + "=");
+                    tok.push_back(s.substr(i, 2));
                     ++i;
                 }
                 else
                 {
-                    tok.push_back(string(1, ch));
+                    tok.push_back(s.substr(i, 1));
                 }
             }
-            else if (isspace((unsigned char)ch)) // space 
-            {
-                if (!current.empty())
-                {
-                    tok.push_back(current);
-                    current.clear();
-                }
-            }
-            else current.push_back(ch);
+            else if (start == string_view::npos)
+                start = i;
         }
 
-        if (!current.empty()) // last token
-            tok.push_back(current);
-
-        return tok;
+        if (start != string_view::npos) // last token
+            tok.push_back(s.substr(start));
     }
 
-    void parse(const string& query)
+    // zero-copy path: fills out with views into q, returns out.valid()
+    static bool parseStatement(string_view q, Statement& out)
     {
-        reset();
+        out = Statement();
+        out.text = trimView(q);
 
-        auto tok = tokenize(query);
+        Tokens tok;
+        tokenize(q, tok);
 
         if (tok.empty())
-            return;
+            return false;
+
+        string_view first = tok[0];
+
+        if (iequals(first, "EXPLAIN"))
+        {
+            // EXPLAIN [ANALYZE] stmt: parse the rest of the text as the statement
+            size_t k = (tok.size() > 1 && iequals(tok[1], "ANALYZE")) ? 2 : 1;
+            if (k >= tok.size() || iequals(tok[k], "EXPLAIN"))
+                return false;
+
+            if (!parseStatement(q.substr(tok[k].data() - q.data()), out))
+                return false;
+
+            out.explain = true;
+            out.analyze = k == 2;
+            out.text = trimView(q);
+            return true;
+        }
+
+        if (iequals(first, "CREATE"))
+            parseCreate(tok, out);
+
+        else if (iequals(first, "INSERT"))
+            parseInsert(tok, out);
 
-        string first = toUpper(tok[0]);
+        else if (iequals(first, "SELECT"))
+            parseSelect(tok, out);
 
-        if (first == "CREATE")
-            parseCreate(tok);
+        else if (iequals(first, "UPDATE"))
+            parseUpdate(tok, out);
 
-        else if (first == "INSERT")
-            parseInsert(tok);
+        else if (iequals(first, "DELETE"))
+            parseDelete(tok, out);
 
-        else if (first == "SELECT")
-            parseSelect(tok);
+        else if (iequals(first, "DROP"))
+            parseDrop(tok, out);
 
-        else if (first == "UPDATE")
-            parseUpdate(tok);
+        else if (iequals(first, "SHOW"))
+            parseShow(tok, out);
 
-        else if (first == "DELETE")
-            parseDelete(tok);
+        else if (iequals(first, "ANALYZE"))
+            parseAnalyze(tok, out);
 
-        else if (first == "DROP")
-            parseDrop(tok);
+        else if (iequals(first, "BEGIN") || iequals(first, "START"))
+            parseTransaction(tok, out, StmtKind::Begin);
+
+        else if (iequals(first, "COMMIT") || iequals(first, "END"))
+            parseTransaction(tok, out, StmtKind::Commit);
+
+        else if (iequals(first, "ROLLBACK"))
+            parseTransaction(tok, out, StmtKind::Rollback);
+
+        else if (iequals(first, "ALTER"))
+            parseAlter(tok, out);
+
+        return out.valid();
+    }
+
+    void parse(const string& query)
+    {
+        reset();
+        query_ = query;
+        parseStatement(query_, stmt_);
     }
 
-    void parseCreate(const vector<string>& t)
+    // CREATE|DROP BLOOM FILTER ON table ( col )
+    static void parseBloom(const Tokens& t, Statement& st, StmtKind kind)
+    {
+        if (t.size() != 8 || !iequals(t[1], "BLOOM") || !iequals(t[2], "FILTER") || !iequals(t[3], "ON")
+            || t[5] != "(" || t[7] != ")")
+            return;
+
+        st.table = t[4];
+        st.cols.push_back(t[6]);
+        st.bloom = true;
+        st.kind = kind;
+    }
+
+    // CREATE MATERIALIZED VIEW name AS SELECT ... | DROP MATERIALIZED VIEW name
+    static void parseView(const Tokens& t, Statement& st, StmtKind kind)
+    {
+        if (t.size() < 4 || !iequals(t[1], "MATERIALIZED") || !iequals(t[2], "VIEW"))
+            return;
+
+        if (kind == StmtKind::Drop) {
+            if (t.size() != 4)
+                return;
+        }
+        else {
+            if (t.size() < 7 || !iequals(t[4], "AS") || !iequals(t[5], "SELECT"))
+                return;
+            string_view last = t[t.size() - 1];
+            st.makeDdl().query = string_view(t[5].data(), last.data() + last.size() - t[5].data());
+        }
+
+        st.table = t[3];
+        st.view = true;
+        st.kind = kind;
+    }
+
+    static void parseCreate(const Tokens& t, Statement& st)
     {
         // CREATE TABLE name ( col TYPE, col TYPE )
+        if (t.size() > 1 && iequals(t[1], "BLOOM"))
+            return parseBloom(t, st, StmtKind::Create);
+        if (t.size() > 1 && iequals(t[1], "MATERIALIZED"))
+            return parseView(t, st, StmtKind::Create);
+
         if (t.size() < 5)
             return;
 
-        if (toUpper(t[1]) != "TABLE")
+        if (!iequals(t[1], "TABLE"))
             return;
 
-        table_ = toLower(trim(t[2]));
-
         int open = -1, close = -1;
         for (size_t i = 3; i < t.size(); ++i)
             if (t[i] == "(")
@@ -132,7 +280,7 @@ public:
                 break;
             }
 
-        for (int i = (int)t.size() - 1; i >= 0; --i)
+        for (int i = open + 1; open >= 0 && i < (int)t.size(); ++i)
             if (t[i] == ")")
             {
                 close = i;
@@ -142,46 +290,129 @@ public:
         if (open < 0 || close < 0 || close <= open)
             return;
 
-        vector<string> parts;
-
         for (int i = open + 1; i < close; ++i)
             if (t[i] != ",")
-                parts.push_back(t[i]);
+                st.cols.push_back(t[i]);
 
-        if (parts.size() % 2 != 0)
+        if (st.cols.size() % 2 != 0)
             return;
 
-        cols_.clear();
+        size_t next = close + 1;
+        if (next < t.size() && iequals(t[next], "SHARD")) {
+            // SHARD BY (col), only a coordinator accepts it
+            if (next + 5 > t.size() || !iequals(t[next + 1], "BY") || t[next + 2] != "(" || t[next + 4] != ")")
+                return;
+            DdlClauses& d = st.makeDdl();
+            d.shardCol = t[next + 3];
+            d.shardBy = string_view(t[next].data(), t[next + 4].data() + t[next + 4].size() - t[next].data());
+            next += 5;
+        }
+
+        if (next < t.size() && !parsePartitionBy(t, next, st))
+            return;
 
-        for (size_t i = 0; i < parts.size(); i += 2)
-        {
-            string name = toLower(trim(parts[i]));
-            string type = toUpper(trim(parts[i + 1]));
+        st.table = t[2];
+        st.kind = StmtKind::Create;
+    }
 
-            if (type != "INT" && type != "STRING")  // default to STRING
-                type = "STRING";
+    // PARTITION BY RANGE (col) (name VALUES LESS THAN (v), ..., name VALUES LESS THAN MAXVALUE)
+    // PARTITION BY HASH (col) PARTITIONS n
+    static bool parsePartitionBy(const Tokens& t, size_t i, Statement& st)
+    {
+        if (i + 6 > t.size() || !iequals(t[i], "PARTITION") || !iequals(t[i + 1], "BY")
+            || t[i + 3] != "(" || t[i + 5] != ")")
+            return false;
+        DdlClauses& d = st.makeDdl();
+        d.partKind = t[i + 2];
+        d.partCol = t[i + 4];
+        i += 6;
+
+        if (iequals(d.partKind, "HASH")) {
+            if (i + 2 != t.size() || !iequals(t[i], "PARTITIONS"))
+                return false;
+            d.partCount = t[i + 1];
+            return true;
+        }
+        if (!iequals(d.partKind, "RANGE") || i >= t.size() || t[i] != "(" || t[t.size() - 1] != ")")
+            return false;
+        for (++i; i + 1 < t.size(); ) {
+            if (!parseRangePart(t, i, st))
+                return false;
+            if (t[i] == ",")
+                ++i;
+            else if (i + 1 != t.size())
+                return false;
+        }
+        return !d.parts.empty();
+    }
 
-            cols_.push_back(name + ":" + type);
+    // name VALUES LESS THAN (v) | name VALUES LESS THAN MAXVALUE, from t[i]; i ends past it
+    static bool parseRangePart(const Tokens& t, size_t& i, Statement& st)
+    {
+        if (i + 5 > t.size() || !iequals(t[i + 1], "VALUES") || !iequals(t[i + 2], "LESS") || !iequals(t[i + 3], "THAN"))
+            return false;
+        Fields& parts = st.makeDdl().parts;
+        parts.push_back(t[i]);
+        i += 4;
+        if (iequals(t[i], "MAXVALUE")) {
+            parts.push_back(t[i]);
+            ++i;
+            return true;
         }
-        valid_ = true;
+        if (i + 3 > t.size() || t[i] != "(" || t[i + 2] != ")")
+            return false;
+        parts.push_back(t[i + 1]);
+        i += 3;
+        return true;
+    }
 
-        cmd_ = "CREATE";
+    // ALTER TABLE t ADD PARTITION name VALUES LESS THAN (v) | ALTER TABLE t DROP PARTITION name
+    // ALTER TABLE t ADD [COLUMN] c TYPE [DEFAULT v] | ALTER TABLE t DROP [COLUMN] c
+    static void parseAlter(const Tokens& t, Statement& st)
+    {
+        if (t.size() < 5 || !iequals(t[1], "TABLE") || (!iequals(t[3], "ADD") && !iequals(t[3], "DROP")))
+            return;
+        bool drop = iequals(t[3], "DROP");
+        if (iequals(t[4], "PARTITION")) {
+            size_t i = 5;
+            if (drop) {
+                if (t.size() != 6)
+                    return;
+                st.makeDdl().parts.push_back(t[5]);
+            }
+            else if (!parseRangePart(t, i, st) || i != t.size())
+                return;
+        }
+        else {
+            size_t i = iequals(t[4], "COLUMN") ? 5 : 4;
+            size_t n = t.size() - i;
+            if (drop ? n != 1 : n != 2 && (n != 4 || !iequals(t[i + 2], "DEFAULT")))
+                return;
+            st.cols.push_back(t[i]);
+            if (!drop)
+                st.cols.push_back(t[i + 1]);
+            if (n == 4)
+                st.vals.push_back(t[i + 3]);
+            st.makeDdl().alterColumn = true;
+        }
+        st.table = t[2];
+        st.makeDdl().alterOp = t[3];
+        st.kind = StmtKind::Alter;
     }
 
-    void parseInsert(const vector<string>& t)
+    static void parseInsert(const Tokens& t, Statement& st)
     {
         // INSERT INTO table VALUES (val1,val2)
         if (t.size() < 4)
             return;
 
-        if (toUpper(t[1]) != "INTO")
+        if (!iequals(t[1], "INTO"))
             return;
 
-        table_ = toLower(trim(t[2]));
         int vpos = -1;
 
         for (size_t i = 3; i < t.size(); ++i)
-            if (toUpper(t[i]) == "VALUES")
+            if (iequals(t[i], "VALUES"))
             {
                 vpos = (int)i;
                 break;
@@ -197,22 +428,27 @@ public:
                 open = (int)i;
                 break;
             }
+        if (open < 0)
+            return;
+
         for (size_t i = open + 1; i < t.size(); ++i)
             if (t[i] == ")")
             {
                 close = (int)i;
                 break;
             }
-        if (open < 0 || close < 0)
+        if (close < 0)
             return;
-        vals_.clear();
 
-        for (int i = open + 1; i < close; ++i) if (t[i] != ",") vals_.push_back(trim(t[i]));
-        valid_ = true; cmd_ = "INSERT";
-    }
+        for (int i = open + 1; i < close; ++i)
+            if (t[i] != ",")
+                st.vals.push_back(t[i]);
 
+        st.table = t[2];
+        st.kind = StmtKind::Insert;
+    }
 
-    void parseSelect(const vector<string>& t)
+    static void parseSelect(const Tokens& t, Statement& st)
     {
         if (t.size() < 4)
             return;
@@ -220,7 +456,7 @@ public:
         int from = -1;
 
         for (size_t i = 1; i < t.size(); ++i)
-            if (toUpper(t[i]) == "FROM")
+            if (iequals(t[i], "FROM"))
             {
                 from = (int)i;
                 break;
@@ -229,109 +465,189 @@ public:
         if (from < 0 || from + 1 >= (int)t.size())
             return;
 
-        cols_.clear();
-
         for (int i = 1; i < from; ++i)
             if (t[i] != "," && t[i] != "(" && t[i] != ")")
-                cols_.push_back(toLower(trim(t[i])));
+                st.cols.push_back(t[i]);
 
-        table_ = toLower(trim(t[from + 1]));
+        st.table = t[from + 1];
 
-        if (from + 2 < (int)t.size() && toUpper(t[from + 2]) == "WHERE")
+        if (from + 2 < (int)t.size() && iequals(t[from + 2], "WHERE"))
         {
-            if (from + 5 <= (int)t.size() - 1)
-            {
-                whereCol_ = toLower(trim(t[from + 3]));
-                whereOp_ = trim(t[from + 4]);
-                whereVal_ = trim(t[from + 5]);
-                valid_ = true; cmd_ = "SELECT"; return;
-            }
-            else return;
+            if (from + 5 > (int)t.size() - 1)
+                return;
+
+            st.whereCol = t[from + 3];
+            st.whereOp = t[from + 4];
+            st.whereVal = t[from + 5];
         }
-        valid_ = true; cmd_ = "SELECT";
+        st.kind = StmtKind::Select;
     }
 
-    void parseUpdate(const vector<string>& t)
+    static void parseUpdate(const Tokens& t, Statement& st)
     {
-        if (t.size() < 5)
+        // UPDATE table SET col = expr [, col = expr ...] [WHERE col op val]
+        if (t.size() < 6 || !iequals(t[2], "SET"))
             return;
 
-        table_ = toLower(trim(t[1]));
-
-        if (toUpper(t[2]) != "SET")
-            return;
-        if (t.size() < 6)
-            return;
-
-        setCol_ = toLower(trim(t[3]));
-        if (t[4] != "=")
-            return;
+        size_t i = 3;
+        for (;;) {
+            if (i + 2 >= t.size() || t[i + 1] != "=")
+                return;
+            st.setCols.push_back(t[i]);
+
+            // the expression runs to a top level ',' or WHERE, kept as raw text
+            size_t b = i + 2, e = b;
+            int depth = 0;
+            for (; e < t.size(); ++e) {
+                if (t[e] == "(") ++depth;
+                else if (t[e] == ")") --depth;
+                else if (depth == 0 && (t[e] == "," || iequals(t[e], "WHERE")))
+                    break;
+            }
+            if (e == b)
+                return;
+            st.setExprs.push_back(string_view(t[b].data(), t[e - 1].data() + t[e - 1].size() - t[b].data()));
 
-        setVal_ = trim(t[5]);
+            i = e;
+            if (i < t.size() && t[i] == ",") {
+                ++i;
+                continue;
+            }
+            break;
+        }
 
-        if ((int)t.size() > 6 && toUpper(t[6]) == "WHERE")
+        if (i < t.size())
         {
-            if ((int)t.size() >= 10) {
-                whereCol_ = toLower(trim(t[7]));
-                whereOp_ = trim(t[8]);
-                whereVal_ = trim(t[9]);
-            }
-            else
+            // WHERE col op val
+            if (t.size() < i + 4)
                 return;
+
+            st.whereCol = t[i + 1];
+            st.whereOp = t[i + 2];
+            st.whereVal = t[i + 3];
         }
-        valid_ = true;
 
-        cmd_ = "UPDATE";
+        st.table = t[1];
+        st.kind = StmtKind::Update;
     }
 
-    void parseDelete(const vector<string>& t) {
+    static void parseDelete(const Tokens& t, Statement& st) {
+        // DELETE FROM table [WHERE col op val]
         if (t.size() < 3)
             return;
 
-        if (toUpper(t[1]) != "FROM")
+        if (!iequals(t[1], "FROM"))
             return;
 
-        table_ = toLower(trim(t[2]));
-
-        if ((int)t.size() > 3 && toUpper(t[3]) == "WHERE")
+        if ((int)t.size() > 3 && iequals(t[3], "WHERE"))
         {
-            if ((int)t.size() >= 6)
-            {
-                whereCol_ = toLower(trim(t[4]));
-                whereOp_ = trim(t[5]);
-                whereVal_ = trim(t[6]);
-            }
-            else
+            if ((int)t.size() < 7)
                 return;
+
+            st.whereCol = t[4];
+            st.whereOp = t[5];
+            st.whereVal = t[6];
         }
-        valid_ = true;
-        cmd_ = "DELETE";
+
+        st.table = t[2];
+        st.kind = StmtKind::Delete;
     }
 
-    void parseDrop(const vector<string>& t)
+    static void parseDrop(const Tokens& t, Statement& st)
     {
+        if (t.size() > 1 && iequals(t[1], "BLOOM"))
+            return parseBloom(t, st, StmtKind::Drop);
+        if (t.size() > 1 && iequals(t[1], "MATERIALIZED"))
+            return parseView(t, st, StmtKind::Drop);
+
         if (t.size() < 3)
             return;
 
-        if (toUpper(t[1]) != "TABLE")
+        if (!iequals(t[1], "TABLE"))
             return;
 
-        table_ = toLower(trim(t[2]));
-        valid_ = true;
-        cmd_ = "DROP";
+        st.table = t[2];
+        st.kind = StmtKind::Drop;
     }
 
-    // getters
-    string cmd() const { return cmd_; }
-    string table() const { return table_; }
-    vector<string> columns() const { return cols_; }
-    vector<string> values() const { return vals_; }
-    bool valid() const { return valid_; }
-    string whereCol() const { return whereCol_; }
-    string whereOp() const { return whereOp_; }
-    string whereVal() const { return whereVal_; }
-    string setCol() const { return setCol_; }
-    string setVal() const { return setVal_; }
+    static void parseShow(const Tokens& t, Statement& st)
+    {
+        // SHOW STATS | SHOW REPLICATION
+        if (t.size() != 2 || (!iequals(t[1], "STATS") && !iequals(t[1], "REPLICATION")))
+            return;
+
+        st.table = t[1];
+        st.kind = StmtKind::Show;
+    }
+
+    static void parseAnalyze(const Tokens& t, Statement& st)
+    {
+        // ANALYZE [TABLE] name
+        size_t k = (t.size() == 3 && iequals(t[1], "TABLE")) ? 2 : 1;
+        if (t.size() != k + 1)
+            return;
+
+        st.table = t[k];
+        st.kind = StmtKind::Analyze;
+    }
+
+    static void parseTransaction(const Tokens& t, Statement& st, StmtKind kind)
+    {
+        // BEGIN [TRANSACTION|WORK] | START TRANSACTION | COMMIT|END [TRANSACTION|WORK] | ROLLBACK [TRANSACTION|WORK]
+        bool start = iequals(t[0], "START");
+        if (t.size() > 2 || (start && t.size() != 2))
+            return;
+        if (t.size() == 2 && !iequals(t[1], "TRANSACTION") && (start || !iequals(t[1], "WORK")))
+            return;
+
+        st.kind = kind;
+    }
+
+    static const char* kindName(StmtKind k)
+    {
+        switch (k) {
+        case StmtKind::Create: return "CREATE";
+        case StmtKind::Insert: return "INSERT";
+        case StmtKind::Select: return "SELECT";
+        case StmtKind::Update: return "UPDATE";
+        case StmtKind::Delete: return "DELETE";
+        case StmtKind::Drop:   return "DROP";
+        case StmtKind::Show:   return "SHOW";
+        case StmtKind::Analyze: return "ANALYZE";
+        case StmtKind::Begin:  return "BEGIN";
+        case StmtKind::Commit: return "COMMIT";
+        case StmtKind::Rollback: return "ROLLBACK";
+        case StmtKind::Alter:  return "ALTER";
+        default:               return "";
+        }
+    }
+
+    // getters (these copy, use stmt() on hot paths)
+    const Statement& stmt() const { return stmt_; }
+    string cmd() const { return kindName(stmt_.kind); }
+    string table() const { return lowerCopy(stmt_.table); }
+    vector<string> columns() const
+    {
+        // CREATE: name:TYPE | SELECT: col list
+        vector<string> r;
+        if (stmt_.kind == StmtKind::Create) {
+            for (size_t i = 0; i + 1 < stmt_.cols.size(); i += 2)
+                r.push_back(lowerCopy(stmt_.cols[i]) + ":" + toUpper(string(stmt_.cols[i + 1])));
+        }
+        else {
+            for (auto c : stmt_.cols)
+                r.push_back(lowerCopy(c));
+        }
+        return r;
+    }
+    vector<string> values() const { return vector<string>(stmt_.vals.begin(), stmt_.vals.end()); }
+    bool valid() const { return stmt_.valid(); }
+    string whereCol() const { return lowerCopy(stmt_.whereCol); }
+    string whereOp() const { return string(stmt_.whereOp); }
+    string whereVal() const { return string(stmt_.whereVal); }
+    // first UPDATE assignment
+    string setCol() const { return stmt_.setCols.empty() ? string() : lowerCopy(stmt_.setCols[0]); }
+    string setVal() const { return stmt_.setExprs.empty() ? string() : string(stmt_.setExprs[0]); }
 };
 
-#endif // PARSER_H
\ No newline at end of file
+#endif // PARSER_H
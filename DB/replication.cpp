@@ -0,0 +1,366 @@
+#include "replication.h"
+
+#include <iostream>
+#include <unordered_map>
+#include <algorithm>
+#include <filesystem>
+#include "database.h"
+#include "server.h"
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+using namespace std;
+namespace fs = std::filesystem;
+
+#ifdef __linux__
+
+namespace {
+
+const size_t kFilePart = 1 << 20;   // snapshot bytes per 'F' frame
+
+vector<string> splitLines(string_view s) {
+    vector<string> out;
+    while (!s.empty()) {
+        size_t nl = s.find('\n');
+        out.emplace_back(s.substr(0, nl));
+        if (nl == string_view::npos)
+            break;
+        s.remove_prefix(nl + 1);
+    }
+    return out;
+}
+
+bool parseU64(string_view s, uint64_t& v) {
+    long long x = 0;
+    if (!parseInt64(s, x) || x < 0)
+        return false;
+    v = (uint64_t)x;
+    return true;
+}
+
+// 'L' body: "lsn ts", then one statement per line
+bool parseEntry(string_view body, uint64_t& lsn, int64_t& ts, vector<string>& sqls) {
+    size_t nl = body.find('\n');
+    string_view head = body.substr(0, nl);
+    size_t sp = head.find(' ');
+    uint64_t t = 0;
+    if (sp == string_view::npos || !parseU64(head.substr(0, sp), lsn) || !parseU64(head.substr(sp + 1), t))
+        return false;
+    ts = (int64_t)t;
+    sqls = nl == string_view::npos ? vector<string>() : splitLines(body.substr(nl + 1));
+    return true;
+}
+
+string absoluteDir(const string& dir) {
+    error_code ec;
+    fs::path p = fs::weakly_canonical(fs::absolute(dir, ec), ec);
+    return p.string();
+}
+
+} // namespace
+
+
+bool LogShipper::start(string& err) {
+    lfd_ = net::openSocket(addr_, true, err);
+    if (lfd_ < 0)
+        return false;
+
+    state_.role = ReplicationState::Primary;
+    state_.epoch = log_.epoch();
+    acceptor_ = thread([this] {
+        while (!stop_) {
+            int fd = accept4(lfd_, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                break;
+            }
+            lock_guard<mutex> lk(mu_);
+            if (stop_) {
+                close(fd);
+                break;
+            }
+            fds_.push_back(fd);
+            conns_.emplace_back([this, fd] {
+                serve(fd);
+                lock_guard<mutex> lk(mu_);
+                fds_.erase(find(fds_.begin(), fds_.end(), fd));
+                close(fd);
+            });
+        }
+    });
+    return true;
+}
+
+void LogShipper::stop() {
+    if (stop_.exchange(true) || lfd_ < 0)
+        return;
+
+    shutdown(lfd_, SHUT_RDWR);     // wakes accept()
+    acceptor_.join();
+    {
+        lock_guard<mutex> lk(mu_);
+        for (int fd : fds_)
+            shutdown(fd, SHUT_RDWR);
+    }
+    log_.wake();
+    for (auto& t : conns_)
+        t.join();
+    close(lfd_);
+    if (net::isUnixAddr(addr_))
+        unlink(addr_.c_str());
+    lfd_ = -1;
+}
+
+void LogShipper::serve(int fd) {
+    string in, hello, out;
+    if (!net::readFrame(fd, in, hello))
+        return;
+
+    size_t sp = hello.find(' ');
+    uint64_t epoch = 0, lsn = 0;
+    if (sp == string::npos || !parseU64(string_view(hello).substr(0, sp), epoch) || !parseU64(string_view(hello).substr(sp + 1), lsn))
+        return;
+
+    if (epoch != log_.epoch() || !log_.holds(lsn)) {
+        // the follower starts over from the current files
+        vector<pair<string, string>> files;
+        string err;
+        if (!db_.snapshot(files, lsn, err)) {
+            cerr << "replication: snapshot failed: " << err << "\n";
+            return;
+        }
+        proto::putFrame(out, 'S', to_string(log_.epoch()) + " " + to_string(lsn) + " " + absoluteDir(db_.catalog().folder()));
+        for (auto& [name, data] : files) {
+            size_t off = 0;
+            do {
+                size_t n = min(kFilePart, data.size() - off);
+                string body = name + "\n";
+                body.append(data, off, n);
+                proto::putFrame(out, 'F', body);
+                off += n;
+                if (out.size() >= kFilePart) {
+                    if (!net::writeAll(fd, out.data(), out.size()))
+                        return;
+                    out.clear();
+                }
+            } while (off < data.size());
+        }
+        proto::putFrame(out, 'E', "");
+        if (!net::writeAll(fd, out.data(), out.size()))
+            return;
+    }
+
+    ++state_.followers;
+    vector<LogEntry> entries;
+    while (!stop_) {
+        entries.clear();
+        if (!log_.since(lsn, entries, chrono::milliseconds(1000)))
+            break;      // fell behind what the log keeps, it reconnects and gets a snapshot
+
+        out.clear();
+        if (entries.empty())
+            proto::putFrame(out, 'H', to_string(log_.lsn()));
+        for (auto& e : entries) {
+            string body = to_string(e.lsn) + " " + to_string(e.ts);
+            for (auto& q : e.sqls) {
+                body += "\n";
+                body += q;
+            }
+            proto::putFrame(out, 'L', body);
+            lsn = e.lsn;
+        }
+        if (!net::writeAll(fd, out.data(), out.size()))
+            break;
+    }
+    --state_.followers;
+}
+
+
+void Replica::start() {
+    state_.role = ReplicationState::Follower;
+    th_ = thread([this] { run(); });
+}
+
+void Replica::stop() {
+    if (stop_.exchange(true))
+        return;
+    {
+        lock_guard<mutex> lk(mu_);
+        if (fd_ >= 0)
+            shutdown(fd_, SHUT_RDWR);
+    }
+    if (th_.joinable())
+        th_.join();
+}
+
+void Replica::run() {
+    bool warned = false;
+    while (!stop_) {
+        string err;
+        int fd = net::openSocket(state_.peer, false, err);
+        if (fd >= 0) {
+            {
+                lock_guard<mutex> lk(mu_);
+                fd_ = fd;
+            }
+            timeval tv{ 5, 0 };     // the primary sends at least a heartbeat a second
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+            string hello;
+            proto::putFrame(hello, 0, to_string(state_.epoch) + " " + to_string(state_.appliedLsn));
+            warned = false;
+            if (net::writeAll(fd, hello.data(), hello.size()) && !follow(fd))
+                stop_ = true;       // can't go on (see follow)
+            {
+                lock_guard<mutex> lk(mu_);
+                fd_ = -1;
+            }
+            close(fd);
+            state_.connected = false;
+        }
+        else if (!warned) {
+            cerr << "replica: " << err << ", retrying\n";
+            warned = true;
+        }
+
+        for (int i = 0; i < 10 && !stop_; ++i)
+            this_thread::sleep_for(chrono::milliseconds(100));
+    }
+}
+
+// applies frames until the connection breaks (true: reconnect) or the
+// primary can't be followed at all (false)
+bool Replica::follow(int fd) {
+    string in, f;
+    vector<pair<string, string>> files;     // snapshot being received
+    unordered_map<string, size_t> fileIdx;
+    uint64_t snapEpoch = 0, snapLsn = 0;
+
+    while (!stop_ && net::readFrame(fd, in, f)) {
+        if (f.empty())
+            return true;
+        state_.connected = true;
+        state_.contactTs = wallMicros();
+        string_view body = string_view(f).substr(1);
+
+        switch (f[0]) {
+        case 'S': {
+            size_t a = body.find(' '), b = a == string_view::npos ? a : body.find(' ', a + 1);
+            if (b == string_view::npos || !parseU64(body.substr(0, a), snapEpoch) || !parseU64(body.substr(a + 1, b - a - 1), snapLsn))
+                return true;
+            if (body.substr(b + 1) == absoluteDir(db_.catalog().folder())) {
+                cerr << "replica: the primary uses this process's own directory, not following\n";
+                return false;
+            }
+            files.clear();
+            fileIdx.clear();
+            break;
+        }
+        case 'F': {
+            size_t nl = body.find('\n');
+            if (nl == string_view::npos)
+                return true;
+            string name(body.substr(0, nl));
+            auto [it, fresh] = fileIdx.emplace(name, files.size());
+            if (fresh)
+                files.push_back({ name, string() });
+            files[it->second].second.append(body.substr(nl + 1));
+            break;
+        }
+        case 'E': {
+            size_t n = files.size();
+            string err;
+            if (!db_.restore(std::move(files), err)) {
+                cerr << "replica: " << err << "\n";
+                return false;
+            }
+            files.clear();
+            fileIdx.clear();
+            state_.epoch = snapEpoch;
+            state_.appliedLsn = snapLsn;
+            state_.primaryLsn = max<uint64_t>(state_.primaryLsn, snapLsn);
+            state_.appliedTs = wallMicros();
+            cerr << "replica: snapshot of " << n << " file(s) at lsn " << snapLsn << "\n";
+            break;
+        }
+        case 'L': {
+            uint64_t lsn = 0;
+            int64_t ts = 0;
+            vector<string> sqls;
+            if (!parseEntry(body, lsn, ts, sqls) || lsn != state_.appliedLsn + 1)
+                return true;    // out of step: reconnect from what was applied
+            bool txn = sqls.size() > 1;
+            if (!txn) {
+                // single statements already received behind it go in the same batch,
+                // so a burst of INSERTs is appended and saved together as on the primary
+                string_view next;
+                size_t used;
+                while ((used = proto::takeFrame(in, next)) != 0 && used != string_view::npos && next.size() > 1 && next[0] == 'L') {
+                    uint64_t l2 = 0;
+                    int64_t t2 = 0;
+                    vector<string> s2;
+                    if (!parseEntry(next.substr(1), l2, t2, s2) || l2 != lsn + 1 || s2.size() != 1)
+                        break;
+                    sqls.push_back(std::move(s2[0]));
+                    lsn = l2;
+                    ts = t2;
+                    in.erase(0, used);
+                }
+            }
+            string err;
+            if (!db_.applyLogged(sqls, txn, err))
+                cerr << "replica: lsn " << lsn << ": " << err << "\n";
+            state_.appliedLsn = lsn;
+            state_.appliedTs = ts;
+            state_.primaryLsn = max<uint64_t>(state_.primaryLsn, lsn);
+            break;
+        }
+        case 'H': {
+            uint64_t lsn = 0;
+            if (parseU64(body, lsn))
+                state_.primaryLsn = lsn;
+            break;
+        }
+        default:
+            return true;
+        }
+    }
+    return true;
+}
+
+#else // !__linux__
+
+bool LogShipper::start(string& err) {
+    err = "replication needs sockets and is only available on Linux";
+    return false;
+}
+
+void LogShipper::stop() {
+    stop_ = true;
+}
+
+void LogShipper::serve(int) {
+}
+
+void Replica::start() {
+    cerr << "replica: replication is only available on Linux\n";
+}
+
+void Replica::stop() {
+    stop_ = true;
+}
+
+void Replica::run() {
+}
+
+bool Replica::follow(int) {
+    return false;
+}
+
+#endif
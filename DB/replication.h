@@ -0,0 +1,181 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <cstdint>
+using namespace std;
+
+// log-shipping replication. The primary appends the text of every statement
+// that changed data to a ChangeLog, in the order the write lock ran them; a
+// committed transaction is one entry. Followers connect, take a snapshot of
+// the primary's ./db/ when the log no longer holds what they need, and replay
+// the entries in order. Followers answer SELECT, SHOW and EXPLAIN only.
+//
+// follower -> primary: one frame "epoch lsn", what the follower has applied (0 0 when nothing)
+// primary -> follower: frames whose status byte says what they hold
+//   'S' "epoch lsn dir"          a snapshot of the state at lsn follows
+//   'F' "name\n" bytes           part of one file of the snapshot, in order
+//   'E'                          end of the snapshot
+//   'L' "lsn ts\nsql\nsql..."    one entry (ts: commit time, us since 1970)
+//   'H' "lsn"                    heartbeat, once a second when nothing is written
+
+inline int64_t wallMicros()
+{
+    return chrono::duration_cast<chrono::microseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+struct LogEntry {
+    uint64_t lsn = 0;
+    int64_t ts = 0;
+    vector<string> sqls;
+
+    size_t bytes() const
+    {
+        size_t n = sizeof(LogEntry);
+        for (auto& s : sqls)
+            n += s.size() + sizeof(string);
+        return n;
+    }
+};
+
+// the newest entries within a memory budget. The epoch changes with every
+// primary process, a follower from an older one starts over from a snapshot.
+class ChangeLog {
+    mutable mutex mu_;
+    condition_variable cv_;
+    deque<LogEntry> entries_;
+    size_t bytes_ = 0;
+    size_t budget_;
+    uint64_t lsn_ = 0;
+    uint64_t epoch_;
+
+public:
+    explicit ChangeLog(size_t budget = 64u << 20) : budget_(budget)
+    {
+        epoch_ = (((uint64_t)random_device{}() << 32) ^ (uint64_t)wallMicros()) | 1;
+    }
+
+    uint64_t epoch() const { return epoch_; }
+
+    uint64_t lsn() const
+    {
+        lock_guard<mutex> lk(mu_);
+        return lsn_;
+    }
+
+    // called with the database write lock held, so lsns follow execution order
+    void append(vector<string> sqls)
+    {
+        {
+            lock_guard<mutex> lk(mu_);
+            entries_.push_back({ ++lsn_, wallMicros(), std::move(sqls) });
+            bytes_ += entries_.back().bytes();
+            while (bytes_ > budget_ && entries_.size() > 1) {
+                bytes_ -= entries_.front().bytes();
+                entries_.pop_front();
+            }
+        }
+        cv_.notify_all();
+    }
+
+    // true when every entry after `after` is still here
+    bool holds(uint64_t after) const
+    {
+        lock_guard<mutex> lk(mu_);
+        return after == lsn_ || (after < lsn_ && !entries_.empty() && entries_.front().lsn <= after + 1);
+    }
+
+    // copies up to max entries after `after` into out, waiting up to `wait` for
+    // the first one. false when they were dropped already (snapshot needed)
+    bool since(uint64_t after, vector<LogEntry>& out, chrono::milliseconds wait, size_t max = 256)
+    {
+        unique_lock<mutex> lk(mu_);
+        cv_.wait_for(lk, wait, [&] { return lsn_ > after; });
+        if (after >= lsn_)
+            return after == lsn_;
+        if (entries_.empty() || entries_.front().lsn > after + 1)
+            return false;
+        for (size_t i = (size_t)(after + 1 - entries_.front().lsn); i < entries_.size() && out.size() < max; ++i)
+            out.push_back(entries_[i]);
+        return true;
+    }
+
+    void wake() { cv_.notify_all(); }
+};
+
+// what SHOW REPLICATION reports, kept up to date by the replication threads
+struct ReplicationState {
+    enum Role { None, Primary, Follower };
+    Role role = None;
+    string peer;                        // follower: the primary's replication address
+    atomic<bool> connected{ false };
+    atomic<int> followers{ 0 };         // primary: connected followers
+    atomic<uint64_t> epoch{ 0 };
+    atomic<uint64_t> appliedLsn{ 0 };   // follower: last entry replayed
+    atomic<uint64_t> primaryLsn{ 0 };   // follower: newest entry the primary reported
+    atomic<int64_t> appliedTs{ 0 };     // follower: commit time of the last entry replayed
+    atomic<int64_t> contactTs{ 0 };     // follower: last frame from the primary
+};
+
+class Database;
+
+// primary side: accepts followers on addr, one thread streams the log to each
+class LogShipper {
+    Database& db_;
+    ChangeLog& log_;
+    ReplicationState& state_;
+    string addr_;
+    atomic<bool> stop_{ false };
+    int lfd_ = -1;
+    thread acceptor_;
+    mutex mu_;
+    vector<thread> conns_;
+    vector<int> fds_;
+
+    void serve(int fd);
+
+public:
+    LogShipper(Database& db, ChangeLog& log, ReplicationState& st, const string& addr)
+        : db_(db), log_(log), state_(st), addr_(addr) {}
+    ~LogShipper() { stop(); }
+
+    LogShipper(const LogShipper&) = delete;
+    LogShipper& operator=(const LogShipper&) = delete;
+
+    bool start(string& err);
+    void stop();
+};
+
+// follower side: keeps a connection to the primary, applies the snapshot and
+// the entries it sends, reconnects (from the last applied lsn) when it breaks
+class Replica {
+    Database& db_;
+    ReplicationState& state_;
+    atomic<bool> stop_{ false };
+    thread th_;
+    mutex mu_;
+    int fd_ = -1;
+
+    void run();
+    bool follow(int fd);
+
+public:
+    Replica(Database& db, ReplicationState& st) : db_(db), state_(st) {}
+    ~Replica() { stop(); }
+
+    Replica(const Replica&) = delete;
+    Replica& operator=(const Replica&) = delete;
+
+    void start();
+    void stop();
+};
+
+#endif // REPLICATION_H
@@ -0,0 +1,99 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <string>
+#include <string_view>
+#include <list>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstddef>
+#include "stats.h"
+using namespace std;
+
+// LRU cache of SELECT results within a memory budget. A key holds the
+// normalized statement and the version of the table it read; any change to
+// the table gives it a new version, so its old entries are never looked up
+// again and simply age out. Entries are shared, a hit is copied outside the lock.
+template <class V>
+class ResultCache {
+    struct Entry {
+        string key;
+        shared_ptr<const V> value;
+        size_t bytes;
+    };
+
+    list<Entry> lru_;       // most recent first
+    unordered_map<string_view, typename list<Entry>::iterator> index_;     // views into Entry::key
+    atomic<size_t> budget_{ 0 };
+    size_t used_ = 0;
+    mutable mutex mu_;
+
+    void evictTo(size_t limit)
+    {
+        while (used_ > limit && !lru_.empty()) {
+            Entry& e = lru_.back();
+            used_ -= e.bytes;
+            index_.erase(e.key);
+            lru_.pop_back();
+            metrics::add(metrics::ResultCacheEvictions);
+        }
+    }
+
+public:
+    // 0 turns the cache off and empties it
+    void setBudget(size_t bytes)
+    {
+        lock_guard<mutex> lk(mu_);
+        budget_ = bytes;
+        evictTo(bytes);
+    }
+
+    bool enabled() const { return budget_ > 0; }
+
+    shared_ptr<const V> get(const string& key)
+    {
+        lock_guard<mutex> lk(mu_);
+        auto it = index_.find(key);
+        if (it == index_.end()) {
+            metrics::add(metrics::ResultCacheMisses);
+            return nullptr;
+        }
+        lru_.splice(lru_.begin(), lru_, it->second);
+        metrics::add(metrics::ResultCacheHits);
+        return it->second->value;
+    }
+
+    // results larger than an eighth of the budget are not kept
+    void put(string key, V value, size_t bytes)
+    {
+        bytes += key.size() + sizeof(Entry) + 64;
+        size_t budget = budget_;
+        if (bytes > budget / 8)
+            return;
+
+        auto v = make_shared<const V>(std::move(value));
+        lock_guard<mutex> lk(mu_);
+        if (index_.count(key))
+            return;     // another thread got there first
+        lru_.push_front({ std::move(key), std::move(v), bytes });
+        index_.emplace(lru_.front().key, lru_.begin());
+        used_ += bytes;
+        evictTo(budget);
+    }
+
+    size_t bytes() const
+    {
+        lock_guard<mutex> lk(mu_);
+        return used_;
+    }
+
+    size_t entries() const
+    {
+        lock_guard<mutex> lk(mu_);
+        return lru_.size();
+    }
+};
+
+#endif // RESULT_CACHE_H
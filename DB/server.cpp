@@ -0,0 +1,546 @@
+#include "server.h"
+
+#include <iostream>
+#include <unordered_map>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include "thread_pool.h"
+#include "coordinator.h"
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+using namespace std;
+
+
+void Server::render(const ResultSet& rs, string& out) {
+    if (!rs.hasRows()) {
+        proto::putFrame(out, rs.ok() ? '+' : '-', rs.message());
+        return;
+    }
+    ResultWriter w(nullptr, opt_.format);
+    w.write(rs);
+    proto::putFrame(out, '+', w.take());
+}
+
+void Server::handle(const vector<string>& reqs, string& out, Session& session) {
+    vector<Statement> sts(reqs.size());
+    for (size_t i = 0; i < reqs.size(); ++i)
+        Parse::parseStatement(reqs[i], sts[i]); // invalid ones stay StmtKind::None
+
+    size_t answered = 0;
+    auto reply = [&](size_t, const ResultSet& rs) {
+        render(rs, out);
+        ++answered;
+    };
+    try {
+        if (coord_)
+            coord_->executeBatch(sts.data(), sts.size(), reply);
+        else
+            db_.executeBatch(sts.data(), sts.size(), session, reply);
+    }
+    catch (const exception& ex) {
+        // the failing statement and everything after it get the error
+        for (; answered < reqs.size(); ++answered)
+            proto::putFrame(out, '-', string("Error: ") + ex.what());
+    }
+}
+
+#ifdef __linux__
+
+namespace net {
+
+bool isUnixAddr(const string& addr) {
+    return addr.find('/') != string::npos;
+}
+
+int openSocket(const string& addr, bool listening, string& err) {
+    int fd = -1;
+
+    if (isUnixAddr(addr)) {
+        sockaddr_un sa{};
+        sa.sun_family = AF_UNIX;
+        if (addr.size() >= sizeof(sa.sun_path)) {
+            err = "socket path too long";
+            return -1;
+        }
+        memcpy(sa.sun_path, addr.c_str(), addr.size() + 1);
+
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            err = strerror(errno);
+            return -1;
+        }
+
+        if (listening) {
+            unlink(addr.c_str());
+            if (bind(fd, (sockaddr*)&sa, sizeof(sa)) < 0 || listen(fd, 128) < 0) {
+                err = addr + ": " + strerror(errno);
+                close(fd);
+                return -1;
+            }
+        }
+        else if (connect(fd, (sockaddr*)&sa, sizeof(sa)) < 0) {
+            err = addr + ": " + strerror(errno);
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    long long port = 0;
+    if (!parseInt64(addr, port) || port <= 0 || port > 65535) {
+        err = "bad address '" + addr + "' (expected a socket path or a port)";
+        return -1;
+    }
+
+    sockaddr_in sa{};
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons((uint16_t)port);
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        err = strerror(errno);
+        return -1;
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (listening) {
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, (sockaddr*)&sa, sizeof(sa)) < 0 || listen(fd, 128) < 0) {
+            err = "port " + addr + ": " + strerror(errno);
+            close(fd);
+            return -1;
+        }
+    }
+    else if (connect(fd, (sockaddr*)&sa, sizeof(sa)) < 0) {
+        err = "port " + addr + ": " + strerror(errno);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool writeAll(int fd, const char* p, size_t n) {
+    while (n > 0) {
+        ssize_t w = send(fd, p, n, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR)
+            continue;
+        if (w <= 0)
+            return false;
+        p += w;
+        n -= (size_t)w;
+    }
+    return true;
+}
+
+bool readFrame(int fd, string& buf, string& payload) {
+    char tmp[64 * 1024];
+    while (true) {
+        string_view p;
+        size_t used = proto::takeFrame(buf, p);
+        if (used == string_view::npos)
+            return false;
+        if (used > 0) {
+            payload.assign(p);
+            buf.erase(0, used);
+            return true;
+        }
+        ssize_t r = recv(fd, tmp, sizeof(tmp), 0);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0)
+            return false;
+        buf.append(tmp, (size_t)r);
+    }
+}
+
+} // namespace net
+
+using namespace net;
+
+namespace {
+
+void setNonBlocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+// per connection state, only touched by the event loop thread
+struct Conn {
+    int fd = -1;
+    uint64_t id = 0;
+    string in;              // bytes received, not yet framed
+    deque<string> pending;  // complete requests waiting for a worker
+    string out;             // response bytes not yet sent
+    bool busy = false;      // a worker is running a batch of our requests
+    bool eof = false;       // peer finished sending, answer what is queued then close
+    bool closing = false;   // connection broken or protocol error
+    unique_ptr<Session> session = make_unique<Session>();   // open transaction dies with the connection
+    uint32_t mask = EPOLLIN;
+};
+
+struct Completion {
+    int fd;
+    uint64_t id;
+    string response;
+};
+
+} // namespace
+
+
+void Server::stop() {
+    stop_ = true;
+    if (wakeFd_ >= 0) {
+        uint64_t one = 1;
+        ssize_t r = write(wakeFd_, &one, sizeof(one));
+        (void)r;
+    }
+}
+
+bool Server::run(string& err) {
+    int lfd = openSocket(opt_.addr, true, err);
+    if (lfd < 0)
+        return false;
+    setNonBlocking(lfd);
+
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = lfd;
+    epoll_ctl(ep, EPOLL_CTL_ADD, lfd, &ev);
+    ev.data.fd = wakeFd_;
+    epoll_ctl(ep, EPOLL_CTL_ADD, wakeFd_, &ev);
+
+    mutex doneMu;
+    vector<Completion> done;
+
+    unique_ptr<ThreadPool> pool = make_unique<ThreadPool>(opt_.threads);
+    unordered_map<int, Conn> conns;
+    uint64_t nextId = 1;
+
+    auto updateInterest = [&](Conn& c) {
+        uint32_t mask = (c.eof ? 0u : (uint32_t)EPOLLIN) | (c.out.empty() ? 0u : (uint32_t)EPOLLOUT);
+        if (mask == c.mask)
+            return;
+        c.mask = mask;
+        epoll_event e{};
+        e.events = mask;
+        e.data.fd = c.fd;
+        epoll_ctl(ep, EPOLL_CTL_MOD, c.fd, &e);
+    };
+
+    auto flushOut = [&](Conn& c) {
+        while (!c.out.empty()) {
+            ssize_t w = send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+            if (w > 0) {
+                c.out.erase(0, (size_t)w);
+                continue;
+            }
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                break;
+            c.closing = true;
+            c.out.clear();
+            break;
+        }
+        updateInterest(c);
+    };
+
+    // hand everything queued on c to the pool as one batch; one batch per
+    // connection runs at a time so responses go back in request order
+    auto dispatch = [&](Conn& c) {
+        if (c.busy || c.closing || c.pending.empty())
+            return;
+
+        c.busy = true;
+        int fd = c.fd;
+        uint64_t id = c.id;
+        Session* session = c.session.get();     // c is not erased while busy
+        vector<string> reqs(make_move_iterator(c.pending.begin()), make_move_iterator(c.pending.end()));
+        c.pending.clear();
+
+        pool->submit([this, fd, id, session, reqs = std::move(reqs), &doneMu, &done] {
+            string resp;
+            handle(reqs, resp, *session);
+            {
+                lock_guard<mutex> lk(doneMu);
+                done.push_back({ fd, id, std::move(resp) });
+            }
+            uint64_t one = 1;
+            ssize_t r = write(wakeFd_, &one, sizeof(one));
+            (void)r;
+        });
+    };
+
+    auto maybeClose = [&](int fd) {
+        auto it = conns.find(fd);
+        if (it == conns.end())
+            return;
+        Conn& c = it->second;
+        if (!c.busy && (c.closing || (c.eof && c.pending.empty() && c.out.empty()))) {
+            epoll_ctl(ep, EPOLL_CTL_DEL, fd, nullptr);
+            close(fd);
+            conns.erase(it);
+        }
+    };
+
+    vector<epoll_event> events(256);
+
+    // wake up once a second to refresh the stats dump, otherwise sleep until there is work
+    bool dumping = !db_.statsFile().empty() && opt_.statsInterval > 0;
+    auto lastDump = chrono::steady_clock::now();
+
+    while (!stop_) {
+        int n = epoll_wait(ep, events.data(), (int)events.size(), dumping ? 1000 : -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            err = strerror(errno);
+            break;
+        }
+
+        if (dumping && chrono::steady_clock::now() - lastDump >= chrono::seconds(opt_.statsInterval)) {
+            string dumpErr;
+            if (!db_.dumpStats(dumpErr))
+                fprintf(stderr, "stats: %s\n", dumpErr.c_str());
+            lastDump = chrono::steady_clock::now();
+        }
+
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+
+            if (fd == lfd) {
+                while (true) {
+                    int cfd = accept4(lfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                    if (cfd < 0)
+                        break;
+
+                    Conn& c = conns[cfd];
+                    c = Conn();
+                    c.fd = cfd;
+                    c.id = nextId++;
+
+                    epoll_event e{};
+                    e.events = EPOLLIN;
+                    e.data.fd = cfd;
+                    epoll_ctl(ep, EPOLL_CTL_ADD, cfd, &e);
+                }
+                continue;
+            }
+
+            if (fd == wakeFd_) {
+                uint64_t cnt;
+                ssize_t r = read(wakeFd_, &cnt, sizeof(cnt));
+                (void)r;
+
+                vector<Completion> ready;
+                {
+                    lock_guard<mutex> lk(doneMu);
+                    ready.swap(done);
+                }
+                for (auto& d : ready) {
+                    auto it = conns.find(d.fd);
+                    if (it == conns.end() || it->second.id != d.id)
+                        continue;
+                    Conn& c = it->second;
+                    c.busy = false;
+                    if (!c.closing) {
+                        c.out += d.response;
+                        flushOut(c);
+                        dispatch(c);
+                    }
+                    maybeClose(d.fd);
+                }
+                continue;
+            }
+
+            auto it = conns.find(fd);
+            if (it == conns.end())
+                continue;
+            Conn& c = it->second;
+
+            if (events[i].events & EPOLLOUT)
+                flushOut(c);
+
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                char buf[64 * 1024];
+                while (true) {
+                    ssize_t r = recv(fd, buf, sizeof(buf), 0);
+                    if (r > 0) {
+                        c.in.append(buf, (size_t)r);
+                        continue;
+                    }
+                    if (r < 0 && errno == EINTR)
+                        continue;
+                    if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                        break;
+                    if (r == 0 && !(events[i].events & (EPOLLHUP | EPOLLERR)))
+                        c.eof = true;
+                    else
+                        c.closing = true;
+                    break;
+                }
+
+                size_t pos = 0;
+                while (true) {
+                    string_view payload;
+                    size_t used = proto::takeFrame(string_view(c.in).substr(pos), payload);
+                    if (used == 0)
+                        break;
+                    if (used == string_view::npos) {
+                        c.closing = true;
+                        break;
+                    }
+                    c.pending.emplace_back(payload);
+                    pos += used;
+                }
+                c.in.erase(0, pos);
+
+                dispatch(c);
+                updateInterest(c);
+            }
+            maybeClose(fd);
+        }
+    }
+
+    pool.reset(); // let running statements finish before the fds go away
+
+    if (dumping) {
+        string dumpErr;
+        if (!db_.dumpStats(dumpErr))
+            fprintf(stderr, "stats: %s\n", dumpErr.c_str());
+    }
+
+    for (auto& p : conns)
+        close(p.first);
+    close(lfd);
+    close(ep);
+    close(wakeFd_);
+    wakeFd_ = -1;
+    if (isUnixAddr(opt_.addr))
+        unlink(opt_.addr.c_str());
+    return err.empty();
+}
+
+int runClient(const string& addr, size_t pipeline) {
+    string err;
+    int fd = openSocket(addr, false, err);
+    if (fd < 0) {
+        cerr << "connect: " << err << "\n";
+        return 1;
+    }
+    if (pipeline == 0)
+        pipeline = 1;
+
+    string line, frames, in;
+    size_t inFlight = 0;
+    bool inputDone = false;
+    char buf[64 * 1024];
+
+    // prints one response, returns false if the stream is broken
+    auto readResponse = [&]() -> bool {
+        while (true) {
+            string_view payload;
+            size_t used = proto::takeFrame(in, payload);
+            if (used == string_view::npos) {
+                cerr << "bad response frame\n";
+                return false;
+            }
+            if (used > 0) {
+                if (!payload.empty()) {
+                    ostream& os = payload[0] == '-' ? cerr : cout;
+                    os << payload.substr(1);
+                    if (payload.size() > 1 && payload.back() != '\n')
+                        os << "\n";
+                }
+                in.erase(0, used);
+                return true;
+            }
+            ssize_t r = recv(fd, buf, sizeof(buf), 0);
+            if (r < 0 && errno == EINTR)
+                continue;
+            if (r <= 0) {
+                cerr << "connection lost\n";
+                return false;
+            }
+            in.append(buf, (size_t)r);
+        }
+    };
+
+    while (!inputDone || inFlight > 0) {
+        // queue up to the window, then send it in one write
+        frames.clear();
+        while (!inputDone && inFlight < pipeline) {
+            if (!getline(cin, line)) {
+                inputDone = true;
+                break;
+            }
+            string_view sql = trimView(line);
+            if (sql.empty() || sql.substr(0, 2) == "--")
+                continue;
+            if (iequals(sql, "EXIT")) {
+                inputDone = true;
+                break;
+            }
+            proto::putFrame(frames, 0, sql);
+            ++inFlight;
+        }
+
+        if (!frames.empty() && !writeAll(fd, frames.data(), frames.size())) {
+            cerr << "connection lost\n";
+            close(fd);
+            return 1;
+        }
+
+        // drain half the window (everything once input is done) before sending more
+        size_t keep = inputDone ? 0 : pipeline / 2;
+        while (inFlight > keep) {
+            if (!readResponse()) {
+                close(fd);
+                return 1;
+            }
+            --inFlight;
+        }
+    }
+
+    close(fd);
+    return 0;
+}
+
+#else // !__linux__
+
+void Server::stop() {
+    stop_ = true;
+}
+
+bool Server::run(string& err) {
+    err = "server mode needs epoll and is only available on Linux";
+    return false;
+}
+
+int runClient(const string& addr, size_t pipeline) {
+    cerr << "client mode is only available on Linux\n";
+    return 1;
+}
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <atomic>
+#include "database.h"
+#include "output.h"
+using namespace std;
+
+// wire protocol (all lengths are 4 byte big-endian):
+//   request  = len, SQL text (len bytes)
+//   response = len, status byte ('+' ok / '-' error), body (len - 1 bytes)
+// the body is the statement message, or its rows rendered in the server's format.
+namespace proto {
+    const size_t kMaxFrame = 64u << 20;
+
+    inline void putFrame(string& out, char status, string_view body)
+    {
+        uint32_t len = (uint32_t)body.size() + (status ? 1 : 0);
+        char hdr[4] = { (char)(len >> 24), (char)(len >> 16), (char)(len >> 8), (char)len };
+        out.append(hdr, 4);
+        if (status)
+            out.push_back(status);
+        out.append(body);
+    }
+
+    // returns bytes consumed (0 if no complete frame yet, npos if the frame is too large)
+    inline size_t takeFrame(string_view in, string_view& payload)
+    {
+        if (in.size() < 4)
+            return 0;
+
+        uint32_t len = ((uint32_t)(unsigned char)in[0] << 24) | ((uint32_t)(unsigned char)in[1] << 16)
+            | ((uint32_t)(unsigned char)in[2] << 8) | (uint32_t)(unsigned char)in[3];
+
+        if (len > kMaxFrame)
+            return string_view::npos;
+
+        if (in.size() < 4 + (size_t)len)
+            return 0;
+
+        payload = in.substr(4, len);
+        return 4 + (size_t)len;
+    }
+}
+
+// ADDR is either a unix socket path (contains '/') or a TCP port on 127.0.0.1.
+// Blocking socket helpers, also used by replication (Linux only)
+namespace net {
+    bool isUnixAddr(const string& addr);
+
+    // listening: binds and listens on addr, otherwise connects to it. -1 and err on failure
+    int openSocket(const string& addr, bool listening, string& err);
+
+    bool writeAll(int fd, const char* p, size_t n);
+
+    // reads until buf holds a whole frame and moves its payload out (status
+    // byte included), false on EOF, error, timeout or an oversized frame
+    bool readFrame(int fd, string& buf, string& payload);
+}
+
+struct ServerOptions {
+    string addr = "/tmp/minidb.sock";
+    size_t threads = 4;
+    OutputFormat format = OutputFormat::Tsv;
+    int statsInterval = 10;     // seconds between stats dumps, when the Database has a stats file
+};
+
+// one event loop thread (epoll) owns all sockets and frames the requests,
+// statements run on a worker pool against the shared Database. Clients may
+// pipeline: everything a connection has queued goes to one worker as a batch,
+// which runs it in order (see Database::executeBatch) and answers in order.
+class Coordinator;
+
+class Server {
+    Database& db_;
+    Coordinator* coord_ = nullptr;
+    ServerOptions opt_;
+    atomic<bool> stop_{ false };
+    int wakeFd_ = -1;
+
+public:
+    Server(Database& db, const ServerOptions& opt) : db_(db), opt_(opt) {}
+
+    // coordinator mode: statements go to the shards instead of db
+    void setCoordinator(Coordinator* c) { coord_ = c; }
+
+    // blocks until stop() is called, returns false if the socket could not be set up
+    bool run(string& err);
+    void stop();
+
+    // runs the queued request payloads of one connection in order and appends
+    // one response frame per request to out
+    void handle(const vector<string>& reqs, string& out, Session& session);
+
+private:
+    void render(const ResultSet& rs, string& out);
+};
+
+// client side: sends every non-empty stdin line as a request and prints the
+// replies in order. Up to `pipeline` requests are in flight at once.
+int runClient(const string& addr, size_t pipeline = 64);
+
+#endif // SERVER_H
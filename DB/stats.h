@@ -0,0 +1,175 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cmath>
+#include <bit>
+#include <algorithm>
+using namespace std;
+
+// engine-wide counters and latency histograms.
+// Every thread bumps its own block (relaxed stores, no shared cache lines),
+// snapshot() sums the blocks of all live threads plus those that already exited.
+namespace metrics {
+
+enum Counter {
+    RowsScanned, RowsReturned, BytesRead, BytesWritten,
+    TableLoads, TableSaves, CatalogHits, CatalogMisses,
+    ResultCacheHits, ResultCacheMisses, ResultCacheEvictions,
+    Compactions, RowsCompacted,
+    kCounters
+};
+
+inline const char* counterName(int c) {
+    static const char* names[kCounters] = {
+        "rows_scanned", "rows_returned", "file_bytes_read", "file_bytes_written",
+        "table_loads", "table_saves", "catalog_hits", "catalog_misses",
+        "result_cache_hits", "result_cache_misses", "result_cache_evictions",
+        "compactions", "rows_compacted"
+    };
+    return names[c];
+}
+
+const int kKinds = 16;      // indexed by (int)StmtKind
+const int kBuckets = 496;   // log-linear: 8 sub-buckets per power of two of nanoseconds
+
+// HDR-style bucket: values below 8 ns are exact, above that each power of two
+// is split into 8 linear steps (at most 12.5% relative error)
+inline int bucketOf(uint64_t ns) {
+    if (ns < 8)
+        return (int)ns;
+    int msb = 63 - countl_zero(ns);
+    int sub = (int)((ns >> (msb - 3)) & 7);
+    return (msb - 2) * 8 + sub;
+}
+
+inline uint64_t bucketLow(int b) {
+    if (b < 8)
+        return (uint64_t)b;
+    int msb = b / 8 + 2;
+    return (uint64_t)(8 + b % 8) << (msb - 3);
+}
+
+struct Block {
+    atomic<uint64_t> counters[kCounters];
+    atomic<uint64_t> statements[kKinds];
+    atomic<uint64_t> sumNs[kKinds];
+    atomic<uint64_t> maxNs[kKinds];
+    atomic<uint64_t> hist[kKinds][kBuckets];
+};
+
+struct Snapshot {
+    uint64_t counters[kCounters] = {};
+    uint64_t statements[kKinds] = {};
+    uint64_t sumNs[kKinds] = {};
+    uint64_t maxNs[kKinds] = {};
+    vector<uint64_t> hist[kKinds];
+
+    // latency at quantile q (0..1) in nanoseconds, from the histogram
+    uint64_t quantileNs(int kind, double q) const {
+        uint64_t total = statements[kind];
+        if (total == 0 || hist[kind].empty())
+            return 0;
+        // nearest rank: the smallest value with at least q of the samples at or below it
+        uint64_t want = max<uint64_t>(1, (uint64_t)ceil(q * (double)total)), seen = 0;
+        for (int b = 0; b < kBuckets; ++b) {
+            seen += hist[kind][b];
+            if (seen >= want)
+                return min(b + 1 < kBuckets ? bucketLow(b + 1) - 1 : bucketLow(b), maxNs[kind]);
+        }
+        return maxNs[kind];
+    }
+};
+
+struct Registry {
+    mutex mu;
+    vector<Block*> live;
+    Block retired{};    // totals of threads that exited
+};
+
+inline Registry& registry() {
+    static Registry r;
+    return r;
+}
+
+inline void fold(Snapshot& s, const Block& b) {
+    for (int c = 0; c < kCounters; ++c)
+        s.counters[c] += b.counters[c].load(memory_order_relaxed);
+    for (int k = 0; k < kKinds; ++k) {
+        s.statements[k] += b.statements[k].load(memory_order_relaxed);
+        s.sumNs[k] += b.sumNs[k].load(memory_order_relaxed);
+        s.maxNs[k] = max(s.maxNs[k], b.maxNs[k].load(memory_order_relaxed));
+        if (s.hist[k].empty())
+            s.hist[k].assign(kBuckets, 0);
+        for (int i = 0; i < kBuckets; ++i)
+            s.hist[k][i] += b.hist[k][i].load(memory_order_relaxed);
+    }
+}
+
+// owner-only increment: a relaxed load+store, cheaper than fetch_add
+inline void bump(atomic<uint64_t>& a, uint64_t n) {
+    a.store(a.load(memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+struct LocalBlock {
+    Block* b;
+
+    LocalBlock() : b(new Block()) {
+        Registry& r = registry();
+        lock_guard<mutex> lk(r.mu);
+        r.live.push_back(b);
+    }
+
+    ~LocalBlock() {
+        Registry& r = registry();
+        lock_guard<mutex> lk(r.mu);
+        for (int c = 0; c < kCounters; ++c)
+            r.retired.counters[c] += b->counters[c].load();
+        for (int k = 0; k < kKinds; ++k) {
+            r.retired.statements[k] += b->statements[k].load();
+            r.retired.sumNs[k] += b->sumNs[k].load();
+            r.retired.maxNs[k] = max(r.retired.maxNs[k].load(), b->maxNs[k].load());
+            for (int i = 0; i < kBuckets; ++i)
+                r.retired.hist[k][i] += b->hist[k][i].load();
+        }
+        r.live.erase(find(r.live.begin(), r.live.end(), b));
+        delete b;
+    }
+};
+
+inline Block& local() {
+    thread_local LocalBlock lb;
+    return *lb.b;
+}
+
+inline void add(Counter c, uint64_t n = 1) {
+    bump(local().counters[c], n);
+}
+
+// one finished statement of the given kind
+inline void statement(int kind, uint64_t ns) {
+    Block& b = local();
+    bump(b.statements[kind], 1);
+    bump(b.sumNs[kind], ns);
+    bump(b.hist[kind][bucketOf(ns)], 1);
+    if (ns > b.maxNs[kind].load(memory_order_relaxed))
+        b.maxNs[kind].store(ns, memory_order_relaxed);
+}
+
+inline Snapshot snapshot() {
+    Snapshot s;
+    Registry& r = registry();
+    lock_guard<mutex> lk(r.mu);
+    fold(s, r.retired);
+    for (Block* b : r.live)
+        fold(s, *b);
+    return s;
+}
+
+} // namespace metrics
+
+#endif // STATS_H
@@ -0,0 +1,301 @@
+#ifndef TABLE_STATS_H
+#define TABLE_STATS_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <bit>
+#include "utils.h"
+#include "value_type.h"
+using namespace std;
+
+// FNV-1a with a splitmix64 finish, so every bit of the result is well mixed
+inline uint64_t hash64(string_view s) {
+    uint64_t h = 1469598103934665603ull;
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 27; h *= 0x94d049bb133111ebull;
+    h ^= h >> 31;
+    return h;
+}
+
+// distinct count estimate in 1 KiB per column (about 3% standard error)
+class HyperLogLog {
+    static constexpr int kBits = 10;
+    static constexpr int kRegs = 1 << kBits;
+    vector<uint8_t> regs_ = vector<uint8_t>(kRegs, 0);
+
+public:
+    void add(string_view v) {
+        uint64_t h = hash64(v);
+        int idx = (int)(h >> (64 - kBits));
+        uint64_t rest = (h << kBits) | (1ull << (kBits - 1)); // guard bit caps the rank
+        uint8_t rank = (uint8_t)(countl_zero(rest) + 1);
+        if (rank > regs_[idx])
+            regs_[idx] = rank;
+    }
+
+    double estimate() const {
+        double m = kRegs, sum = 0;
+        int zeros = 0;
+        for (uint8_t r : regs_) {
+            sum += ldexp(1.0, -r);
+            if (r == 0)
+                ++zeros;
+        }
+        double e = (0.7213 / (1 + 1.079 / m)) * m * m / sum;
+        if (e <= 2.5 * m && zeros > 0)
+            e = m * log(m / zeros);   // small range correction (linear counting)
+        return e;
+    }
+
+    string toHex() const {
+        static const char* digits = "0123456789abcdef";
+        string s;
+        s.reserve(kRegs * 2);
+        for (uint8_t r : regs_) {
+            s.push_back(digits[r >> 4]);
+            s.push_back(digits[r & 15]);
+        }
+        return s;
+    }
+
+    bool fromHex(string_view s) {
+        if ((int)s.size() != kRegs * 2)
+            return false;
+        auto val = [](char c) { return c <= '9' ? c - '0' : c - 'a' + 10; };
+        for (int i = 0; i < kRegs; ++i)
+            regs_[i] = (uint8_t)(val(s[2 * i]) * 16 + val(s[2 * i + 1]));
+        return true;
+    }
+};
+
+struct ColumnStats {
+    bool isInt = false;         // fixed-width column: min / max / bounds hold keys
+    ValueType type = ValueType::String;
+    HyperLogLog ndv;
+    bool empty = true;
+    long long minI = 0, maxI = 0;
+    string minS, maxS;
+    vector<long long> bounds;   // isInt only: equi-depth histogram, bounds.size()-1 buckets of equal row count
+
+    void setType(ValueType t) {
+        type = t;
+        isInt = isFixedWidth(t);
+    }
+
+    void observe(string_view v) {
+        ndv.add(v);
+        if (isInt) {
+            long long x = 0;
+            if (!encodeValue(type, v, x))
+                return;
+            if (empty || x < minI) minI = x;
+            if (empty || x > maxI) maxI = x;
+        }
+        else {
+            if (empty || v < minS) minS = string(v);
+            if (empty || v > maxS) maxS = string(v);
+        }
+        empty = false;
+    }
+
+    // fraction of rows with value <= x, from the histogram
+    double fractionAtMost(long long x) const {
+        if (bounds.size() < 2)
+            return (maxI > minI) ? clamp((double)(x - minI) / (double)(maxI - minI), 0.0, 1.0) : (x >= minI ? 1.0 : 0.0);
+        if (x < bounds.front())
+            return 0;
+        if (x >= bounds.back())
+            return 1;
+
+        size_t buckets = bounds.size() - 1;
+        size_t i = (size_t)(upper_bound(bounds.begin(), bounds.end(), x) - bounds.begin()) - 1;
+        double lo = (double)bounds[i], hi = (double)bounds[i + 1];
+        double within = hi > lo ? ((double)x - lo) / (hi - lo) : 1.0;
+        return ((double)i + within) / (double)buckets;
+    }
+};
+
+// per-table statistics collected by ANALYZE and persisted next to the table
+// file (<table>.stats). Inserts keep rows, NDV and min/max current; the
+// histogram is only rebuilt by the next ANALYZE.
+class TableStats {
+    bool analyzed_ = false;
+    long long rows_ = 0;
+    vector<ColumnStats> cols_;
+
+public:
+    static constexpr int kHistogramBuckets = 32;
+
+    bool analyzed() const { return analyzed_; }
+    long long rows() const { return rows_; }
+    const vector<ColumnStats>& columns() const { return cols_; }
+
+    void clear() {
+        analyzed_ = false;
+        rows_ = 0;
+        cols_.clear();
+    }
+
+    // cell(r, c) returns the value of row r, column c as text
+    template <class CellFn>
+    void build(const vector<string>& types, int rows, CellFn cell) {
+        clear();
+        cols_.resize(types.size());
+        for (size_t c = 0; c < types.size(); ++c)
+            cols_[c].setType(valueTypeOf(types[c]));
+
+        rows_ = rows;
+        for (int r = 0; r < rows; ++r)
+            for (size_t c = 0; c < cols_.size(); ++c)
+                cols_[c].observe(cell(r, (int)c));
+
+        for (size_t c = 0; c < cols_.size(); ++c) {
+            if (!cols_[c].isInt || rows == 0)
+                continue;
+            vector<long long> v;
+            v.reserve(rows);
+            for (int r = 0; r < rows; ++r) {
+                long long x = 0;
+                if (encodeValue(cols_[c].type, cell(r, (int)c), x))
+                    v.push_back(x);
+            }
+            if (v.empty())
+                continue;
+            sort(v.begin(), v.end());
+            size_t b = min<size_t>(kHistogramBuckets, v.size());
+            for (size_t i = 0; i <= b; ++i)
+                cols_[c].bounds.push_back(v[min(v.size() - 1, i * v.size() / b)]);
+            cols_[c].bounds.back() = v.back();
+        }
+        analyzed_ = true;
+    }
+
+    void observe(const vector<string>& row) {
+        ++rows_;
+        for (size_t c = 0; c < cols_.size() && c < row.size(); ++c)
+            cols_[c].observe(row[c]);
+    }
+
+    void setRows(long long n) { rows_ = n; }
+
+    // ALTER TABLE: a column added with every row holding v, or one dropped
+    void addColumn(ValueType t, string_view v) {
+        ColumnStats c;
+        c.setType(t);
+        if (rows_ > 0)
+            c.observe(v);
+        cols_.push_back(std::move(c));
+    }
+    void dropColumn(int c) { cols_.erase(cols_.begin() + c); }
+
+    double distinct(int col) const {
+        return max(1.0, min(cols_[col].ndv.estimate(), (double)max(1LL, rows_)));
+    }
+
+    // estimated fraction of rows matching "col op val", -1 when unknown
+    double selectivity(int col, string_view op, string_view val) const {
+        if (!analyzed_ || col < 0 || col >= (int)cols_.size())
+            return -1;
+        const ColumnStats& cs = cols_[col];
+        if (rows_ == 0 || cs.empty)
+            return 0;
+
+        long long x = 0;
+        bool num = cs.isInt && encodeValue(cs.type, val, x);
+        if (!num && op != "=")
+            return cs.isInt ? 0 : -1;   // keys vs text only compare with =, numbers in STRING columns are unknown
+
+        bool inRange = num ? (x >= cs.minI && x <= cs.maxI) : (val >= cs.minS && val <= cs.maxS);
+        double eq = inRange ? 1.0 / distinct(col) : 0.0;
+
+        double s;
+        if (op == "=") s = eq;
+        else if (op == "!=") s = 1.0 - eq;
+        else if (op == "<=") s = cs.fractionAtMost(x);
+        else if (op == "<") s = cs.fractionAtMost(x) - eq;
+        else if (op == ">") s = 1.0 - cs.fractionAtMost(x);
+        else if (op == ">=") s = 1.0 - cs.fractionAtMost(x) + eq;
+        else s = 0;
+        return clamp(s, 0.0, 1.0);
+    }
+
+    bool save(const string& path) const {
+        ofstream out(path);
+        if (!out.is_open())
+            return false;
+
+        out << "rows " << rows_ << "\n" << "columns " << cols_.size() << "\n";
+        for (auto& c : cols_) {
+            out << typeName(c.type) << " " << (c.empty ? 0 : 1) << "\n";
+            if (c.isInt)
+                out << c.minI << " " << c.maxI << "\n";
+            else
+                out << c.minS << "\n" << c.maxS << "\n";
+            out << c.bounds.size();
+            for (long long b : c.bounds)
+                out << " " << b;
+            out << "\n" << c.ndv.toHex() << "\n";
+        }
+        return (bool)out;
+    }
+
+    // returns false (and stays empty) when the file is missing or does not
+    // match the table's column types
+    bool load(const string& path, const vector<string>& types) {
+        clear();
+        ifstream in(path);
+        if (!in.is_open())
+            return false;
+
+        string word, line;
+        size_t n = 0;
+        if (!(in >> word >> rows_) || word != "rows" || !(in >> word >> n) || word != "columns" || n != types.size()) {
+            clear();
+            return false;
+        }
+
+        cols_.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            ColumnStats& c = cols_[i];
+            string type;
+            int nonEmpty = 0;
+            size_t nb = 0;
+            if (!(in >> type >> nonEmpty) || type != types[i]) {
+                clear();
+                return false;
+            }
+            c.setType(valueTypeOf(type));
+            c.empty = nonEmpty == 0;
+            if (c.isInt)
+                in >> c.minI >> c.maxI;
+            else {
+                getline(in, line);
+                getline(in, c.minS);
+                getline(in, c.maxS);
+            }
+            in >> nb;
+            c.bounds.resize(nb);
+            for (auto& b : c.bounds)
+                in >> b;
+            in >> word;
+            if (!in || !c.ndv.fromHex(word)) {
+                clear();
+                return false;
+            }
+        }
+        analyzed_ = true;
+        return true;
+    }
+};
+
+#endif // TABLE_STATS_H
@@ -0,0 +1,47 @@
+// ALTER TABLE ADD / DROP COLUMN: the .alter journal replayed on load and
+// dropped once the table file is written in the new layout
+
+#include "engine.h"
+
+TEST(alter_journal_replayed_on_load)
+{
+    TestDb t;
+    CHECK(t.run("CREATE TABLE a (name STRING, v INT)").ok());
+    t.insert("a", 100, [](int i) { return string("n").append(to_string(i)) + ", " + to_string(i); });
+
+    auto stamp = fs::last_write_time("db/a.txt");
+    CHECK(t.run("ALTER TABLE a ADD COLUMN score INT DEFAULT 7").ok());
+    CHECK(t.run("ALTER TABLE a DROP COLUMN name").ok());
+    CHECK(fs::exists("db/a.alter"));
+    CHECK(fs::last_write_time("db/a.txt") == stamp);
+    {
+        Database reopened;
+        auto rows = cells(reopened.execute("SELECT * FROM a WHERE v = 5"));
+        CHECK(rows == vector<vector<string>>{ { "5", "7" } });
+    }
+
+    CHECK(t.run("INSERT INTO a VALUES (100, 1)").ok());
+    CHECK(!fs::exists("db/a.alter"));
+    Database reopened;
+    CHECK(cells(reopened.execute("SELECT * FROM a WHERE v = 100")) == vector<vector<string>>{ { "100", "1" } });
+}
+
+TEST(alter_journal_kept_when_save_fails)
+{
+    TestDb t;
+    CHECK(t.run("CREATE TABLE a (v INT)").ok());
+    t.insert("a", 100, [](int i) { return to_string(i); });
+    CHECK(t.run("ALTER TABLE a ADD COLUMN w INT DEFAULT 3").ok());
+
+    // the table file opens but every write to it fails
+    fs::remove("db/a.txt");
+    fs::create_symlink("/dev/full", "db/a.txt");
+    t.run("INSERT INTO a VALUES (100, 1)");
+    CHECK(fs::exists("db/a.alter"));
+
+    fs::remove("db/a.txt");
+    CHECK(t.run("INSERT INTO a VALUES (101, 1)").ok());
+    CHECK(!fs::exists("db/a.alter"));
+    Database reopened;
+    CHECK_EQ(cells(reopened.execute("SELECT w FROM a WHERE w = 3")).size(), (size_t)100);
+}
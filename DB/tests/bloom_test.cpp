@@ -0,0 +1,83 @@
+// BlockBloom: no false negatives, few false positives, and the filters of a
+// table stay complete through UPDATE, compaction and a reload
+
+#include <sstream>
+#include "engine.h"
+#include "bloom.h"
+
+namespace {
+
+string key(int i) { return string("user").append(to_string(i)).append("@x.org"); }
+
+} // namespace
+
+TEST(bloom_no_false_negatives)
+{
+    BlockBloom f;
+    const int rows = BlockBloom::kBlock * 4;
+    for (int r = 0; r < rows; ++r)
+        f.add((size_t)r, BlockBloom::hashOf(key(r)));
+    CHECK_EQ(f.blocks(), (size_t)4);
+
+    bool all = true;
+    for (int r = 0; r < rows; ++r)
+        all = all && f.mayContain((size_t)r / BlockBloom::kBlock, BlockBloom::hashOf(key(r)));
+    CHECK(all);
+
+    // values never added: about 1% of the probes may say "maybe"
+    int maybe = 0, probes = 0;
+    for (int i = rows; i < rows + 10000; ++i, ++probes)
+        maybe += f.mayContain((size_t)i % 4, BlockBloom::hashOf(key(i)));
+    CHECK(maybe < probes / 20);
+    CHECK(!f.mayContain(4, BlockBloom::hashOf(key(0))));   // past the last block
+
+    ostringstream out;
+    f.write(out);
+    BlockBloom back;
+    istringstream in(out.str());
+    for (string line; getline(in, line);)
+        CHECK(back.readLine(line));
+    CHECK_EQ(back.blocks(), f.blocks());
+    bool same = true;
+    for (int i = 0; i < rows + 1000; ++i)
+        same = same && back.mayContain((size_t)i % 4, BlockBloom::hashOf(key(i))) == f.mayContain((size_t)i % 4, BlockBloom::hashOf(key(i)));
+    CHECK(same);
+    CHECK(!back.readLine("not base64!"));
+}
+
+TEST(bloom_table_lookups)
+{
+    TestDb t;
+    CHECK(t.run("CREATE TABLE u (email STRING, v INT)").ok());
+    t.insert("u", 5000, [](int i) { return key(i) + ", " + to_string(i); });
+    CHECK(t.run("CREATE BLOOM FILTER ON u (email)").ok());
+    CHECK(!t.run("CREATE BLOOM FILTER ON u (email)").ok());
+
+    auto find = [&](const string& email) { return cells(t.run("SELECT v FROM u WHERE email = " + email)); };
+    CHECK(find(key(4321)) == vector<vector<string>>{ { "4321" } });
+    CHECK(find("nobody@x.org").empty());
+
+    // a filter that skips every block of a missing value
+    string scan;
+    for (auto& row : cells(t.run("EXPLAIN ANALYZE SELECT v FROM u WHERE email = nobody@x.org")))
+        if (row[0].find("TableScan") != string::npos)
+            scan = row[0];
+    CHECK(scan.find("skipped 5 of 5 blocks") != string::npos);
+
+    // updated values are added to the filter
+    CHECK(t.run("UPDATE u SET email = moved@x.org WHERE v = 4000").affected() == 1);
+    CHECK(find("moved@x.org") == vector<vector<string>>{ { "4000" } });
+
+    // compaction moves rows between blocks and rebuilds the filter
+    CHECK(t.run("DELETE FROM u WHERE v < 2000").affected() == 2000);
+    bool found = true;
+    for (int i = 2000; i < 5000; i += 97)
+        found = found && (i == 4000 || find(key(i)) == vector<vector<string>>{ { to_string(i) } });
+    CHECK(found);
+    CHECK(find("moved@x.org") == vector<vector<string>>{ { "4000" } });
+    CHECK(find(key(10)).empty());
+
+    // and the saved filter is read back
+    Database reopened;
+    CHECK(cells(reopened.execute("SELECT v FROM u WHERE email = " + key(4999))) == vector<vector<string>>{ { "4999" } });
+}
@@ -0,0 +1,67 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+// minimal test harness: TEST(name) registers a case, CHECK records a failure
+// and keeps going, main() in test_main.cpp runs every case (or the ones named
+// on the command line) and exits non-zero if any check failed
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <functional>
+using namespace std;
+
+namespace check {
+
+struct Case {
+    const char* name;
+    function<void()> run;
+};
+
+inline vector<Case>& cases()
+{
+    static vector<Case> all;
+    return all;
+}
+
+inline int& failures()
+{
+    static int n = 0;
+    return n;
+}
+
+struct Register {
+    Register(const char* name, function<void()> run) { cases().push_back({ name, move(run) }); }
+};
+
+inline void fail(const char* file, int line, const string& what)
+{
+    ++failures();
+    cerr << file << ":" << line << ": CHECK failed: " << what << "\n";
+}
+
+} // namespace check
+
+#define CHECK_CAT2(a, b) a##b
+#define CHECK_CAT(a, b) CHECK_CAT2(a, b)
+
+#define TEST(name)                                                              \
+    static void test_##name();                                                  \
+    static check::Register CHECK_CAT(reg_, name)(#name, test_##name);           \
+    static void test_##name()
+
+#define CHECK(...)                                                              \
+    do {                                                                        \
+        if (!(__VA_ARGS__))                                                     \
+            check::fail(__FILE__, __LINE__, #__VA_ARGS__);                      \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                          \
+    do {                                                                        \
+        auto&& check_a = (a);                                                   \
+        auto&& check_b = (b);                                                   \
+        if (!(check_a == check_b))                                              \
+            check::fail(__FILE__, __LINE__, string(#a " == " #b));              \
+    } while (0)
+
+#endif // CHECK_H
@@ -0,0 +1,97 @@
+// deleted rows and compaction: row ids stay put until a write statement
+// compacts the table, and results held across statements are never renumbered
+
+#include "engine.h"
+
+namespace {
+
+uint64_t compactions() { return metrics::snapshot().counters[metrics::Compactions]; }
+
+string name(size_t i) { return string("n").append(to_string(i)); }
+
+string row(int i) { return name(i) + ", " + to_string(i); }
+
+} // namespace
+
+TEST(compaction_renumbers_rows)
+{
+    TestDb t;
+    CHECK(t.run("CREATE TABLE c (name STRING, v INT)").ok());
+    t.insert("c", 4000, row);
+
+    uint64_t before = compactions();
+    ResultSet del = t.run("DELETE FROM c WHERE v < 1500");
+    CHECK(del.ok() && del.affected() == 1500);
+    CHECK_EQ(compactions(), before + 1);   // 37% deleted, compacted by the DELETE itself
+
+    auto rows = cells(t.run("SELECT name, v FROM c"));
+    CHECK_EQ(rows.size(), (size_t)2500);
+    bool inOrder = true;
+    for (size_t i = 0; i < rows.size(); ++i)
+        inOrder = inOrder && rows[i][0] == name(1500 + i) && rows[i][1] == to_string(1500 + i);
+    CHECK(inOrder);
+    CHECK(cells(t.run("SELECT name FROM c WHERE v = 3999")) == vector<vector<string>>{ { "n3999" } });
+
+    // a later delete below the threshold only marks rows
+    before = compactions();
+    CHECK(t.run("DELETE FROM c WHERE v > 3900").affected() == 99);
+    CHECK_EQ(compactions(), before);
+    CHECK_EQ(cells(t.run("SELECT v FROM c")).size(), (size_t)2401);
+
+    // the file holds the compacted rows and the later tombstones
+    Database reopened;
+    auto back = cells(reopened.execute("SELECT name, v FROM c"));
+    CHECK_EQ(back.size(), (size_t)2401);
+    CHECK(!back.empty() && back.front()[0] == "n1500" && back.back()[0] == "n3900");
+}
+
+TEST(compaction_keeps_held_results)
+{
+    TestDb t;
+    CHECK(t.run("CREATE TABLE e (name STRING, v INT)").ok());
+    t.insert("e", 20000, row);
+
+    // another session's open transaction holds e, so the DELETE cannot compact it
+    Session a;
+    CHECK(t.run(a, "BEGIN").ok());
+    CHECK(t.run(a, "UPDATE e SET v = 1 WHERE v = 19999").ok());
+
+    uint64_t before = compactions();
+    CHECK(t.run("DELETE FROM e WHERE v < 10000").affected() == 10000);
+    ResultSet held = t.run("SELECT name, v FROM e");
+    CHECK_EQ(held.rowCount(), (size_t)10000);
+
+    // ending the transaction does not modify e, so it must not renumber its rows
+    CHECK(t.run(a, "ROLLBACK").ok());
+    CHECK_EQ(compactions(), before);
+    auto rows = cells(held);
+    bool same = rows.size() == 10000;
+    for (size_t i = 0; same && i < rows.size(); ++i)
+        same = rows[i][0] == name(10000 + i) && rows[i][1] == to_string(10000 + i);
+    CHECK(same);
+
+    // the next write to e compacts it
+    CHECK(t.run("UPDATE e SET v = 0 WHERE v = 19999").affected() == 1);
+    CHECK_EQ(compactions(), before + 1);
+    auto after = cells(t.run("SELECT name, v FROM e"));
+    CHECK_EQ(after.size(), (size_t)10000);
+    CHECK(!after.empty() && after.front()[0] == "n10000" && after.back()[1] == "0");
+}
+
+TEST(compaction_remaps_views)
+{
+    TestDb t;
+    CHECK(t.run("CREATE TABLE b (name STRING, v INT)").ok());
+    t.insert("b", 3000, row);
+    CHECK(t.run("CREATE MATERIALIZED VIEW bv AS SELECT name, v FROM b WHERE v >= 2000").ok());
+
+    uint64_t before = compactions();
+    CHECK(t.run("DELETE FROM b WHERE v < 1000").affected() == 1000);
+    CHECK_EQ(compactions(), before + 1);
+
+    // the view follows the base's new row ids
+    CHECK(t.run("UPDATE b SET name = changed WHERE v = 2500").affected() == 1);
+    CHECK(cells(t.run("SELECT name FROM bv WHERE v = 2500")) == vector<vector<string>>{ { "changed" } });
+    CHECK(t.run("DELETE FROM b WHERE v = 2999").affected() == 1);
+    CHECK_EQ(cells(t.run("SELECT v FROM bv")).size(), (size_t)999);
+}
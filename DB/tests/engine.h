@@ -0,0 +1,62 @@
+#ifndef TEST_ENGINE_H
+#define TEST_ENGINE_H
+
+// engine cases: a Database over an empty ./db (ctest runs them in their own
+// directory), statements run from their text
+
+#include <filesystem>
+#include <functional>
+#include "check.h"
+#include "database.h"
+
+namespace fs = std::filesystem;
+
+struct EmptyDbDir {
+    EmptyDbDir()
+    {
+        fs::remove_all("db");
+        fs::create_directories("db");
+    }
+};
+
+struct TestDb : EmptyDbDir {
+    Database db;
+
+    ResultSet run(string_view sql) { return db.execute(sql); }
+
+    ResultSet run(Session& s, string_view sql)
+    {
+        Statement st;
+        if (!Parse::parseStatement(sql, st))
+            return ResultSet::error("Invalid query or unsupported format");
+        return db.execute(st, s);
+    }
+
+    // n INSERT INTO table VALUES (row(i)), appended as one batch
+    void insert(const string& table, int n, const function<string(int)>& row)
+    {
+        vector<string> texts(n);
+        vector<Statement> sts(n);
+        for (int i = 0; i < n; ++i) {
+            texts[i] = "INSERT INTO " + table + " VALUES (" + row(i) + ")";
+            CHECK(Parse::parseStatement(texts[i], sts[i]));
+        }
+        int bad = 0;
+        db.executeBatch(sts.data(), sts.size(), [&](size_t, const ResultSet& rs) { bad += !rs.ok(); });
+        CHECK_EQ(bad, 0);
+    }
+};
+
+// the cells of a result, row by row
+inline vector<vector<string>> cells(const ResultSet& rs)
+{
+    vector<vector<string>> out;
+    for (auto row : rs) {
+        auto& r = out.emplace_back();
+        for (size_t c = 0; c < row.size(); ++c)
+            r.emplace_back(row[c]);
+    }
+    return out;
+}
+
+#endif // TEST_ENGINE_H
@@ -0,0 +1,49 @@
+// EXPLAIN: only SELECT, UPDATE and DELETE have a plan, and explaining a
+// statement never runs it, whether it comes alone or pipelined in a batch
+
+#include "engine.h"
+
+namespace {
+
+// runs the statements as one executeBatch call, like a pipelining client
+vector<ResultSet> batch(TestDb& t, const vector<string>& texts)
+{
+    vector<Statement> sts(texts.size());
+    for (size_t i = 0; i < texts.size(); ++i)
+        CHECK(Parse::parseStatement(texts[i], sts[i]));
+    vector<ResultSet> out(texts.size());
+    t.db.executeBatch(sts.data(), sts.size(), [&](size_t i, const ResultSet& rs) { out[i] = rs; });
+    return out;
+}
+
+} // namespace
+
+TEST(explain_insert_is_refused)
+{
+    TestDb t;
+    CHECK(t.run("CREATE TABLE t (id INT)").ok());
+
+    ResultSet one = t.run("EXPLAIN INSERT INTO t VALUES (1)");
+    CHECK(!one.ok() && one.message().find("only SELECT, UPDATE and DELETE have a plan") != string::npos);
+
+    // pipelined, they must not be grouped with each other or with real INSERTs
+    auto rs = batch(t, { "EXPLAIN INSERT INTO t VALUES (1)", "EXPLAIN INSERT INTO t VALUES (2)",
+        "INSERT INTO t VALUES (3)", "EXPLAIN INSERT INTO t VALUES (4)", "INSERT INTO t VALUES (5)" });
+    CHECK(!rs[0].ok() && !rs[1].ok() && !rs[3].ok());
+    CHECK(rs[2].ok() && rs[4].ok());
+    CHECK(rs[0].message() == one.message());
+    CHECK(cells(t.run("SELECT id FROM t")) == vector<vector<string>>{ { "3" }, { "5" } });
+}
+
+TEST(explain_does_not_run_the_statement)
+{
+    TestDb t;
+    CHECK(t.run("CREATE TABLE t (id INT)").ok());
+    t.insert("t", 10, [](int i) { return to_string(i); });
+
+    auto rs = batch(t, { "EXPLAIN DELETE FROM t WHERE id < 5", "EXPLAIN UPDATE t SET id = 0 WHERE id = 9", "EXPLAIN SELECT * FROM t" });
+    for (auto& r : rs)
+        CHECK(r.ok() && r.rowCount() > 0);
+    auto rows = cells(t.run("SELECT id FROM t"));
+    CHECK(rows.size() == 10 && rows.back()[0] == "9");
+}
@@ -0,0 +1,95 @@
+// Expr: UPDATE right-hand sides over INT, BIGINT and DOUBLE columns
+
+#include "check.h"
+#include "expr.h"
+
+namespace {
+
+const vector<string> kNames = { "qty", "big", "price", "d", "name" };
+const vector<string> kTypes = { "INT", "BIGINT", "DOUBLE", "DATE", "STRING" };
+
+// row keys: qty 3, big 10, price 2.5, d 2020-01-01
+long long key(int c)
+{
+    long long days = 0;
+    parseDate("2020-01-01", days);
+    const long long keys[] = { 3, 10, doubleKey(2.5), days, 0 };
+    return keys[c];
+}
+
+bool compile(Expr& e, string_view text, const char* target, string& err)
+{
+    return e.compile(text, kNames, kTypes, target, err);
+}
+
+} // namespace
+
+TEST(expr_integer)
+{
+    Expr e;
+    string err;
+    const char* why = nullptr;
+    long long v = 0;
+    CHECK(compile(e, "qty * 2 + big / 4", "INT", err));
+    CHECK(!e.isReal());
+    CHECK(e.evalInt(key, v, why) && v == 8);
+
+    CHECK(compile(e, "qty * 1.1", "INT", err));
+    CHECK(e.evalInt(key, v, why) && v == 3);     // 3.3 rounds
+
+    CHECK(compile(e, "price * 3", "BIGINT", err));
+    CHECK(e.evalInt(key, v, why) && v == 8);     // 7.5 rounds away from zero
+
+    CHECK(compile(e, "qty / (big - 10)", "INT", err));
+    CHECK(!e.evalInt(key, v, why) && string(why) == "division by zero");
+}
+
+TEST(expr_double)
+{
+    Expr e;
+    string err;
+    const char* why = nullptr;
+    double d = 0;
+    CHECK(compile(e, "price * 1.1", "DOUBLE", err));
+    CHECK(e.isReal());
+    CHECK(e.evalReal(key, d, why) && d == 2.5 * 1.1);
+
+    CHECK(compile(e, "qty / 2 + price", "DOUBLE", err));
+    CHECK(e.evalReal(key, d, why) && d == 3.5);  // qty / 2 stays integer division
+
+    CHECK(compile(e, "-(price - big)", "DOUBLE", err));
+    CHECK(e.evalReal(key, d, why) && d == 7.5);
+
+    CHECK(compile(e, "price / 0", "DOUBLE", err));
+    CHECK(!e.evalReal(key, d, why) && string(why) == "division by zero");
+
+    // a literal or a DOUBLE column alone is stored as is
+    CHECK(compile(e, "4.25", "DOUBLE", err) && e.isLiteral());
+    CHECK(compile(e, "price", "DOUBLE", err) && e.copiedColumn() == 2);
+}
+
+TEST(expr_type_mismatch)
+{
+    Expr e;
+    string err;
+    CHECK(!compile(e, "d + 1", "DOUBLE", err) && err == "type mismatch");
+    CHECK(!compile(e, "name * 2", "INT", err) && err == "type mismatch");
+    CHECK(!compile(e, "qty", "DATE", err) && err == "type mismatch");
+    CHECK(!compile(e, "nope + 1", "DOUBLE", err) && err == "unknown column nope");
+}
+
+TEST(expr_too_complex)
+{
+    Expr e;
+    string err;
+    CHECK(compile(e, "--qty", "INT", err));
+    CHECK(!compile(e, string(200000, '-') + "1", "INT", err) && err == "expression too complex");
+    CHECK(!compile(e, string(200000, '(') + "1", "INT", err) && err == "expression too complex");
+    CHECK(compile(e, string(100, '(') + "qty" + string(100, ')'), "INT", err));
+
+    // operands left pending overflow the evaluation stack
+    string deep = "qty";
+    for (int i = 0; i < Expr::kMaxDepth; ++i)
+        deep = "qty - (" + deep + ")";
+    CHECK(!compile(e, deep, "INT", err) && err == "expression too complex");
+}
@@ -0,0 +1,159 @@
+// IntColumn: every encoding decodes back to what was pushed, through get(),
+// decodeBlock(), all() and the table file lines
+
+#include <climits>
+#include <random>
+#include <sstream>
+#include "check.h"
+#include "int_column.h"
+
+namespace {
+
+constexpr size_t kRows = IntColumn::kBlock * 3 + 100;   // three full blocks and a tail
+
+IntColumn build(const vector<long long>& v)
+{
+    IntColumn c;
+    for (long long x : v)
+        c.push(x);
+    return c;
+}
+
+void checkRoundTrip(const IntColumn& c, const vector<long long>& v)
+{
+    CHECK_EQ(c.size(), v.size());
+    CHECK(c.all() == v);
+
+    bool same = true;
+    for (size_t r = 0; r < v.size(); ++r)
+        same = same && c.get(r) == v[r];
+    CHECK(same);
+
+    long long buf[IntColumn::kBlock];
+    for (size_t b = 0; b < c.blockCount(); ++b) {
+        c.decodeBlock(b, buf);
+        size_t n = c.blockRows(b);
+        CHECK(equal(buf, buf + n, v.begin() + b * IntColumn::kBlock));
+        long long lo = 0, hi = 0;
+        c.zone(b, lo, hi);
+        auto mm = minmax_element(buf, buf + n);
+        CHECK(lo == *mm.first && hi == *mm.second);
+    }
+
+    // file lines read back to the same values
+    ostringstream out;
+    c.write(out);
+    IntColumn back;
+    istringstream in(out.str());
+    string line;
+    size_t lines = 0;
+    while (getline(in, line)) {
+        CHECK(back.readLine(line));
+        ++lines;
+    }
+    CHECK_EQ(lines, c.lineCount());
+    CHECK(back.all() == v);
+    CHECK_EQ(back.describe(), c.describe());
+}
+
+vector<long long> forValues()
+{
+    mt19937_64 rng(1);
+    vector<long long> v(kRows);
+    for (auto& x : v)
+        x = 1000000 + (long long)(rng() % 5000);
+    return v;
+}
+
+vector<long long> deltaValues()
+{
+    mt19937_64 rng(2);
+    vector<long long> v(kRows);
+    long long x = -50;
+    for (auto& y : v)
+        y = x += 1 + (long long)(rng() % 3);
+    return v;
+}
+
+vector<long long> rleValues()
+{
+    vector<long long> v(kRows);
+    for (size_t i = 0; i < v.size(); ++i)
+        v[i] = (long long)(i / 300) * 1000003;
+    return v;
+}
+
+} // namespace
+
+TEST(int_column_for)
+{
+    vector<long long> v = forValues();
+    IntColumn c = build(v);
+    CHECK_EQ(c.describe(), string("for 3, delta 0, rle 0, tail 100"));
+    checkRoundTrip(c, v);
+}
+
+TEST(int_column_delta)
+{
+    vector<long long> v = deltaValues();
+    IntColumn c = build(v);
+    CHECK_EQ(c.describe(), string("for 0, delta 3, rle 0, tail 100"));
+    checkRoundTrip(c, v);
+}
+
+TEST(int_column_rle)
+{
+    vector<long long> v = rleValues();
+    IntColumn c = build(v);
+    CHECK_EQ(c.describe(), string("for 0, delta 0, rle 3, tail 100"));
+    checkRoundTrip(c, v);
+}
+
+TEST(int_column_extremes)
+{
+    // full 64-bit range differences must wrap, not overflow
+    vector<long long> v(kRows);
+    for (size_t i = 0; i < v.size(); ++i)
+        v[i] = i % 2 ? LLONG_MIN + (long long)i : LLONG_MAX - (long long)i;
+    checkRoundTrip(build(v), v);
+}
+
+TEST(int_column_set_and_erase)
+{
+    vector<long long> v = deltaValues();
+    IntColumn c = build(v);
+
+    c.set(5, 7);
+    v[5] = 7;
+    c.set(kRows - 1, -1);
+    v[kRows - 1] = -1;
+    checkRoundTrip(c, v);
+
+    vector<int> rows = { 0, 1, 1500, 3000, (int)kRows - 2 };
+    vector<long long> vals = { 9, v[1], 11, 12, 13 };
+    vector<char> changed(rows.size(), 0);
+    CHECK_EQ(c.setMany(rows, vals, changed), (size_t)4);
+    CHECK(changed[1] == 0 && changed[0] == 1);
+    for (size_t i = 0; i < rows.size(); ++i)
+        v[rows[i]] = vals[i];
+    checkRoundTrip(c, v);
+
+    vector<int> gone = { 0, 2, 1023, 1024, 2500, (int)kRows - 1 };
+    c.erase(gone);
+    for (size_t i = gone.size(); i-- > 0;)
+        v.erase(v.begin() + gone[i]);
+    checkRoundTrip(c, v);
+}
+
+TEST(int_column_push_repeat)
+{
+    IntColumn c;
+    vector<long long> v;
+    for (int i = 0; i < 10; ++i) {
+        c.push(i);
+        v.push_back(i);
+    }
+    c.pushRepeat(42, IntColumn::kBlock * 2 + 5);
+    v.insert(v.end(), IntColumn::kBlock * 2 + 5, 42);
+    checkRoundTrip(c, v);
+}
@@ -0,0 +1,123 @@
+// partitioned tables: INSERT routing by RANGE and HASH, pruning of the
+// partitions a WHERE can't reach, and ADD / DROP PARTITION
+
+#include <algorithm>
+#include "engine.h"
+
+namespace {
+
+uint64_t loads() { return metrics::snapshot().counters[metrics::TableLoads]; }
+
+const char* kEvents = "CREATE TABLE ev (id INT, day DATE, v INT) PARTITION BY RANGE (day) "
+    "(p23 VALUES LESS THAN (2024-01-01), p24 VALUES LESS THAN (2025-01-01), pmax VALUES LESS THAN MAXVALUE)";
+
+// id i falls on day i of 2023, so ids 0-364 go to p23, 365-730 to p24
+string event(int i)
+{
+    long long days = 0;
+    parseDate("2023-01-01", days);
+    char buf[32];
+    return to_string(i) + ", " + string(buf, formatValue(ValueType::Date, days + i, buf)) + ", " + to_string(i % 10);
+}
+
+size_t rowsIn(TestDb& t, const string& table) { return cells(t.run("SELECT * FROM " + table)).size(); }
+
+// the first line of EXPLAIN: "Append on t (k of n partitions, ...)"
+string appendLine(const ResultSet& rs)
+{
+    auto rows = cells(rs);
+    return rows.empty() || rows[0].empty() ? "" : rows[0][0];
+}
+
+} // namespace
+
+TEST(partition_range_routing)
+{
+    TestDb t;
+    CHECK(t.run(kEvents).ok());
+    t.insert("ev", 1000, event);
+    CHECK_EQ(rowsIn(t, "ev.p23"), (size_t)365);
+    CHECK_EQ(rowsIn(t, "ev.p24"), (size_t)366);    // 2024 is a leap year
+    CHECK_EQ(rowsIn(t, "ev.pmax"), (size_t)269);
+    CHECK_EQ(rowsIn(t, "ev"), (size_t)1000);
+
+    // bounds: a partition takes values below its own and from the previous one up
+    CHECK(cells(t.run("SELECT id FROM ev.p24 WHERE day = 2024-01-01")) == vector<vector<string>>{ { "365" } });
+    CHECK(cells(t.run("SELECT id FROM ev.p23 WHERE day = 2023-12-31")) == vector<vector<string>>{ { "364" } });
+
+    CHECK(!t.run("INSERT INTO ev.p24 VALUES (1, 2024-02-01, 0)").ok());
+    CHECK(!t.run("UPDATE ev SET day = 2020-01-01 WHERE id = 1").ok());
+    CHECK(t.run("CREATE TABLE r (id INT, v INT) PARTITION BY RANGE (id) (a VALUES LESS THAN (10))").ok());
+    CHECK(!t.run("INSERT INTO r VALUES (20, 1)").ok());
+    CHECK(t.run("INSERT INTO r VALUES (9, 1)").ok());
+}
+
+TEST(partition_pruning)
+{
+    TestDb t;
+    CHECK(t.run(kEvents).ok());
+    t.insert("ev", 1000, event);
+
+    CHECK(appendLine(t.run("EXPLAIN SELECT * FROM ev WHERE day >= 2024-02-01")).find("(2 of 3 partitions") != string::npos);
+    CHECK(appendLine(t.run("EXPLAIN SELECT * FROM ev WHERE day < 2023-06-01")).find("(1 of 3 partitions") != string::npos);
+    CHECK(appendLine(t.run("EXPLAIN SELECT * FROM ev WHERE v = 3")).find("(3 of 3 partitions") != string::npos);
+
+    // a fresh Database only loads the partitions it keeps
+    Database reopened;
+    uint64_t before = loads();
+    auto rows = cells(reopened.execute("SELECT id FROM ev WHERE day < 2023-01-11"));
+    CHECK_EQ(rows.size(), (size_t)10);
+    CHECK_EQ(loads() - before, (uint64_t)2);    // ev itself and ev.p23
+
+    // UPDATE and DELETE prune the same way and still see every matching row
+    CHECK(t.run("UPDATE ev SET v = 100 WHERE day >= 2025-01-01").affected() == 269);
+    CHECK(t.run("DELETE FROM ev WHERE day < 2023-02-01").affected() == 31);
+    CHECK_EQ(cells(t.run("SELECT id FROM ev WHERE v = 100")).size(), (size_t)269);
+    CHECK_EQ(rowsIn(t, "ev"), (size_t)969);
+}
+
+TEST(partition_hash)
+{
+    TestDb t;
+    CHECK(t.run("CREATE TABLE h (id INT, name STRING) PARTITION BY HASH (name) PARTITIONS 4").ok());
+    t.insert("h", 400, [](int i) { return to_string(i) + ", " + string("n").append(to_string(i % 40)); });
+
+    // every name lives in exactly one partition
+    size_t total = 0;
+    bool single = true;
+    for (int p = 0; p < 4; ++p) {
+        auto rows = cells(t.run("SELECT name FROM h.p" + to_string(p)));
+        total += rows.size();
+        for (int q = 0; q < 4 && !rows.empty(); ++q)
+            single = single && (q == p || cells(t.run("SELECT id FROM h.p" + to_string(q) + " WHERE name = " + rows[0][0])).empty());
+    }
+    CHECK_EQ(total, (size_t)400);
+    CHECK(single);
+
+    CHECK(appendLine(t.run("EXPLAIN SELECT * FROM h WHERE name = n7")).find("(1 of 4 partitions") != string::npos);
+    CHECK_EQ(cells(t.run("SELECT id FROM h WHERE name = n7")).size(), (size_t)10);
+    CHECK(!t.run("ALTER TABLE h DROP PARTITION p0").ok());
+}
+
+TEST(partition_add_drop)
+{
+    TestDb t;
+    CHECK(t.run("CREATE TABLE ev (id INT, day DATE, v INT) PARTITION BY RANGE (day) "
+                "(p23 VALUES LESS THAN (2024-01-01), p24 VALUES LESS THAN (2025-01-01))").ok());
+    t.insert("ev", 731, event);
+    CHECK(!t.run("INSERT INTO ev VALUES (1, 2025-03-01, 0)").ok());
+
+    CHECK(t.run("ALTER TABLE ev ADD PARTITION p25 VALUES LESS THAN (2026-01-01)").ok());
+    CHECK(t.run("INSERT INTO ev VALUES (1000, 2025-03-01, 0)").ok());
+    CHECK_EQ(rowsIn(t, "ev.p25"), (size_t)1);
+
+    CHECK(t.run("ALTER TABLE ev DROP PARTITION p23").ok());
+    CHECK(!fs::exists("db/ev.p23.txt"));
+    CHECK_EQ(rowsIn(t, "ev"), (size_t)367);
+    CHECK(t.run("INSERT INTO ev VALUES (1001, 2022-03-01, 0)").ok());     // p24 takes the old range
+    CHECK_EQ(rowsIn(t, "ev.p24"), (size_t)367);
+
+    Database reopened;
+    CHECK_EQ(cells(reopened.execute("SELECT * FROM ev")).size(), (size_t)368);
+    CHECK(appendLine(reopened.execute("EXPLAIN SELECT * FROM ev WHERE day >= 2025-01-01")).find("(1 of 2 partitions") != string::npos);
+}
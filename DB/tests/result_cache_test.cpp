@@ -0,0 +1,62 @@
+// result cache: repeated SELECTs are answered from the cache until their
+// table changes, and a transaction neither reads nor fills it
+
+#include "engine.h"
+
+namespace {
+
+uint64_t counter(metrics::Counter c) { return metrics::snapshot().counters[c]; }
+
+} // namespace
+
+TEST(result_cache_hits_and_invalidation)
+{
+    TestDb t;
+    t.db.setResultCache(1 << 20);
+    CHECK(t.run("CREATE TABLE r (id INT, name STRING)").ok());
+    t.insert("r", 2000, [](int i) { return to_string(i) + ", n" + to_string(i % 5); });
+
+    const char* q = "SELECT id FROM r WHERE name = n3";
+    uint64_t hits = counter(metrics::ResultCacheHits), misses = counter(metrics::ResultCacheMisses);
+    auto first = cells(t.run(q));
+    CHECK_EQ(first.size(), (size_t)400);
+    CHECK_EQ(cells(t.run("select ID from R where NAME = n3")), first);     // same statement, other case
+    CHECK_EQ(counter(metrics::ResultCacheMisses), misses + 1);
+    CHECK_EQ(counter(metrics::ResultCacheHits), hits + 1);
+
+    // every kind of write gives the table a new version
+    CHECK(t.run("INSERT INTO r VALUES (2000, n3)").ok());
+    CHECK_EQ(cells(t.run(q)).size(), (size_t)401);
+    CHECK(t.run("UPDATE r SET name = n3 WHERE id = 0").affected() == 1);
+    CHECK_EQ(cells(t.run(q)).size(), (size_t)402);
+    CHECK(t.run("DELETE FROM r WHERE id < 1000").affected() == 1000);    // compacts too
+    auto after = cells(t.run(q));
+    CHECK_EQ(after.size(), (size_t)201);
+    CHECK(!after.empty() && after.front()[0] == "1003");
+    CHECK(t.run("ALTER TABLE r ADD COLUMN score INT DEFAULT 7").ok());
+    auto wide = cells(t.run("SELECT * FROM r WHERE id = 1003"));
+    CHECK(wide == vector<vector<string>>{ { "1003", "n3", "7" } });
+}
+
+TEST(result_cache_bypassed_by_transactions)
+{
+    TestDb t;
+    t.db.setResultCache(1 << 20);
+    Session a;
+    CHECK(t.run("CREATE TABLE r (id INT, name STRING)").ok());
+    t.insert("r", 100, [](int i) { return to_string(i) + ", x"; });
+
+    const char* q = "SELECT id FROM r";
+    auto committed = cells(t.run(q));
+    CHECK(t.run(a, "BEGIN").ok());
+    CHECK(t.run(a, "DELETE FROM r WHERE id < 50").affected() == 50);
+
+    uint64_t hits = counter(metrics::ResultCacheHits), misses = counter(metrics::ResultCacheMisses);
+    CHECK_EQ(cells(t.run(a, q)).size(), (size_t)50);      // the session's copy, not the cached rows
+    CHECK_EQ(counter(metrics::ResultCacheHits), hits);
+    CHECK_EQ(counter(metrics::ResultCacheMisses), misses);
+    CHECK_EQ(cells(t.run(q)), committed);                  // others still get the committed rows
+
+    CHECK(t.run(a, "ROLLBACK").ok());
+    CHECK_EQ(cells(t.run(a, q)), committed);
+}
@@ -0,0 +1,24 @@
+// db_tests: runs every registered case, or only the ones named on the command line
+//
+//   db_tests [case ...]
+
+#include <cstring>
+#include "check.h"
+
+int main(int argc, char** argv)
+{
+    int run = 0;
+    for (auto& c : check::cases()) {
+        bool wanted = argc < 2;
+        for (int i = 1; i < argc && !wanted; ++i)
+            wanted = strcmp(argv[i], c.name) == 0;
+        if (!wanted)
+            continue;
+        int before = check::failures();
+        c.run();
+        cout << (check::failures() == before ? "[ OK ] " : "[FAIL] ") << c.name << "\n";
+        ++run;
+    }
+    cout << run << " cases, " << check::failures() << " failed checks\n";
+    return check::failures() == 0 && run > 0 ? 0 : 1;
+}
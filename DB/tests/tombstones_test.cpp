@@ -0,0 +1,132 @@
+// Tombstones: the deleted-row bitmap, its file encoding, and the per-DELETE
+// journal that keeps a DELETE from rewriting the table file
+
+#include <fstream>
+#include <set>
+#include "engine.h"
+#include "tombstones.h"
+
+namespace {
+
+// reference nextLive over a set of dead rows
+int nextLiveIn(const set<int>& dead, int r, int end)
+{
+    while (r < end && dead.count(r))
+        ++r;
+    return r;
+}
+
+} // namespace
+
+TEST(tombstones_kill_and_next_live)
+{
+    Tombstones t;
+    CHECK(!t.any());
+    CHECK_EQ(t.nextLive(5, 100), 5);
+
+    set<int> dead;
+    auto kill = [&](int r) { CHECK(t.kill(r)); dead.insert(r); };
+    for (int r = 0; r < 1024; ++r)      // block 0 entirely
+        kill(r);
+    for (int r = 1030; r < 1100; ++r)   // a run inside block 1
+        kill(r);
+    kill(2047);
+    kill(5000);
+    CHECK(!t.kill(5000));               // already deleted
+    CHECK_EQ(t.count(), dead.size());
+
+    bool same = true;
+    for (int r = 0; r < 6000; ++r)
+        same = same && t.nextLive(r, 6000) == nextLiveIn(dead, r, 6000) && t.dead(r) == (dead.count(r) > 0);
+    CHECK(same);
+    CHECK_EQ(t.nextLive(0, 500), 500);   // capped at end
+    CHECK(t.ids() == vector<int>(dead.begin(), dead.end()));
+}
+
+TEST(tombstones_encode_decode)
+{
+    Tombstones t;
+    for (int r : { 0, 63, 64, 1023, 1024, 3000, 4095 })
+        t.kill(r);
+
+    string header = t.header();
+    CHECK_EQ(header, string("7 4"));
+    Tombstones back;
+    CHECK(back.decode(4, t.encode()));
+    CHECK(back.ids() == t.ids());
+    CHECK_EQ(back.count(), t.count());
+    CHECK_EQ(back.nextLive(63, 100), 65);
+
+    CHECK(!back.decode(4, "not base64!"));
+    CHECK(back.decode(0, ""));
+    CHECK(!back.any());
+
+    back = t;
+    back.truncate(1024);
+    CHECK(back.ids() == vector<int>({ 0, 63, 64, 1023 }));
+}
+
+TEST(tombstones_delete_journal)
+{
+    TestDb t;
+    CHECK(t.run("CREATE TABLE j (name STRING, v INT)").ok());
+    t.insert("j", 5000, [](int i) { return string("n").append(to_string(i % 7)) + ", " + to_string(i); });
+
+    // below the compaction threshold: the file stays, the ids go to the journal
+    auto fileSize = [] { return fs::file_size("db/j.txt"); };
+    auto written = fileSize();
+    auto stamp = fs::last_write_time("db/j.txt");
+    CHECK(t.run("DELETE FROM j WHERE v < 500").affected() == 500);
+    CHECK(t.run("DELETE FROM j WHERE v = 4999").affected() == 1);
+    CHECK(t.run("DELETE FROM j WHERE v = 4999").affected() == 0);
+    CHECK_EQ(fileSize(), written);
+    CHECK(fs::last_write_time("db/j.txt") == stamp);
+    size_t lines = 0;
+    {
+        ifstream in("db/j.del");
+        for (string line; getline(in, line);)
+            ++lines;
+    }
+    CHECK_EQ(lines, (size_t)2);
+
+    // a new Database replays the journal on load
+    {
+        Database reopened;
+        auto rows = cells(reopened.execute("SELECT v FROM j"));
+        CHECK_EQ(rows.size(), (size_t)4499);
+        CHECK(!rows.empty() && rows.front()[0] == "500" && rows.back()[0] == "4998");
+    }
+
+    // any other write saves the file with the bitmap and drops the journal
+    CHECK(t.run("UPDATE j SET v = 0 WHERE v = 4998").affected() == 1);
+    CHECK(!fs::exists("db/j.del"));
+    Database reopened;
+    CHECK_EQ(cells(reopened.execute("SELECT v FROM j")).size(), (size_t)4499);
+    CHECK(cells(reopened.execute("SELECT name FROM j WHERE v = 499")).empty());
+
+    CHECK(t.run("DELETE FROM j WHERE v = 1000").affected() == 1);
+    CHECK(fs::exists("db/j.del"));
+    CHECK(t.run("DROP TABLE j").ok());
+    CHECK(!fs::exists("db/j.del") && !fs::exists("db/j.txt"));
+}
+
+TEST(tombstones_journal_kept_when_save_fails)
+{
+    TestDb t;
+    CHECK(t.run("CREATE TABLE j (v INT)").ok());
+    t.insert("j", 100, [](int i) { return to_string(i); });
+    CHECK(t.run("DELETE FROM j WHERE v < 10").affected() == 10);
+    CHECK(fs::exists("db/j.del"));
+
+    // the table file opens but every write to it fails
+    fs::remove("db/j.txt");
+    fs::create_symlink("/dev/full", "db/j.txt");
+    t.run("UPDATE j SET v = 0 WHERE v = 50");
+    CHECK(fs::exists("db/j.del"));
+
+    fs::remove("db/j.txt");
+    CHECK(t.run("UPDATE j SET v = 1 WHERE v = 0").affected() == 1);
+    CHECK(!fs::exists("db/j.del"));
+    Database reopened;
+    CHECK_EQ(cells(reopened.execute("SELECT v FROM j")).size(), (size_t)90);
+}
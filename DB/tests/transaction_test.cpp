@@ -0,0 +1,87 @@
+// BEGIN / COMMIT / ROLLBACK: a transaction works on private copies, ROLLBACK
+// leaves memory and files as they were, COMMIT publishes every table at once
+
+#include "engine.h"
+
+namespace {
+
+vector<vector<string>> all(TestDb& t, Session& s, const string& table)
+{
+    return cells(t.run(s, "SELECT * FROM " + table));
+}
+
+} // namespace
+
+TEST(transaction_rollback)
+{
+    TestDb t;
+    Session a;
+    CHECK(t.run("CREATE TABLE acct (id INT, balance INT)").ok());
+    CHECK(t.run("CREATE TABLE log (id INT, note STRING)").ok());
+    t.insert("acct", 3000, [](int i) { return to_string(i) + ", 100"; });
+    auto acct = all(t, a, "acct");
+    auto file = fs::last_write_time("db/acct.txt");
+
+    CHECK(t.run(a, "BEGIN").ok());
+    CHECK(!t.run(a, "BEGIN").ok());
+    CHECK(t.run(a, "INSERT INTO acct VALUES (3000, 5)").ok());
+    CHECK(t.run(a, "UPDATE acct SET balance = balance - 100 WHERE id = 3").affected() == 1);
+    CHECK(t.run(a, "DELETE FROM acct WHERE id < 1500").affected() == 1500);
+    CHECK(t.run(a, "INSERT INTO log VALUES (1, moved)").ok());
+
+    // the session sees its copies, everyone else the committed tables
+    CHECK_EQ(all(t, a, "acct").size(), (size_t)1501);
+    CHECK_EQ(cells(t.run("SELECT * FROM acct")), acct);
+    CHECK(cells(t.run("SELECT * FROM log")).empty());
+    CHECK(!t.run(a, "DROP TABLE log").ok());    // not inside a transaction
+
+    CHECK(t.run(a, "ROLLBACK").ok());
+    CHECK(!t.run(a, "ROLLBACK").ok());
+    CHECK_EQ(all(t, a, "acct"), acct);
+    CHECK(all(t, a, "log").empty());
+    CHECK(fs::last_write_time("db/acct.txt") == file);
+    CHECK(!fs::exists("db/acct.del"));
+
+    Database reopened;
+    CHECK_EQ(cells(reopened.execute("SELECT * FROM acct")), acct);
+}
+
+TEST(transaction_commit)
+{
+    TestDb t;
+    Session a;
+    CHECK(t.run("CREATE TABLE acct (id INT, balance INT)").ok());
+    CHECK(t.run("CREATE TABLE log (id INT, note STRING)").ok());
+    t.insert("acct", 10, [](int i) { return to_string(i) + ", 100"; });
+
+    CHECK(t.run(a, "BEGIN").ok());
+    CHECK(t.run(a, "UPDATE acct SET balance = balance - 30 WHERE id = 1").ok());
+    CHECK(t.run(a, "UPDATE acct SET balance = balance + 30 WHERE id = 2").ok());
+    CHECK(t.run(a, "INSERT INTO log VALUES (1, transfer)").ok());
+    ResultSet done = t.run(a, "COMMIT");
+    CHECK(done.ok() && done.affected() == 2);
+
+    auto balances = [&](Database& db) { return cells(db.execute("SELECT balance FROM acct WHERE id < 3")); };
+    vector<vector<string>> want = { { "100" }, { "70" }, { "130" } };
+    CHECK_EQ(balances(t.db), want);
+    Database reopened;
+    CHECK_EQ(balances(reopened), want);
+    CHECK_EQ(cells(reopened.execute("SELECT note FROM log")), vector<vector<string>>{ { "transfer" } });
+}
+
+TEST(transaction_conflict_rolls_back)
+{
+    TestDb t;
+    Session a;
+    CHECK(t.run("CREATE TABLE acct (id INT, balance INT)").ok());
+    t.insert("acct", 10, [](int i) { return to_string(i) + ", 100"; });
+
+    CHECK(t.run(a, "BEGIN").ok());
+    CHECK(t.run(a, "UPDATE acct SET balance = 0 WHERE id = 1").ok());
+    CHECK(t.run("UPDATE acct SET balance = 50 WHERE id = 2").ok());    // another session commits first
+
+    ResultSet rs = t.run(a, "COMMIT");
+    CHECK(!rs.ok() && rs.message().find("was changed by another session") != string::npos);
+    CHECK_EQ(cells(t.run("SELECT balance FROM acct WHERE id < 3")), (vector<vector<string>>{ { "100" }, { "100" }, { "50" } }));
+    CHECK(!a.inTransaction());
+}
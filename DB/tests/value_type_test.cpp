@@ -0,0 +1,115 @@
+// fixed-width types: text <-> 64-bit key, key order matching value order,
+// and BIGINT / DOUBLE / BOOL / DATE / TIMESTAMP columns through the engine
+
+#include "engine.h"
+#include "value_type.h"
+
+namespace {
+
+// text as the engine prints it after encoding, "" when the text is rejected
+string roundTrip(ValueType t, string_view text)
+{
+    long long key = 0;
+    return encodeValue(t, text, key) ? formatValue(t, key) : "";
+}
+
+long long keyOf(ValueType t, string_view text)
+{
+    long long key = 0;
+    CHECK(encodeValue(t, text, key));
+    return key;
+}
+
+// keys of values listed in ascending order are ascending too
+bool ascending(ValueType t, const vector<string>& values)
+{
+    for (size_t i = 1; i < values.size(); ++i)
+        if (keyOf(t, values[i - 1]) >= keyOf(t, values[i]))
+            return false;
+    return true;
+}
+
+} // namespace
+
+TEST(value_type_round_trip)
+{
+    CHECK_EQ(roundTrip(ValueType::BigInt, "9223372036854775807"), string("9223372036854775807"));
+    CHECK_EQ(roundTrip(ValueType::BigInt, "-9223372036854775808"), string("-9223372036854775808"));
+    CHECK_EQ(roundTrip(ValueType::BigInt, "9223372036854775808"), string());
+
+    CHECK_EQ(roundTrip(ValueType::Double, "2.5"), string("2.5"));
+    CHECK_EQ(roundTrip(ValueType::Double, "+1"), string("1"));
+    CHECK_EQ(roundTrip(ValueType::Double, "-0"), string("0"));
+    CHECK_EQ(roundTrip(ValueType::Double, "-1e-300"), string("-1e-300"));
+    CHECK_EQ(roundTrip(ValueType::Double, "inf"), string());
+    CHECK_EQ(roundTrip(ValueType::Double, "nan"), string());
+    CHECK_EQ(roundTrip(ValueType::Double, "1.5x"), string());
+
+    CHECK_EQ(roundTrip(ValueType::Bool, "TRUE"), string("true"));
+    CHECK_EQ(roundTrip(ValueType::Bool, "0"), string("false"));
+    CHECK_EQ(roundTrip(ValueType::Bool, "yes"), string());
+
+    CHECK_EQ(roundTrip(ValueType::Date, "2024-02-29"), string("2024-02-29"));
+    CHECK_EQ(roundTrip(ValueType::Date, "1969-12-31"), string("1969-12-31"));
+    CHECK_EQ(roundTrip(ValueType::Date, "2023-02-29"), string());
+    CHECK_EQ(roundTrip(ValueType::Date, "2024-13-01"), string());
+    CHECK_EQ(roundTrip(ValueType::Date, "2024-05-01T00:00"), string());
+    CHECK_EQ(keyOf(ValueType::Date, "1970-01-02"), 1LL);
+
+    CHECK_EQ(roundTrip(ValueType::Timestamp, "2024-05-01T12:30"), string("2024-05-01T12:30:00"));
+    CHECK_EQ(roundTrip(ValueType::Timestamp, "2024-05-01"), string("2024-05-01T00:00:00"));
+    CHECK_EQ(roundTrip(ValueType::Timestamp, "1969-12-31T23:59:59"), string("1969-12-31T23:59:59"));
+    CHECK_EQ(roundTrip(ValueType::Timestamp, "2024-05-01 12:30"), string());
+    CHECK_EQ(roundTrip(ValueType::Timestamp, "2024-05-01T24:00"), string());
+    CHECK_EQ(keyOf(ValueType::Timestamp, "1969-12-31T23:59:59"), -1LL);
+}
+
+TEST(value_type_key_order)
+{
+    CHECK(ascending(ValueType::Double, { "-1e300", "-2.5", "-1", "-1e-300", "0", "1e-300", "1", "2.5", "1e300" }));
+    CHECK_EQ(keyOf(ValueType::Double, "-0"), keyOf(ValueType::Double, "0"));
+    CHECK(ascending(ValueType::Date, { "0001-01-01", "1969-12-31", "1970-01-01", "2000-02-29", "9999-12-31" }));
+    CHECK(ascending(ValueType::Timestamp, { "1969-12-31T23:59:58", "1969-12-31T23:59:59", "1970-01-01", "1970-01-01T00:00:01" }));
+    CHECK(ascending(ValueType::Bool, { "false", "true" }));
+
+    // DOUBLE keys of negatives decode back to the same value
+    bool same = true;
+    for (double d : { -1e300, -2.5, -1e-300, 3.25 })
+        same = same && keyDouble(doubleKey(d)) == d;
+    CHECK(same);
+}
+
+TEST(value_type_columns)
+{
+    TestDb t;
+    CHECK(t.run("CREATE TABLE o (id BIGINT, price DOUBLE, paid BOOL, day DATE, at TIMESTAMP)").ok());
+    CHECK(t.run("INSERT INTO o VALUES (9223372036854775807, -2.5, true, 1969-12-31, 1969-12-31T23:59:59)").ok());
+    CHECK(t.run("INSERT INTO o VALUES (-5, -0, 0, 2024-02-29, 2024-05-01T12:30)").ok());
+    CHECK(t.run("INSERT INTO o VALUES (1, 1e300, FALSE, 2024-03-01, 2024-05-01T12:30:01)").ok());
+    CHECK(!t.run("INSERT INTO o VALUES (1, abc, true, 2024-03-01, 2024-05-01)").ok());
+    CHECK(!t.run("INSERT INTO o VALUES (1, 1, maybe, 2024-03-01, 2024-05-01)").ok());
+    CHECK(!t.run("INSERT INTO o VALUES (1, 1, true, 2023-02-29, 2024-05-01)").ok());
+    CHECK(!t.run("INSERT INTO o VALUES (9223372036854775808, 1, true, 2024-03-01, 2024-05-01)").ok());
+
+    const vector<vector<string>> all = {
+        { "9223372036854775807", "-2.5", "true", "1969-12-31", "1969-12-31T23:59:59" },
+        { "-5", "0", "false", "2024-02-29", "2024-05-01T12:30:00" },
+        { "1", "1e+300", "false", "2024-03-01", "2024-05-01T12:30:01" },
+    };
+    CHECK(cells(t.run("SELECT * FROM o")) == all);
+
+    // predicates compare by value, across the sign of DOUBLE and the epoch
+    auto ids = [&](const string& where) { return cells(t.run("SELECT id FROM o WHERE " + where)); };
+    CHECK(ids("price < 0") == vector<vector<string>>{ { "9223372036854775807" } });
+    CHECK(ids("price >= -0") == vector<vector<string>>({ { "-5" }, { "1" } }));
+    CHECK(ids("price > -3") == vector<vector<string>>({ { "9223372036854775807" }, { "-5" }, { "1" } }));
+    CHECK(ids("at < 1970-01-01T00:00:00") == vector<vector<string>>{ { "9223372036854775807" } });
+    CHECK(ids("at > 2024-05-01T12:30") == vector<vector<string>>{ { "1" } });
+    CHECK(ids("day <= 2024-02-29") == vector<vector<string>>({ { "9223372036854775807" }, { "-5" } }));
+    CHECK(ids("paid = false") == vector<vector<string>>({ { "-5" }, { "1" } }));
+    CHECK(ids("id < 0") == vector<vector<string>>{ { "-5" } });
+
+    // the keys are what the file stores
+    Database reopened;
+    CHECK(cells(reopened.execute("SELECT * FROM o")) == all);
+}
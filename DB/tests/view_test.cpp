@@ -0,0 +1,95 @@
+// materialized views: base INSERT/UPDATE/DELETE applied as deltas, and the
+// view's row mapping after its base is compacted
+
+#include <algorithm>
+#include "engine.h"
+
+namespace {
+
+uint64_t compactions() { return metrics::snapshot().counters[metrics::Compactions]; }
+
+string row(int i) { return string("n").append(to_string(i)) + ", " + to_string(i); }
+
+// a result's cells in a fixed order: the view keeps rows in the order they entered
+vector<vector<string>> sorted(const ResultSet& rs)
+{
+    auto rows = cells(rs);
+    sort(rows.begin(), rows.end());
+    return rows;
+}
+
+// the view holds what its query returns from the base right now
+bool matches(Database& db, const string& view, const string& query)
+{
+    auto want = sorted(db.execute(query));
+    return !want.empty() && sorted(db.execute("SELECT * FROM " + view)) == want;
+}
+
+} // namespace
+
+TEST(view_applies_deltas)
+{
+    TestDb t;
+    CHECK(t.run("CREATE TABLE emp (name STRING, age INT)").ok());
+    t.insert("emp", 100, row);
+    CHECK(t.run("CREATE MATERIALIZED VIEW seniors AS SELECT name, age FROM emp WHERE age > 50").ok());
+    const string query = "SELECT name, age FROM emp WHERE age > 50";
+    CHECK_EQ(cells(t.run("SELECT * FROM seniors")).size(), (size_t)49);
+
+    // a matching row is appended, the others are not
+    CHECK(t.run("INSERT INTO emp VALUES (new, 70)").ok());
+    CHECK(t.run("INSERT INTO emp VALUES (young, 7)").ok());
+    CHECK(cells(t.run("SELECT * FROM seniors")).back() == vector<string>({ "new", "70" }));
+    CHECK(matches(t.db, "seniors", query));
+
+    // rows leave, enter and are rewritten in place
+    CHECK(t.run("UPDATE emp SET age = 10 WHERE age = 60").affected() == 1);
+    CHECK(t.run("UPDATE emp SET age = 90 WHERE age = 5").affected() == 1);
+    CHECK(t.run("UPDATE emp SET name = renamed WHERE age = 80").affected() == 1);
+    CHECK(cells(t.run("SELECT name FROM seniors WHERE age = 80")) == vector<vector<string>>{ { "renamed" } });
+    CHECK(matches(t.db, "seniors", query));
+
+    CHECK(t.run("DELETE FROM emp WHERE age > 95").affected() == 4);
+    CHECK(matches(t.db, "seniors", query));
+    CHECK(!t.run("INSERT INTO seniors VALUES (x, 99)").ok());
+
+    // the view file and its row mapping are read back
+    Database reopened;
+    CHECK(matches(reopened, "seniors", query));
+    CHECK(reopened.execute("UPDATE emp SET age = 1 WHERE age = 90").affected() == 2);
+    CHECK(matches(reopened, "seniors", query));
+}
+
+TEST(view_remapped_after_compaction)
+{
+    TestDb t;
+    CHECK(t.run("CREATE TABLE c (name STRING, v INT)").ok());
+    t.insert("c", 4000, row);
+    CHECK(t.run("CREATE MATERIALIZED VIEW top AS SELECT name, v FROM c WHERE v > 3000").ok());
+    const string query = "SELECT name, v FROM c WHERE v > 3000";
+
+    // 37% of the base deleted: the DELETE compacts it and renumbers its rows
+    uint64_t before = compactions();
+    CHECK(t.run("DELETE FROM c WHERE v < 1500").affected() == 1500);
+    CHECK(compactions() > before);
+    CHECK(matches(t.db, "top", query));
+
+    // later deltas must find the view rows through the new base row ids
+    CHECK(t.run("UPDATE c SET v = 1 WHERE v = 3500").affected() == 1);
+    CHECK(t.run("UPDATE c SET name = moved WHERE v = 3999").affected() == 1);
+    CHECK(t.run("DELETE FROM c WHERE v = 3001").affected() == 1);
+    CHECK(cells(t.run("SELECT name FROM top WHERE v = 3999")) == vector<vector<string>>{ { "moved" } });
+    CHECK(cells(t.run("SELECT name FROM top WHERE v = 3500")).empty());
+    CHECK(matches(t.db, "top", query));
+
+    // a view compacted with its base: deleting most of its rows
+    before = compactions();
+    CHECK(t.run("DELETE FROM c WHERE v > 3100").affected() == 898);
+    CHECK(compactions() > before);
+    CHECK(matches(t.db, "top", query));
+    CHECK(t.run("UPDATE c SET v = 3050 WHERE v = 3002").affected() == 1);
+    CHECK(matches(t.db, "top", query));
+
+    Database reopened;
+    CHECK(matches(reopened, "top", query));
+}
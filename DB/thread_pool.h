@@ -0,0 +1,75 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+using namespace std;
+
+// fixed set of worker threads pulling tasks from one queue
+class ThreadPool {
+    vector<thread> workers_;
+    queue<function<void()>> tasks_;
+    mutex mu_;
+    condition_variable cv_;
+    bool stop_ = false;
+
+public:
+    explicit ThreadPool(size_t n)
+    {
+        if (n == 0)
+            n = 1;
+
+        for (size_t i = 0; i < n; ++i)
+            workers_.emplace_back([this] { loop(); });
+    }
+
+    ~ThreadPool()
+    {
+        {
+            lock_guard<mutex> lk(mu_);
+            stop_ = true;
+        }
+        cv_.notify_all();
+        for (auto& w : workers_)
+            w.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers_.size(); }
+
+    void submit(function<void()> task)
+    {
+        {
+            lock_guard<mutex> lk(mu_);
+            tasks_.push(std::move(task));
+        }
+        cv_.notify_one();
+    }
+
+private:
+    void loop()
+    {
+        while (true) {
+            function<void()> task;
+            {
+                unique_lock<mutex> lk(mu_);
+                cv_.wait(lk, [this] { return stop_ || !tasks_.empty(); });
+
+                if (stop_ && tasks_.empty())
+                    return;
+
+                task = std::move(tasks_.front());
+                tasks_.pop();
+            }
+            task();
+        }
+    }
+};
+
+#endif // THREAD_POOL_H
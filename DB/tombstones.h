@@ -0,0 +1,127 @@
+#ifndef TOMBSTONES_H
+#define TOMBSTONES_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <bit>
+#include "utils.h"
+using namespace std;
+
+// the deleted rows of a table: one bit per row id, grouped in blocks of kBlock
+// rows (the IntColumn / BlockBloom block) with a count of dead rows per block.
+// A scan passes blocks without deletes after one compare and jumps over fully
+// deleted ones. Row ids stay put until the table is compacted.
+class Tombstones {
+public:
+    static constexpr int kBlock = 1024;
+    static constexpr int kWords = kBlock / 64;
+
+private:
+    vector<uint64_t> bits_;     // kWords per block, up to the last block with a delete
+    vector<uint16_t> dead_;     // per block
+    size_t count_ = 0;
+
+public:
+    bool any() const { return count_ > 0; }
+    size_t count() const { return count_; }
+
+    bool dead(int r) const
+    {
+        size_t w = (size_t)r >> 6;
+        return w < bits_.size() && (bits_[w] >> (r & 63)) & 1;
+    }
+
+    // false when the row was deleted already
+    bool kill(int r)
+    {
+        size_t b = (size_t)r / kBlock;
+        if (b >= dead_.size()) {
+            dead_.resize(b + 1, 0);
+            bits_.resize((b + 1) * kWords, 0);
+        }
+        uint64_t& w = bits_[(size_t)r >> 6];
+        uint64_t m = 1ull << (r & 63);
+        if (w & m)
+            return false;
+        w |= m;
+        ++dead_[b];
+        ++count_;
+        return true;
+    }
+
+    void clear()
+    {
+        bits_.clear();
+        dead_.clear();
+        count_ = 0;
+    }
+
+    // first row id >= r (up to end) that is not deleted
+    int nextLive(int r, int end) const
+    {
+        if (count_ == 0)
+            return r;
+        while (r < end) {
+            size_t b = (size_t)r / kBlock;
+            if (b >= dead_.size() || dead_[b] == 0)
+                return r;
+            if (dead_[b] == kBlock) {
+                r = (int)(b + 1) * kBlock;
+                continue;
+            }
+            uint64_t live = ~bits_[(size_t)r >> 6] >> (r & 63);
+            if (live)
+                return min(end, r + countr_zero(live));
+            r = (r | 63) + 1;
+        }
+        return end;
+    }
+
+    // the deleted row ids, ascending
+    vector<int> ids() const
+    {
+        vector<int> out;
+        out.reserve(count_);
+        for (size_t w = 0; w < bits_.size(); ++w)
+            for (uint64_t x = bits_[w]; x; x &= x - 1)
+                out.push_back((int)(w * 64 + countr_zero(x)));
+        return out;
+    }
+
+    // forgets deletes at or above rows (a table file cut short)
+    void truncate(int rows)
+    {
+        vector<int> all = ids();
+        clear();
+        for (int r : all)
+            if (r < rows)
+                kill(r);
+    }
+
+    // "count blocks", and the bitmap in base64 for the line after it (see TableDynamic::save)
+    string header() const { return to_string(count_) + " " + to_string(dead_.size()); }
+    string encode() const { return base64Encode(bits_.data(), bits_.size() * sizeof(uint64_t)); }
+
+    bool decode(size_t blocks, string_view line)
+    {
+        clear();
+        bits_.resize(blocks * kWords);
+        if (blocks && !base64Decode(line, bits_.data(), bits_.size() * sizeof(uint64_t))) {
+            bits_.clear();
+            return false;
+        }
+        dead_.resize(blocks);
+        for (size_t b = 0; b < blocks; ++b) {
+            int n = 0;
+            for (int k = 0; k < kWords; ++k)
+                n += popcount(bits_[b * kWords + k]);
+            dead_[b] = (uint16_t)n;
+            count_ += n;
+        }
+        return true;
+    }
+};
+
+#endif // TOMBSTONES_H
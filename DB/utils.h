@@ -2,6 +2,9 @@
 #define UTILS_H
 
 #include <string>
+#include <string_view>
+#include <vector>
+#include <charconv>
 #include <cctype>
 using namespace std;
 #ifdef _WIN32
@@ -45,7 +48,43 @@ static inline string trim(const string& s) {
     return s.substr(start, end - start + 1);
 }
 
-static inline bool isNumberString(const string& s) {
+static inline bool iequals(string_view a, string_view b) { // case-insensitive compare without copying
+    if (a.size() != b.size())
+        return false;
+
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i]))
+            return false;
+    }
+    return true;
+}
+
+static inline string_view trimView(string_view s) {
+    while (!s.empty() && isspace((unsigned char)s.front()))
+        s.remove_prefix(1);
+
+    while (!s.empty() && isspace((unsigned char)s.back()))
+        s.remove_suffix(1);
+
+    return s;
+}
+
+static inline string lowerCopy(string_view s) {
+    string r(s);
+    for (char& c : r)
+        c = (char)tolower((unsigned char)c);
+    return r;
+}
+
+static inline bool parseInt64(string_view s, long long& out) {
+    if (!s.empty() && s[0] == '+')
+        s.remove_prefix(1);
+
+    auto res = from_chars(s.data(), s.data() + s.size(), out);
+    return res.ec == errc() && res.ptr == s.data() + s.size();
+}
+
+static inline bool isNumberString(string_view s) {
     if (s.empty()) 
         return false;
 
@@ -61,6 +100,53 @@ static inline bool isNumberString(const string& s) {
     return true;
 }
 
+// base64 for binary payloads inside the text table files
+static inline string base64Encode(const void* data, size_t n) {
+    static const char* abc = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const unsigned char* p = (const unsigned char*)data;
+    string out;
+    out.reserve((n + 2) / 3 * 4);
+    for (size_t i = 0; i < n; i += 3) {
+        unsigned v = p[i] << 16;
+        if (i + 1 < n) v |= p[i + 1] << 8;
+        if (i + 2 < n) v |= p[i + 2];
+        out.push_back(abc[(v >> 18) & 63]);
+        out.push_back(abc[(v >> 12) & 63]);
+        out.push_back(i + 1 < n ? abc[(v >> 6) & 63] : '=');
+        out.push_back(i + 2 < n ? abc[v & 63] : '=');
+    }
+    return out;
+}
+
+// decodes exactly n bytes into out, false on malformed input or a length mismatch
+static inline bool base64Decode(string_view s, void* out, size_t n) {
+    auto val = [](char c) -> int {
+        if (c >= 'A' && c <= 'Z') return c - 'A';
+        if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+        if (c >= '0' && c <= '9') return c - '0' + 52;
+        if (c == '+') return 62;
+        if (c == '/') return 63;
+        return -1;
+    };
+    if (s.size() != (n + 2) / 3 * 4)
+        return false;
+
+    unsigned char* p = (unsigned char*)out;
+    size_t o = 0;
+    for (size_t i = 0; i < s.size(); i += 4) {
+        unsigned v = 0;
+        for (int k = 0; k < 4; ++k) {
+            int d = s[i + k] == '=' ? 0 : val(s[i + k]);
+            if (d < 0)
+                return false;
+            v = (v << 6) | (unsigned)d;
+        }
+        for (int k = 2; k >= 0 && o < n; --k)
+            p[o++] = (unsigned char)(v >> (8 * k));
+    }
+    return true;
+}
+
 static inline void ensure_dir(const string& folder) {
 #ifdef _WIN32
     _mkdir(folder.c_str());
@@ -69,4 +155,46 @@ static inline void ensure_dir(const string& folder) {
 #endif
 }
 
+// vector with N elements of inline storage, spills to the heap only when it grows past N
+template <class T, size_t N>
+class SmallVec {
+    T inline_[N] = {};
+    vector<T> heap_;
+    size_t size_ = 0;
+
+public:
+    void push_back(const T& v)
+    {
+        if (size_ < N) {
+            inline_[size_++] = v;
+            return;
+        }
+        if (heap_.empty())
+            heap_.assign(inline_, inline_ + N);
+
+        heap_.push_back(v);
+        ++size_;
+    }
+
+    void clear()
+    {
+        size_ = 0;
+        heap_.clear();
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    T* data() { return size_ > N ? heap_.data() : inline_; }
+    const T* data() const { return size_ > N ? heap_.data() : inline_; }
+
+    T& operator[](size_t i) { return data()[i]; }
+    const T& operator[](size_t i) const { return data()[i]; }
+
+    T* begin() { return data(); }
+    T* end() { return data() + size_; }
+    const T* begin() const { return data(); }
+    const T* end() const { return data() + size_; }
+};
+
 #endif // UTILS_H
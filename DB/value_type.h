@@ -0,0 +1,203 @@
+#ifndef VALUE_TYPE_H
+#define VALUE_TYPE_H
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <cstdio>
+#include <charconv>
+#include "utils.h"
+using namespace std;
+
+// column types. Every type but STRING is fixed width: a cell is stored as one
+// 64-bit key in an IntColumn, and keys order like the values they stand for, so
+// zone maps and range predicates compare keys without decoding anything.
+//   INT, BIGINT  the number (an INT too wide for 64 bits turns the column plain)
+//   DOUBLE       the IEEE bits, negatives with the magnitude bits flipped
+//   BOOL         0 / 1, written false / true
+//   DATE         days since 1970-01-01, written YYYY-MM-DD
+//   TIMESTAMP    seconds since 1970-01-01T00:00:00 UTC, written YYYY-MM-DDTHH:MM:SS
+enum class ValueType : uint8_t { Int, BigInt, Double, Bool, Date, Timestamp, String };
+
+static inline const char* typeName(ValueType t) {
+    switch (t) {
+    case ValueType::Int: return "INT";
+    case ValueType::BigInt: return "BIGINT";
+    case ValueType::Double: return "DOUBLE";
+    case ValueType::Bool: return "BOOL";
+    case ValueType::Date: return "DATE";
+    case ValueType::Timestamp: return "TIMESTAMP";
+    default: return "STRING";
+    }
+}
+
+// case-insensitive, false for names that are not a column type
+static inline bool parseValueType(string_view name, ValueType& t) {
+    for (int i = 0; i <= (int)ValueType::String; ++i)
+        if (iequals(name, typeName((ValueType)i))) {
+            t = (ValueType)i;
+            return true;
+        }
+    return false;
+}
+
+// schema type name -> type, unknown names are STRING
+static inline ValueType valueTypeOf(string_view name) {
+    ValueType t = ValueType::String;
+    parseValueType(name, t);
+    return t;
+}
+
+static inline bool isFixedWidth(ValueType t) { return t != ValueType::String; }
+
+// integer types: UPDATE arithmetic works on them
+static inline bool isIntegral(ValueType t) { return t == ValueType::Int || t == ValueType::BigInt; }
+
+// proleptic Gregorian calendar <-> days since 1970-01-01
+static inline long long daysFromCivil(long long y, unsigned m, unsigned d) {
+    y -= m <= 2;
+    long long era = (y >= 0 ? y : y - 399) / 400;
+    unsigned yoe = (unsigned)(y - era * 400);
+    unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (long long)doe - 719468;
+}
+
+static inline void civilFromDays(long long z, long long& y, unsigned& m, unsigned& d) {
+    z += 719468;
+    long long era = (z >= 0 ? z : z - 146096) / 146097;
+    unsigned doe = (unsigned)(z - era * 146097);
+    unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    unsigned mp = (5 * doy + 2) / 153;
+    d = doy - (153 * mp + 2) / 5 + 1;
+    m = mp < 10 ? mp + 3 : mp - 9;
+    y = (long long)yoe + era * 400 + (m <= 2);
+}
+
+// exactly n digits at s[at..], in [lo, hi]
+static inline bool digitsAt(string_view s, size_t at, size_t n, unsigned lo, unsigned hi, unsigned& out) {
+    if (at + n > s.size())
+        return false;
+    out = 0;
+    for (size_t i = at; i < at + n; ++i) {
+        if (!isdigit((unsigned char)s[i]))
+            return false;
+        out = out * 10 + (unsigned)(s[i] - '0');
+    }
+    return out >= lo && out <= hi;
+}
+
+// YYYY-MM-DD, years 0001..9999
+static inline bool parseDate(string_view s, long long& days) {
+    unsigned y = 0, m = 0, d = 0;
+    if (s.size() < 10 || s[4] != '-' || s[7] != '-'
+        || !digitsAt(s, 0, 4, 1, 9999, y) || !digitsAt(s, 5, 2, 1, 12, m) || !digitsAt(s, 8, 2, 1, 31, d))
+        return false;
+    static const unsigned mdays[12] = { 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    bool leap = y % 4 == 0 && (y % 100 != 0 || y % 400 == 0);
+    if (d > mdays[m - 1] || (m == 2 && d == 29 && !leap))
+        return false;
+    days = daysFromCivil(y, m, d);
+    return true;
+}
+
+// YYYY-MM-DD[THH:MM[:SS]]
+static inline bool parseTimestamp(string_view s, long long& secs) {
+    long long days = 0;
+    if (!parseDate(s, days))
+        return false;
+    unsigned h = 0, mi = 0, sec = 0;
+    if (s.size() > 10) {
+        if ((s[10] != 'T' && s[10] != 't') || (s.size() != 16 && s.size() != 19)
+            || !digitsAt(s, 11, 2, 0, 23, h) || s[13] != ':' || !digitsAt(s, 14, 2, 0, 59, mi))
+            return false;
+        if (s.size() == 19 && (s[16] != ':' || !digitsAt(s, 17, 2, 0, 59, sec)))
+            return false;
+    }
+    secs = days * 86400 + h * 3600 + mi * 60 + sec;
+    return true;
+}
+
+static inline long long doubleKey(double d) {
+    if (d == 0)
+        d = 0;      // -0 equals 0
+    long long b;
+    memcpy(&b, &d, sizeof(b));
+    return b < 0 ? b ^ 0x7fffffffffffffffLL : b;
+}
+
+static inline double keyDouble(long long k) {
+    if (k < 0)
+        k ^= 0x7fffffffffffffffLL;
+    double d;
+    memcpy(&d, &k, sizeof(d));
+    return d;
+}
+
+// text -> key of a fixed-width type; false when the text is not a value of t
+static inline bool encodeValue(ValueType t, string_view s, long long& key) {
+    switch (t) {
+    case ValueType::Int:
+    case ValueType::BigInt:
+        return parseInt64(s, key);
+    case ValueType::Double: {
+        if (!s.empty() && s[0] == '+')
+            s.remove_prefix(1);
+        double d = 0;
+        auto r = from_chars(s.data(), s.data() + s.size(), d);
+        if (s.empty() || r.ec != errc() || r.ptr != s.data() + s.size() || !isfinite(d))
+            return false;
+        key = doubleKey(d);
+        return true;
+    }
+    case ValueType::Bool:
+        if (iequals(s, "true") || s == "1") { key = 1; return true; }
+        if (iequals(s, "false") || s == "0") { key = 0; return true; }
+        return false;
+    case ValueType::Date:
+        return s.size() == 10 && parseDate(s, key);
+    case ValueType::Timestamp:
+        return parseTimestamp(s, key);
+    default:
+        return false;
+    }
+}
+
+// key -> text into buf (at least 32 bytes), returns the end
+static inline char* formatValue(ValueType t, long long key, char* buf) {
+    switch (t) {
+    case ValueType::Double:
+        return to_chars(buf, buf + 32, keyDouble(key)).ptr;
+    case ValueType::Bool: {
+        const char* w = key ? "true" : "false";
+        size_t n = strlen(w);
+        memcpy(buf, w, n);
+        return buf + n;
+    }
+    case ValueType::Date:
+    case ValueType::Timestamp: {
+        long long days = t == ValueType::Date ? key : (key >= 0 ? key / 86400 : (key - 86399) / 86400);
+        long long y = 0;
+        unsigned m = 0, d = 0;
+        civilFromDays(days, y, m, d);
+        int n = snprintf(buf, 32, "%04lld-%02u-%02u", y, m, d);
+        if (t == ValueType::Timestamp) {
+            long long s = key - days * 86400;
+            n += snprintf(buf + n, 32 - n, "T%02lld:%02lld:%02lld", s / 3600, s / 60 % 60, s % 60);
+        }
+        return buf + n;
+    }
+    default:
+        return to_chars(buf, buf + 32, key).ptr;
+    }
+}
+
+static inline string formatValue(ValueType t, long long key) {
+    char buf[32];
+    return string(buf, formatValue(t, key, buf));
+}
+
+#endif // VALUE_TYPE_H